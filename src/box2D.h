@@ -0,0 +1,532 @@
+/*
+
+	- Axis aligned box type and SIMD overlap kernels
+
+	Box2D<Coord> is an axis aligned box with inclusive bounds for any arithmetic
+	coordinate type. i.e. float for screen space, double for large worlds and
+	int32_t/int64_t for fixed point simulations.
+
+	Testing one box against many is done on structure of arrays (BoxArray2D) with SSE/AVX
+	kernels for float, double, int32_t and int64_t when the compiler targets them, and a
+	scalar loop otherwise.
+*/
+
+#ifndef __BOX_2D_H_
+#define __BOX_2D_H_
+
+#include <vector>
+#include <algorithm>
+#include <type_traits>
+#include <limits>
+#include <cmath>
+#include <cstdint>
+#include <cstddef>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SEARCH_TREE_SSE2 1
+#include <emmintrin.h>
+#endif
+
+#if defined(__SSE4_2__)
+#define SEARCH_TREE_SSE42 1
+#include <nmmintrin.h>
+#endif
+
+#if defined(__AVX__)
+#define SEARCH_TREE_AVX 1
+#endif
+
+#if defined(__AVX2__)
+#define SEARCH_TREE_AVX2 1
+#endif
+
+#if defined(SEARCH_TREE_AVX) || defined(SEARCH_TREE_AVX2)
+#include <immintrin.h>
+#endif
+
+//=======================================
+// Box Type
+//=======================================
+
+// Axis aligned box. Bounds are inclusive
+template<class Coord>
+struct Box2D {
+	static_assert(std::is_arithmetic<Coord>::value, "Box2D requires an arithmetic coordinate type");
+
+	Coord minX;
+	Coord minY;
+	Coord maxX;
+	Coord maxY;
+};
+
+template<class Coord>
+bool operator==(const Box2D<Coord>& left, const Box2D<Coord>& right) {
+	return left.minX == right.minX && left.minY == right.minY && left.maxX == right.maxX && left.maxY == right.maxY;
+}
+
+template<class Coord>
+bool operator!=(const Box2D<Coord>& left, const Box2D<Coord>& right) {
+	return !(left == right);
+}
+
+// A point with the same coordinate type as Box2D
+template<class Coord>
+struct Point2D {
+	Coord x;
+	Coord y;
+};
+
+// Returns true if the two boxes share at least one point
+template<class Coord>
+bool boxOverlaps(const Box2D<Coord>& left, const Box2D<Coord>& right) {
+	return left.minX <= right.maxX && right.minX <= left.maxX &&
+		   left.minY <= right.maxY && right.minY <= left.maxY;
+}
+
+// Returns true if inner lies entirely inside outer
+template<class Coord>
+bool boxContains(const Box2D<Coord>& outer, const Box2D<Coord>& inner) {
+	return outer.minX <= inner.minX && inner.maxX <= outer.maxX &&
+		   outer.minY <= inner.minY && inner.maxY <= outer.maxY;
+}
+
+// Returns true if inner lies inside outer without touching any of its edges
+template<class Coord>
+bool boxContainsStrictly(const Box2D<Coord>& outer, const Box2D<Coord>& inner) {
+	return outer.minX < inner.minX && inner.maxX < outer.maxX &&
+		   outer.minY < inner.minY && inner.maxY < outer.maxY;
+}
+
+// Returns the squared distance between the closest points of the two boxes. Zero if they overlap
+template<class Coord>
+double boxDistanceSquared(const Box2D<Coord>& left, const Box2D<Coord>& right) {
+	double dx = std::max(0.0, std::max(static_cast<double>(left.minX) - right.maxX, static_cast<double>(right.minX) - left.maxX));
+	double dy = std::max(0.0, std::max(static_cast<double>(left.minY) - right.maxY, static_cast<double>(right.minY) - left.maxY));
+	return dx * dx + dy * dy;
+}
+
+namespace searchTreeDetail {
+
+	// Narrows [enter, exit] to the times the interval [low, high] moving by delta overlaps
+	// [targetLow, targetHigh]. Returns false if the narrowed range is empty
+	inline bool sweepInterval(double low, double high, double delta, double targetLow, double targetHigh, double& enter, double& exit) {
+		if (delta == 0) {
+			return low <= targetHigh && targetLow <= high;
+		}
+
+		double first = (targetLow - high) / delta;
+		double last = (targetHigh - low) / delta;
+		if (delta < 0) {
+			std::swap(first, last);
+		}
+		enter = std::max(enter, first);
+		exit = std::min(exit, last);
+		return enter <= exit;
+	}
+}
+
+// Finds when box, moving by displacement, first touches target as a fraction of the displacement
+// in [0, 1]. Returns false if they don't touch during the move
+template<class Coord>
+bool boxSweepTime(const Box2D<Coord>& box, const Point2D<Coord>& displacement, const Box2D<Coord>& target, double& time) {
+	double enter = 0;
+	double exit = 1;
+	if (!searchTreeDetail::sweepInterval(box.minX, box.maxX, displacement.x, target.minX, target.maxX, enter, exit) ||
+		!searchTreeDetail::sweepInterval(box.minY, box.maxY, displacement.y, target.minY, target.maxY, enter, exit)) {
+		return false;
+	}
+	time = enter;
+	return true;
+}
+
+// Returns the smallest box holding both boxes
+template<class Coord>
+Box2D<Coord> boxUnion(const Box2D<Coord>& left, const Box2D<Coord>& right) {
+	Box2D<Coord> box = {
+		std::min(left.minX, right.minX), std::min(left.minY, right.minY),
+		std::max(left.maxX, right.maxX), std::max(left.maxY, right.maxY)
+	};
+	return box;
+}
+
+// Midpoint of [low, high]. Integer midpoints round down and never overflow
+template<class Coord>
+typename std::enable_if<std::is_floating_point<Coord>::value, Coord>::type boxMidpoint(Coord low, Coord high) {
+	return low + (high - low) / 2;
+}
+
+template<class Coord>
+typename std::enable_if<std::is_integral<Coord>::value, Coord>::type boxMidpoint(Coord low, Coord high) {
+	// Shared bits plus half of the differing bits is floor((low + high) / 2) without the sum
+	return static_cast<Coord>((low & high) + ((low ^ high) >> 1));
+}
+
+// Width of [low, high], or 0 if high < low. Integer widths saturate at the largest Coord
+template<class Coord>
+typename std::enable_if<std::is_floating_point<Coord>::value, Coord>::type boxExtent(Coord low, Coord high) {
+	return high < low ? Coord(0) : high - low;
+}
+
+template<class Coord>
+typename std::enable_if<std::is_integral<Coord>::value, Coord>::type boxExtent(Coord low, Coord high) {
+	using Unsigned = typename std::make_unsigned<Coord>::type;
+	if (high < low) {
+		return 0;
+	}
+	Unsigned width = static_cast<Unsigned>(static_cast<Unsigned>(high) - static_cast<Unsigned>(low));
+	return width > static_cast<Unsigned>(std::numeric_limits<Coord>::max()) ? std::numeric_limits<Coord>::max() : static_cast<Coord>(width);
+}
+
+// value - delta and value + delta for delta >= 0. Integer results saturate at the limits of Coord
+template<class Coord>
+typename std::enable_if<std::is_floating_point<Coord>::value, Coord>::type boxSaturatingSub(Coord value, Coord delta) {
+	return value - delta;
+}
+
+template<class Coord>
+typename std::enable_if<std::is_integral<Coord>::value, Coord>::type boxSaturatingSub(Coord value, Coord delta) {
+	return value < std::numeric_limits<Coord>::lowest() + delta ? std::numeric_limits<Coord>::lowest() : static_cast<Coord>(value - delta);
+}
+
+template<class Coord>
+typename std::enable_if<std::is_floating_point<Coord>::value, Coord>::type boxSaturatingAdd(Coord value, Coord delta) {
+	return value + delta;
+}
+
+template<class Coord>
+typename std::enable_if<std::is_integral<Coord>::value, Coord>::type boxSaturatingAdd(Coord value, Coord delta) {
+	return value > std::numeric_limits<Coord>::max() - delta ? std::numeric_limits<Coord>::max() : static_cast<Coord>(value + delta);
+}
+
+// Returns the box grown by distance >= 0 on every side
+template<class Coord>
+Box2D<Coord> boxInflate(const Box2D<Coord>& box, Coord distance) {
+	Box2D<Coord> grown = {
+		boxSaturatingSub(box.minX, distance), boxSaturatingSub(box.minY, distance),
+		boxSaturatingAdd(box.maxX, distance), boxSaturatingAdd(box.maxY, distance)
+	};
+	return grown;
+}
+
+// Returns true if [low, high] is wider than the subdivision floor. Integer ranges stop at a
+// width of 1, where the midpoint is low. Floating point ranges stop at 64 ulps of their
+// magnitude (or of 1 near the origin), well before the midpoint stops making progress
+template<class Coord>
+typename std::enable_if<std::is_floating_point<Coord>::value, bool>::type boxCanSplit(Coord low, Coord high) {
+	Coord magnitude = std::max(Coord(1), std::max(std::abs(low), std::abs(high)));
+	return high - low > magnitude * std::numeric_limits<Coord>::epsilon() * 64;
+}
+
+template<class Coord>
+typename std::enable_if<std::is_integral<Coord>::value, bool>::type boxCanSplit(Coord low, Coord high) {
+	return low < high && boxMidpoint(low, high) != low;
+}
+
+//=======================================
+// Structure of Arrays Kernels
+//=======================================
+
+// Boxes stored as four coordinate arrays so they can be tested in SIMD batches
+template<class Coord>
+struct BoxArray2D {
+	std::vector<Coord> minX;
+	std::vector<Coord> minY;
+	std::vector<Coord> maxX;
+	std::vector<Coord> maxY;
+
+	std::size_t size() const {
+		return minX.size();
+	}
+
+	void clear() {
+		minX.clear();
+		minY.clear();
+		maxX.clear();
+		maxY.clear();
+	}
+
+	void reserve(std::size_t count) {
+		minX.reserve(count);
+		minY.reserve(count);
+		maxX.reserve(count);
+		maxY.reserve(count);
+	}
+
+	void push_back(const Box2D<Coord>& box) {
+		minX.push_back(box.minX);
+		minY.push_back(box.minY);
+		maxX.push_back(box.maxX);
+		maxY.push_back(box.maxY);
+	}
+
+	void insert(std::size_t index, const Box2D<Coord>& box) {
+		minX.insert(minX.begin() + index, box.minX);
+		minY.insert(minY.begin() + index, box.minY);
+		maxX.insert(maxX.begin() + index, box.maxX);
+		maxY.insert(maxY.begin() + index, box.maxY);
+	}
+
+	void erase(std::size_t index) {
+		minX.erase(minX.begin() + index);
+		minY.erase(minY.begin() + index);
+		maxX.erase(maxX.begin() + index);
+		maxY.erase(maxY.begin() + index);
+	}
+
+	Box2D<Coord> at(std::size_t index) const {
+		Box2D<Coord> box = { minX[index], minY[index], maxX[index], maxY[index] };
+		return box;
+	}
+};
+
+namespace searchTreeDetail {
+
+	// Appends the indices of set bits in mask, offset by base
+	inline std::size_t appendMaskIndices(unsigned mask, std::size_t base, std::size_t* outIndices) {
+		std::size_t count = 0;
+		while (mask) {
+			unsigned bit = 0;
+			while (!(mask & (1u << bit))) {
+				++bit;
+			}
+			outIndices[count++] = base + bit;
+			mask &= mask - 1;
+		}
+		return count;
+	}
+
+	// Scalar tail shared by all kernels
+	template<class Coord>
+	std::size_t boxOverlapScalar(const Box2D<Coord>& query, const Coord* minX, const Coord* minY, const Coord* maxX, const Coord* maxY,
+								 std::size_t begin, std::size_t end, std::size_t* outIndices)
+	{
+		std::size_t count = 0;
+		for (std::size_t i = begin; i < end; ++i) {
+			if (query.minX <= maxX[i] && minX[i] <= query.maxX && query.minY <= maxY[i] && minY[i] <= query.maxY) {
+				outIndices[count++] = i;
+			}
+		}
+		return count;
+	}
+}
+
+// Tests query against boxes [begin, end) of the arrays and writes the indices of the boxes
+// that overlap it to outIndices, which must have room for end - begin entries.
+// Returns the number of indices written
+template<class Coord>
+std::size_t boxOverlapBatch(const Box2D<Coord>& query, const Coord* minX, const Coord* minY, const Coord* maxX, const Coord* maxY,
+							std::size_t begin, std::size_t end, std::size_t* outIndices)
+{
+	return searchTreeDetail::boxOverlapScalar(query, minX, minY, maxX, maxY, begin, end, outIndices);
+}
+
+inline std::size_t boxOverlapBatch(const Box2D<float>& query, const float* minX, const float* minY, const float* maxX, const float* maxY,
+								   std::size_t begin, std::size_t end, std::size_t* outIndices)
+{
+	std::size_t count = 0;
+	std::size_t i = begin;
+
+#if defined(SEARCH_TREE_AVX)
+	{
+		__m256 qMinX = _mm256_set1_ps(query.minX);
+		__m256 qMinY = _mm256_set1_ps(query.minY);
+		__m256 qMaxX = _mm256_set1_ps(query.maxX);
+		__m256 qMaxY = _mm256_set1_ps(query.maxY);
+		for (; i + 8 <= end; i += 8) {
+			__m256 overlapX = _mm256_and_ps(_mm256_cmp_ps(qMinX, _mm256_loadu_ps(maxX + i), _CMP_LE_OQ),
+											_mm256_cmp_ps(_mm256_loadu_ps(minX + i), qMaxX, _CMP_LE_OQ));
+			__m256 overlapY = _mm256_and_ps(_mm256_cmp_ps(qMinY, _mm256_loadu_ps(maxY + i), _CMP_LE_OQ),
+											_mm256_cmp_ps(_mm256_loadu_ps(minY + i), qMaxY, _CMP_LE_OQ));
+			unsigned mask = static_cast<unsigned>(_mm256_movemask_ps(_mm256_and_ps(overlapX, overlapY)));
+			count += searchTreeDetail::appendMaskIndices(mask, i, outIndices + count);
+		}
+	}
+#endif
+
+#if defined(SEARCH_TREE_SSE2)
+	{
+		__m128 qMinX = _mm_set1_ps(query.minX);
+		__m128 qMinY = _mm_set1_ps(query.minY);
+		__m128 qMaxX = _mm_set1_ps(query.maxX);
+		__m128 qMaxY = _mm_set1_ps(query.maxY);
+		for (; i + 4 <= end; i += 4) {
+			__m128 overlapX = _mm_and_ps(_mm_cmple_ps(qMinX, _mm_loadu_ps(maxX + i)), _mm_cmple_ps(_mm_loadu_ps(minX + i), qMaxX));
+			__m128 overlapY = _mm_and_ps(_mm_cmple_ps(qMinY, _mm_loadu_ps(maxY + i)), _mm_cmple_ps(_mm_loadu_ps(minY + i), qMaxY));
+			unsigned mask = static_cast<unsigned>(_mm_movemask_ps(_mm_and_ps(overlapX, overlapY)));
+			count += searchTreeDetail::appendMaskIndices(mask, i, outIndices + count);
+		}
+	}
+#endif
+
+	return count + searchTreeDetail::boxOverlapScalar(query, minX, minY, maxX, maxY, i, end, outIndices + count);
+}
+
+inline std::size_t boxOverlapBatch(const Box2D<double>& query, const double* minX, const double* minY, const double* maxX, const double* maxY,
+								   std::size_t begin, std::size_t end, std::size_t* outIndices)
+{
+	std::size_t count = 0;
+	std::size_t i = begin;
+
+#if defined(SEARCH_TREE_AVX)
+	{
+		__m256d qMinX = _mm256_set1_pd(query.minX);
+		__m256d qMinY = _mm256_set1_pd(query.minY);
+		__m256d qMaxX = _mm256_set1_pd(query.maxX);
+		__m256d qMaxY = _mm256_set1_pd(query.maxY);
+		for (; i + 4 <= end; i += 4) {
+			__m256d overlapX = _mm256_and_pd(_mm256_cmp_pd(qMinX, _mm256_loadu_pd(maxX + i), _CMP_LE_OQ),
+											 _mm256_cmp_pd(_mm256_loadu_pd(minX + i), qMaxX, _CMP_LE_OQ));
+			__m256d overlapY = _mm256_and_pd(_mm256_cmp_pd(qMinY, _mm256_loadu_pd(maxY + i), _CMP_LE_OQ),
+											 _mm256_cmp_pd(_mm256_loadu_pd(minY + i), qMaxY, _CMP_LE_OQ));
+			unsigned mask = static_cast<unsigned>(_mm256_movemask_pd(_mm256_and_pd(overlapX, overlapY)));
+			count += searchTreeDetail::appendMaskIndices(mask, i, outIndices + count);
+		}
+	}
+#endif
+
+#if defined(SEARCH_TREE_SSE2)
+	{
+		__m128d qMinX = _mm_set1_pd(query.minX);
+		__m128d qMinY = _mm_set1_pd(query.minY);
+		__m128d qMaxX = _mm_set1_pd(query.maxX);
+		__m128d qMaxY = _mm_set1_pd(query.maxY);
+		for (; i + 2 <= end; i += 2) {
+			__m128d overlapX = _mm_and_pd(_mm_cmple_pd(qMinX, _mm_loadu_pd(maxX + i)), _mm_cmple_pd(_mm_loadu_pd(minX + i), qMaxX));
+			__m128d overlapY = _mm_and_pd(_mm_cmple_pd(qMinY, _mm_loadu_pd(maxY + i)), _mm_cmple_pd(_mm_loadu_pd(minY + i), qMaxY));
+			unsigned mask = static_cast<unsigned>(_mm_movemask_pd(_mm_and_pd(overlapX, overlapY)));
+			count += searchTreeDetail::appendMaskIndices(mask, i, outIndices + count);
+		}
+	}
+#endif
+
+	return count + searchTreeDetail::boxOverlapScalar(query, minX, minY, maxX, maxY, i, end, outIndices + count);
+}
+
+inline std::size_t boxOverlapBatch(const Box2D<std::int32_t>& query, const std::int32_t* minX, const std::int32_t* minY,
+								   const std::int32_t* maxX, const std::int32_t* maxY,
+								   std::size_t begin, std::size_t end, std::size_t* outIndices)
+{
+	std::size_t count = 0;
+	std::size_t i = begin;
+
+	// Integer compares only come in greater-than form, so test for separation and invert
+
+#if defined(SEARCH_TREE_AVX2)
+	{
+		__m256i qMinX = _mm256_set1_epi32(query.minX);
+		__m256i qMinY = _mm256_set1_epi32(query.minY);
+		__m256i qMaxX = _mm256_set1_epi32(query.maxX);
+		__m256i qMaxY = _mm256_set1_epi32(query.maxY);
+		for (; i + 8 <= end; i += 8) {
+			__m256i apartX = _mm256_or_si256(_mm256_cmpgt_epi32(qMinX, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(maxX + i))),
+											 _mm256_cmpgt_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(minX + i)), qMaxX));
+			__m256i apartY = _mm256_or_si256(_mm256_cmpgt_epi32(qMinY, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(maxY + i))),
+											 _mm256_cmpgt_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(minY + i)), qMaxY));
+			unsigned apart = static_cast<unsigned>(_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_or_si256(apartX, apartY))));
+			count += searchTreeDetail::appendMaskIndices(~apart & 0xFFu, i, outIndices + count);
+		}
+	}
+#endif
+
+#if defined(SEARCH_TREE_SSE2)
+	{
+		__m128i qMinX = _mm_set1_epi32(query.minX);
+		__m128i qMinY = _mm_set1_epi32(query.minY);
+		__m128i qMaxX = _mm_set1_epi32(query.maxX);
+		__m128i qMaxY = _mm_set1_epi32(query.maxY);
+		for (; i + 4 <= end; i += 4) {
+			__m128i apartX = _mm_or_si128(_mm_cmpgt_epi32(qMinX, _mm_loadu_si128(reinterpret_cast<const __m128i*>(maxX + i))),
+										  _mm_cmpgt_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(minX + i)), qMaxX));
+			__m128i apartY = _mm_or_si128(_mm_cmpgt_epi32(qMinY, _mm_loadu_si128(reinterpret_cast<const __m128i*>(maxY + i))),
+										  _mm_cmpgt_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(minY + i)), qMaxY));
+			unsigned apart = static_cast<unsigned>(_mm_movemask_ps(_mm_castsi128_ps(_mm_or_si128(apartX, apartY))));
+			count += searchTreeDetail::appendMaskIndices(~apart & 0xFu, i, outIndices + count);
+		}
+	}
+#endif
+
+	return count + searchTreeDetail::boxOverlapScalar(query, minX, minY, maxX, maxY, i, end, outIndices + count);
+}
+
+inline std::size_t boxOverlapBatch(const Box2D<std::int64_t>& query, const std::int64_t* minX, const std::int64_t* minY,
+								   const std::int64_t* maxX, const std::int64_t* maxY,
+								   std::size_t begin, std::size_t end, std::size_t* outIndices)
+{
+	std::size_t count = 0;
+	std::size_t i = begin;
+
+	// 64 bit compares need AVX2 or SSE4.2
+
+#if defined(SEARCH_TREE_AVX2)
+	{
+		__m256i qMinX = _mm256_set1_epi64x(query.minX);
+		__m256i qMinY = _mm256_set1_epi64x(query.minY);
+		__m256i qMaxX = _mm256_set1_epi64x(query.maxX);
+		__m256i qMaxY = _mm256_set1_epi64x(query.maxY);
+		for (; i + 4 <= end; i += 4) {
+			__m256i apartX = _mm256_or_si256(_mm256_cmpgt_epi64(qMinX, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(maxX + i))),
+											 _mm256_cmpgt_epi64(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(minX + i)), qMaxX));
+			__m256i apartY = _mm256_or_si256(_mm256_cmpgt_epi64(qMinY, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(maxY + i))),
+											 _mm256_cmpgt_epi64(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(minY + i)), qMaxY));
+			unsigned apart = static_cast<unsigned>(_mm256_movemask_pd(_mm256_castsi256_pd(_mm256_or_si256(apartX, apartY))));
+			count += searchTreeDetail::appendMaskIndices(~apart & 0xFu, i, outIndices + count);
+		}
+	}
+#endif
+
+#if defined(SEARCH_TREE_SSE42)
+	{
+		__m128i qMinX = _mm_set1_epi64x(query.minX);
+		__m128i qMinY = _mm_set1_epi64x(query.minY);
+		__m128i qMaxX = _mm_set1_epi64x(query.maxX);
+		__m128i qMaxY = _mm_set1_epi64x(query.maxY);
+		for (; i + 2 <= end; i += 2) {
+			__m128i apartX = _mm_or_si128(_mm_cmpgt_epi64(qMinX, _mm_loadu_si128(reinterpret_cast<const __m128i*>(maxX + i))),
+										  _mm_cmpgt_epi64(_mm_loadu_si128(reinterpret_cast<const __m128i*>(minX + i)), qMaxX));
+			__m128i apartY = _mm_or_si128(_mm_cmpgt_epi64(qMinY, _mm_loadu_si128(reinterpret_cast<const __m128i*>(maxY + i))),
+										  _mm_cmpgt_epi64(_mm_loadu_si128(reinterpret_cast<const __m128i*>(minY + i)), qMaxY));
+			unsigned apart = static_cast<unsigned>(_mm_movemask_pd(_mm_castsi128_pd(_mm_or_si128(apartX, apartY))));
+			count += searchTreeDetail::appendMaskIndices(~apart & 0x3u, i, outIndices + count);
+		}
+	}
+#endif
+
+	return count + searchTreeDetail::boxOverlapScalar(query, minX, minY, maxX, maxY, i, end, outIndices + count);
+}
+
+// Convenience overload over a whole BoxArray2D. outIndices is resized to the number of hits
+template<class Coord>
+void boxOverlapBatch(const Box2D<Coord>& query, const BoxArray2D<Coord>& boxes, std::vector<std::size_t>& outIndices) {
+	outIndices.resize(boxes.size());
+	if (boxes.size() == 0) {
+		return;
+	}
+	std::size_t count = boxOverlapBatch(query, boxes.minX.data(), boxes.minY.data(), boxes.maxX.data(), boxes.maxY.data(),
+										0, boxes.size(), outIndices.data());
+	outIndices.resize(count);
+}
+
+// Sweep and prune over boxes sorted by min x. Calls onPair(i, j) with i < j for every pair of
+// overlapping boxes. Each box is tested in SIMD batches against only the boxes that start
+// before it ends
+template<class Coord, class OnPair>
+void boxOverlapPairs(const BoxArray2D<Coord>& boxes, OnPair onPair) {
+
+	std::size_t count = boxes.size();
+	if (count < 2) {
+		return;
+	}
+
+	const Coord* minX = boxes.minX.data();
+	std::vector<std::size_t> vecHits(count);
+	for (std::size_t i = 0; i + 1 < count; ++i) {
+		std::size_t end = std::upper_bound(minX + i + 1, minX + count, boxes.maxX[i]) - minX;
+		std::size_t hitCount = boxOverlapBatch(boxes.at(i), minX, boxes.minY.data(), boxes.maxX.data(), boxes.maxY.data(),
+											   i + 1, end, vecHits.data());
+		for (std::size_t hit = 0; hit < hitCount; ++hit) {
+			onPair(i, vecHits[hit]);
+		}
+	}
+}
+
+#endif
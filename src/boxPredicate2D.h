@@ -0,0 +1,326 @@
+/*
+
+	- Built in axis aligned box predicates for the generic 2D search tree
+
+	Usage:
+	BoxPredicate2D<Value, Coord, BoxOf> implements SearchPredicate<Value, Box2D<Coord>>
+	where BoxOf is a default constructible functor returning the Box2D<Coord> of a value:
+
+		struct SpriteBox {
+			Box2D<double> operator()(const Sprite* sprite) const { ... }
+		};
+		using SpriteTree = SearchTree2D<Sprite*, Box2D<double>, BoxPredicate2D<Sprite*, double, SpriteBox>>;
+
+	PointPredicate2D<Value, Coord, PointOf> is the same predicate for values that are
+	points, where PointOf returns a Point2D<Coord>. Points never straddle quadrants, so
+	it routes each value to exactly one child (see quadrantOf) and the tree never has
+	to deduplicate query results.
+
+	Quadrants follow screen space: UPPER quadrants have the smaller y values.
+
+	Box2D and the SIMD overlap kernels live in box2D.h.
+*/
+
+#ifndef __BOX_PREDICATE_2D_H_
+#define __BOX_PREDICATE_2D_H_
+
+#include <vector>
+#include <set>
+#include <map>
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+#include <limits>
+
+#include "searchTree2D.h"
+#include "box2D.h"
+
+//=======================================
+// Box Predicate
+//=======================================
+template<class Value, class Coord, class BoxOf>
+class BoxPredicate2D : public SearchPredicate<Value, Box2D<Coord> > {
+public:
+
+	using Box = Box2D<Coord>;
+	using CoordType = Coord;
+
+	// Unit box at the origin
+	virtual Box nilCompare() override {
+		Box box = { 0, 0, 1, 1 };
+		return box;
+	}
+
+	// Smallest box holding every value. The nil box if there are no values
+	virtual Box buildRegionFromData(const std::set<Value>& values) override {
+		if (values.empty()) {
+			return nilCompare();
+		}
+
+		auto itVal = values.begin();
+		Box region = boxOf(*itVal);
+		for (++itVal; itVal != values.end(); ++itVal) {
+			region = boxUnion(region, boxOf(*itVal));
+		}
+		return region;
+	}
+
+	// Splits the parent into four equal quadrants sharing their inner edges (see subregion)
+	virtual void buildQuadrantsFromData(const Box& parentRegion, const std::set<Value>&, const std::map<RegionCode, Box&>& quads) override {
+		for (auto&& quad : quads) {
+			quad.second = subregion(parentRegion, quad.first);
+		}
+	}
+
+	// Returns true if the value's box overlaps the node's box
+	virtual bool satisfies(const Box& nodeCompare, const Value& val) override {
+		return boxOverlaps(nodeCompare, boxOf(val));
+	}
+
+	// Returns true if the two boxes overlap
+	virtual bool overlaps(const Box& compareLeft, const Box& compareRight) override {
+		return boxOverlaps(compareLeft, compareRight);
+	}
+
+	// Returns the box of a value
+	Box boxOf(const Value& val) const {
+		return BoxOf()(val);
+	}
+
+	// Returns a box twice the size of region on each axis, extended on each axis towards the
+	// side the value's box lies on. region becomes the childCode quadrant of the returned box.
+	// Integer boxes saturate at the limits of Coord: a region at a limit grows towards its
+	// other side, and a region spanning every Coord on both axes is returned unchanged
+	Box growRegion(const Box& region, const Value& val, RegionCode& childCode) const {
+		Box target = boxOf(val);
+
+		Box grown = region;
+		bool growLeft = growAxis(region.minX, region.maxX, target.minX, target.maxX, grown.minX, grown.maxX);
+		bool growUp = growAxis(region.minY, region.maxY, target.minY, target.maxY, grown.minY, grown.maxY);
+
+		if (growUp) {
+			childCode = growLeft ? RegionCode::LOWER_RIGHT : RegionCode::LOWER_LEFT;
+		}
+		else {
+			childCode = growLeft ? RegionCode::UPPER_RIGHT : RegionCode::UPPER_LEFT;
+		}
+		return grown;
+	}
+
+	// Doubles [low, high] into [grownLow, grownHigh] towards the side [targetLow, targetHigh]
+	// lies on, or for targets past both sides or inside, the side holding more of it.
+	// Returns true if it grew towards low
+	static bool growAxis(Coord low, Coord high, Coord targetLow, Coord targetHigh, Coord& grownLow, Coord& grownHigh) {
+		const Coord lowest = std::numeric_limits<Coord>::lowest();
+		const Coord highest = std::numeric_limits<Coord>::max();
+
+		// Degenerate regions would never grow by doubling
+		Coord width = boxExtent(low, high);
+		if (!(width > 0)) {
+			width = 1;
+		}
+
+		// Compared as doubles so integer distances can't overflow
+		double below = static_cast<double>(low) - targetLow;
+		double above = static_cast<double>(targetHigh) - high;
+		bool growLow = below > above;
+		if (!(below > 0) && !(above > 0)) {
+			growLow = static_cast<double>(targetLow) + targetHigh < static_cast<double>(low) + high;
+		}
+
+		// Saturated sides can't grow, so grow the other one
+		if (growLow && low == lowest) {
+			growLow = false;
+		}
+		else if (!growLow && high == highest) {
+			growLow = true;
+		}
+
+		grownLow = low;
+		grownHigh = high;
+		if (growLow) {
+			if (low != lowest) {
+				grownLow = boxSaturatingSub(low, width);
+			}
+		}
+		else {
+			grownHigh = boxSaturatingAdd(high, width);
+		}
+		return growLow;
+	}
+
+	// Returns true if inner lies entirely inside outer
+	bool contains(const Box& outer, const Box& inner) const {
+		return boxContains(outer, inner);
+	}
+
+	// Returns true if inner lies inside outer without touching its edges. Quadrants only share
+	// edges, so inner then overlaps no box outside of outer's quadrants
+	bool containsStrictly(const Box& outer, const Box& inner) const {
+		return boxContainsStrictly(outer, inner);
+	}
+
+	// Returns the code child of a parent. Axes at the subdivision floor (see boxCanSplit) aren't
+	// split: a parent that can only be split along one axis is cut into four strips along it,
+	// in region order, and a parent that can't be split at all gives four copies of itself,
+	// so the tree keeps its values in one node. Children only differ when some axis can split
+	static Box subregion(const Box& parentRegion, RegionCode code) {
+		bool canSplitX = boxCanSplit(parentRegion.minX, parentRegion.maxX);
+		bool canSplitY = boxCanSplit(parentRegion.minY, parentRegion.maxY);
+
+		Box box = parentRegion;
+		if (canSplitX && canSplitY) {
+			box = quadrant(parentRegion, boxMidpoint(parentRegion.minX, parentRegion.maxX),
+						   boxMidpoint(parentRegion.minY, parentRegion.maxY), code);
+		}
+		else if (canSplitX) {
+			strip(parentRegion.minX, parentRegion.maxX, stripIndex(code), box.minX, box.maxX);
+		}
+		else if (canSplitY) {
+			strip(parentRegion.minY, parentRegion.maxY, stripIndex(code), box.minY, box.maxY);
+		}
+		return box;
+	}
+
+	// Returns one quadrant of a parent split at (midX, midY)
+	static Box quadrant(const Box& parentRegion, Coord midX, Coord midY, RegionCode code) {
+		Box box = parentRegion;
+		switch (code) {
+		case RegionCode::UPPER_LEFT:
+			box.maxX = midX;
+			box.maxY = midY;
+			break;
+		case RegionCode::UPPER_RIGHT:
+			box.minX = midX;
+			box.maxY = midY;
+			break;
+		case RegionCode::LOWER_LEFT:
+			box.maxX = midX;
+			box.minY = midY;
+			break;
+		case RegionCode::LOWER_RIGHT:
+			box.minX = midX;
+			box.minY = midY;
+			break;
+		}
+		return box;
+	}
+
+	// Position of a region among four strips, in region order
+	static std::size_t stripIndex(RegionCode code) {
+		switch (code) {
+		case RegionCode::UPPER_LEFT:
+			return 0;
+		case RegionCode::UPPER_RIGHT:
+			return 1;
+		case RegionCode::LOWER_LEFT:
+			return 2;
+		default:
+			return 3;
+		}
+	}
+
+	// Region of the strip at index, the inverse of stripIndex
+	static RegionCode stripCode(std::size_t index) {
+		static const RegionCode codes[] = { RegionCode::UPPER_LEFT, RegionCode::UPPER_RIGHT, RegionCode::LOWER_LEFT, RegionCode::LOWER_RIGHT };
+		return codes[index];
+	}
+
+	// Sets [first, last] to the strip at index of [low, high] cut at its quarter points
+	static void strip(Coord low, Coord high, std::size_t index, Coord& first, Coord& last) {
+		Coord mid = boxMidpoint(low, high);
+		Coord bounds[] = { low, boxMidpoint(low, mid), mid, boxMidpoint(mid, high), high };
+		first = bounds[index];
+		last = bounds[index + 1];
+	}
+
+	// Index of the strip of [low, high] holding coord. Coords on a cut belong to the higher strip
+	static std::size_t stripOf(Coord low, Coord high, Coord coord) {
+		Coord mid = boxMidpoint(low, high);
+		if (coord < mid) {
+			return coord < boxMidpoint(low, mid) ? 0 : 1;
+		}
+		return coord < boxMidpoint(mid, high) ? 2 : 3;
+	}
+};
+
+// Filters candidate values (i.e. the result of getNearbyValues) down to those whose boxes
+// overlap the query, testing the boxes in SIMD batches
+template<class Value, class Coord, class BoxOf>
+std::vector<Value> filterOverlapping(const Box2D<Coord>& query, const std::set<Value>& candidates) {
+
+	BoxOf boxOf;
+
+	std::vector<Value> vecValues(candidates.begin(), candidates.end());
+	BoxArray2D<Coord> boxes;
+	boxes.reserve(vecValues.size());
+	for (auto&& val : vecValues) {
+		boxes.push_back(boxOf(val));
+	}
+
+	std::vector<std::size_t> vecHits;
+	boxOverlapBatch(query, boxes, vecHits);
+
+	std::vector<Value> vecOverlapping;
+	vecOverlapping.reserve(vecHits.size());
+	for (std::size_t index : vecHits) {
+		vecOverlapping.push_back(vecValues[index]);
+	}
+	return vecOverlapping;
+}
+
+//=======================================
+// Point Predicate
+//=======================================
+
+// Adapts a PointOf functor into the BoxOf functor used by BoxPredicate2D
+template<class Value, class Coord, class PointOf>
+struct PointBoxOf {
+	Box2D<Coord> operator()(const Value& val) const {
+		Point2D<Coord> point = PointOf()(val);
+		Box2D<Coord> box = { point.x, point.y, point.x, point.y };
+		return box;
+	}
+};
+
+template<class Value, class Coord, class PointOf>
+class PointPredicate2D : public BoxPredicate2D<Value, Coord, PointBoxOf<Value, Coord, PointOf> > {
+public:
+
+	using Box = Box2D<Coord>;
+
+	// Returns the quadrant of parentRegion holding the value. Points on a split line
+	// belong to both neighbouring quadrants, so they go to the right/lower one.
+	// Parents split into strips (see subregion) route points the same way
+	RegionCode quadrantOf(const Box& parentRegion, const Value& val) const {
+		using Base = BoxPredicate2D<Value, Coord, PointBoxOf<Value, Coord, PointOf> >;
+
+		Point2D<Coord> point = PointOf()(val);
+		bool canSplitX = boxCanSplit(parentRegion.minX, parentRegion.maxX);
+		bool canSplitY = boxCanSplit(parentRegion.minY, parentRegion.maxY);
+		if (!canSplitX || !canSplitY) {
+			if (canSplitX) {
+				return Base::stripCode(Base::stripOf(parentRegion.minX, parentRegion.maxX, point.x));
+			}
+			if (canSplitY) {
+				return Base::stripCode(Base::stripOf(parentRegion.minY, parentRegion.maxY, point.y));
+			}
+			return RegionCode::UPPER_LEFT;
+		}
+
+		bool isRight = !(point.x < boxMidpoint(parentRegion.minX, parentRegion.maxX));
+		bool isLower = !(point.y < boxMidpoint(parentRegion.minY, parentRegion.maxY));
+
+		if (isLower) {
+			return isRight ? RegionCode::LOWER_RIGHT : RegionCode::LOWER_LEFT;
+		}
+		return isRight ? RegionCode::UPPER_RIGHT : RegionCode::UPPER_LEFT;
+	}
+
+	// Returns the position of a value
+	Point2D<Coord> pointOf(const Value& val) const {
+		return PointOf()(val);
+	}
+};
+
+#endif
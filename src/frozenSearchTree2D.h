@@ -0,0 +1,357 @@
+/*
+
+	- Immutable, compact form of the generic 2D search tree
+
+	Usage:
+	Call SearchTree2D::freeze() once a tree is built and will no longer change, i.e.
+	static level geometry. The frozen tree has the same query API but stores its nodes
+	in one array in breadth first order, with each node's children and values stored
+	contiguously and referenced by index instead of by pointer.
+
+	If the predicate supports leaf sorting (see SearchTree2D::setLeafSorting) every node's
+	values are stored sorted by min x with a structure of arrays of their boxes, and
+	queries sweep only the slice of each node that can overlap the query. Such a frozen
+	tree always returns only the values whose boxes overlap the query, like a live tree
+	with leaf sorting enabled, whether or not the tree it was frozen from sorted its leaves.
+
+	Indices are 32 bit, so a frozen tree holds at most 2^32 - 1 nodes and values. Freezing
+	a larger tree gives an empty frozen tree whose isComplete returns false.
+*/
+
+#ifndef __FROZEN_SEARCH_TREE_2D_H_
+#define __FROZEN_SEARCH_TREE_2D_H_
+
+#include <vector>
+#include <set>
+#include <algorithm>
+#include <utility>
+#include <cstdint>
+#include <cstddef>
+
+#include "searchTree2D.h"
+#include "box2D.h"
+
+// A node of a frozen tree
+template<class NodeCompare>
+struct FrozenNode {
+	// node's search space
+	NodeCompare compare;
+
+	// children are nodes [firstChild, firstChild + childCount)
+	std::uint32_t firstChild;
+	std::uint32_t childCount;
+
+	// values are [firstValue, firstValue + valueCount) of the value array
+	std::uint32_t firstValue;
+	std::uint32_t valueCount;
+};
+
+//=======================================
+// Frozen Tree View
+//=======================================
+
+// Queries a frozen tree laid out in memory the tree does not own, i.e. a FrozenSearchTree2D's
+// arrays or a mapped file. All pointers must stay valid while the view is used
+template<class Value, class NodeCompare, class Predicate>
+struct FrozenTreeView {
+
+	using SetValue = std::set<Value>;
+	using Node = FrozenNode<NodeCompare>;
+	using LeafCoord = typename searchTreeDetail::LeafSortTraits<Predicate, Value, NodeCompare>::Coord;
+
+	static const bool isPointTree = searchTreeDetail::HasQuadrantOf<Predicate, NodeCompare, Value>::value;
+	static const bool isLeafSorted = searchTreeDetail::LeafSortTraits<Predicate, Value, NodeCompare>::value;
+
+	// Nodes in breadth first order. nodes[0] is the root
+	const Node* nodes;
+	std::size_t nodeCount;
+
+	const Value* values;
+	std::size_t valueCount;
+
+	// Boxes of values, parallel to values, and the widest box of each node.
+	// Only used when isLeafSorted
+	const LeafCoord* minX;
+	const LeafCoord* minY;
+	const LeafCoord* maxX;
+	const LeafCoord* maxY;
+	const LeafCoord* nodeMaxWidth;
+
+	// Adds all values belonging to nodes whose search spaces overlap compare to out.
+	// Output is a SetValue or a std::vector<Value>. Vectors are not deduplicated
+	template<class Output>
+	void getNearbyValues(const NodeCompare& compare, Output& out) const {
+
+		if (nodeCount == 0) {
+			return;
+		}
+
+		Predicate predicate;
+
+		std::vector<std::uint32_t> vecStack(1, 0);
+		while (!vecStack.empty()) {
+			std::uint32_t index = vecStack.back();
+			vecStack.pop_back();
+
+			const Node& node = nodes[index];
+
+			// Children are quadrants of their parent, so a miss prunes the whole subtree
+			if (!predicate.overlaps(node.compare, compare)) {
+				continue;
+			}
+
+			appendNodeValues(index, compare, out, std::integral_constant<bool, isLeafSorted>());
+
+			// Push in reverse so children are visited in order
+			for (std::uint32_t child = node.childCount; child-- > 0; ) {
+				vecStack.push_back(node.firstChild + child);
+			}
+		}
+	}
+
+private:
+
+	// Appends every value of a node
+	template<class Output>
+	void appendNodeValues(std::uint32_t index, const NodeCompare&, Output& out, std::false_type) const {
+		const Node& node = nodes[index];
+		append(out, values + node.firstValue, values + node.firstValue + node.valueCount);
+	}
+
+	// Appends the values of a node whose boxes overlap compare
+	template<class Output>
+	void appendNodeValues(std::uint32_t index, const NodeCompare& compare, Output& out, std::true_type) const {
+
+		const Node& node = nodes[index];
+		const LeafCoord* first = minX + node.firstValue;
+		const LeafCoord* last = first + node.valueCount;
+
+		// Values are sorted by min x, so only a slice can reach the query
+		std::size_t end = std::upper_bound(first, last, compare.maxX) - minX;
+		std::size_t begin = std::lower_bound(first, minX + end, boxSaturatingSub(compare.minX, nodeMaxWidth[index])) - minX;
+		if (begin >= end) {
+			return;
+		}
+
+		std::vector<std::size_t> vecHits(end - begin);
+		std::size_t hitCount = boxOverlapBatch(compare, minX, minY, maxX, maxY, begin, end, vecHits.data());
+		for (std::size_t i = 0; i < hitCount; ++i) {
+			append(out, values + vecHits[i], values + vecHits[i] + 1);
+		}
+	}
+
+	static void append(SetValue& out, const Value* first, const Value* last) {
+		out.insert(first, last);
+	}
+
+	static void append(std::vector<Value>& out, const Value* first, const Value* last) {
+		out.insert(out.end(), first, last);
+	}
+};
+
+//=======================================
+// Frozen Tree
+//=======================================
+template<class Value, class NodeCompare, class Predicate>
+class FrozenSearchTree2D {
+public:
+
+	using SetValue = std::set<Value>;
+	using View = FrozenTreeView<Value, NodeCompare, Predicate>;
+	using Node = typename View::Node;
+	using LeafCoord = typename View::LeafCoord;
+
+	static const bool isPointTree = View::isPointTree;
+	static const bool isLeafSorted = View::isLeafSorted;
+
+	// Empty tree
+	FrozenSearchTree2D() = default;
+
+	// Freezes a copy of tree
+	explicit FrozenSearchTree2D(const SearchTree2D<Value, NodeCompare, Predicate>& tree);
+
+	// Returns all values belonging to nodes whose search spaces overlap (as defined by the predicate)
+	// with the input search space
+	SetValue getNearbyValues(const NodeCompare& compare) const {
+		SetValue nearbyVals;
+		view().getNearbyValues(compare, nearbyVals);
+		return nearbyVals;
+	}
+
+	// Appends the same values as getNearbyValues to out. Point trees append without
+	// any deduplication. Other trees sort and deduplicate the appended values
+	void getNearbyValues(const NodeCompare& compare, std::vector<Value>& out) const {
+		std::size_t firstNew = out.size();
+		view().getNearbyValues(compare, out);
+
+		if (!isPointTree) {
+			searchTreeDetail::sortUnique(out, firstNew);
+		}
+	}
+
+	// Returns false if the tree it was frozen from had too many nodes or values for 32 bit
+	// indices. The frozen tree is then empty
+	bool isComplete() const {
+		return m_isComplete;
+	}
+
+	// Number of nodes
+	std::size_t nodeCount() const {
+		return m_nodes.size();
+	}
+
+	// Number of stored values. Values belonging to more than one node are counted per node
+	std::size_t valueCount() const {
+		return m_values.size();
+	}
+
+	// Bytes used by the tree's arrays
+	std::size_t memoryBytes() const {
+		return m_nodes.size() * sizeof(Node) + m_values.size() * sizeof(Value) +
+			   (m_boxes.size() * 4 + m_nodeMaxWidth.size()) * sizeof(LeafCoord);
+	}
+
+	// Returns a view over this tree's arrays. Invalidated if the tree is destroyed or assigned
+	View view() const {
+		View treeView = {
+			m_nodes.data(), m_nodes.size(), m_values.data(), m_values.size(),
+			m_boxes.minX.data(), m_boxes.minY.data(), m_boxes.maxX.data(), m_boxes.maxY.data(),
+			m_nodeMaxWidth.data()
+		};
+		return treeView;
+	}
+
+	// Raw arrays, i.e. for writing the tree out
+	const std::vector<Node>& nodes() const {
+		return m_nodes;
+	}
+
+	const std::vector<Value>& values() const {
+		return m_values;
+	}
+
+	const BoxArray2D<LeafCoord>& boxes() const {
+		return m_boxes;
+	}
+
+	const std::vector<LeafCoord>& nodeMaxWidths() const {
+		return m_nodeMaxWidth;
+	}
+
+private:
+
+	// Sorts a node's values by min x and records their boxes
+	void appendValues(std::vector<Value>& vecValues, std::true_type isLeafSorted);
+
+	// Records a node's values as they are
+	void appendValues(std::vector<Value>& vecValues, std::false_type);
+
+	std::vector<Node> m_nodes;
+	std::vector<Value> m_values;
+
+	// Only filled when isLeafSorted
+	BoxArray2D<LeafCoord> m_boxes;
+	std::vector<LeafCoord> m_nodeMaxWidth;
+
+	bool m_isComplete = true;
+};
+
+// Freeze a tree
+template<class Value, class NodeCompare, class Predicate>
+FrozenSearchTree2D<Value, NodeCompare, Predicate>::FrozenSearchTree2D(const SearchTree2D<Value, NodeCompare, Predicate>& tree)
+	: m_nodes()
+	, m_values()
+	, m_boxes()
+	, m_nodeMaxWidth()
+	, m_isComplete(true)
+{
+	using Tree = SearchTree2D<Value, NodeCompare, Predicate>;
+
+	// Gather the nodes in depth first order along with each node's children
+	struct Staged {
+		NodeCompare compare;
+		std::vector<Value> values;
+		std::vector<std::size_t> children;
+	};
+	std::vector<Staged> vecStaged;
+	std::vector<std::size_t> vecPath;
+	std::size_t valueTotal = 0;
+
+	tree.visitNodes([&](const typename Tree::NodeVisit& node) {
+		vecPath.resize(node.depth);
+		if (!vecPath.empty()) {
+			vecStaged[vecPath.back()].children.push_back(vecStaged.size());
+		}
+		vecPath.push_back(vecStaged.size());
+
+		Staged staged = { node.compare, std::vector<Value>(node.values.begin(), node.values.end()), std::vector<std::size_t>() };
+		vecStaged.push_back(staged);
+		valueTotal += staged.values.size();
+		return true;
+	});
+
+	// Every index below is narrowed to 32 bits
+	if (vecStaged.size() >= UINT32_MAX || valueTotal >= UINT32_MAX) {
+		m_isComplete = false;
+		return;
+	}
+
+	// Lay the nodes out breadth first so that siblings are contiguous
+	std::vector<std::size_t> vecOrder(1, 0);
+	m_nodes.reserve(vecStaged.size());
+	for (std::size_t i = 0; i < vecOrder.size(); ++i) {
+		Staged& staged = vecStaged[vecOrder[i]];
+
+		Node node;
+		node.compare = staged.compare;
+		node.firstChild = static_cast<std::uint32_t>(vecOrder.size());
+		node.childCount = static_cast<std::uint32_t>(staged.children.size());
+		node.firstValue = static_cast<std::uint32_t>(m_values.size());
+		node.valueCount = static_cast<std::uint32_t>(staged.values.size());
+		m_nodes.push_back(node);
+
+		appendValues(staged.values, std::integral_constant<bool, isLeafSorted>());
+		vecOrder.insert(vecOrder.end(), staged.children.begin(), staged.children.end());
+	}
+}
+
+// Append a node's values sorted by min x
+template<class Value, class NodeCompare, class Predicate>
+void FrozenSearchTree2D<Value, NodeCompare, Predicate>::appendValues(std::vector<Value>& vecValues, std::true_type) {
+
+	Predicate predicate;
+
+	std::vector<std::pair<NodeCompare, Value> > vecSorted;
+	vecSorted.reserve(vecValues.size());
+	for (auto&& val : vecValues) {
+		vecSorted.push_back(std::make_pair(predicate.boxOf(val), val));
+	}
+	std::stable_sort(vecSorted.begin(), vecSorted.end(),
+		[](const std::pair<NodeCompare, Value>& left, const std::pair<NodeCompare, Value>& right) {
+			return left.first.minX < right.first.minX;
+		});
+
+	LeafCoord maxWidth = 0;
+	for (auto&& sorted : vecSorted) {
+		m_values.push_back(sorted.second);
+		m_boxes.push_back(sorted.first);
+		maxWidth = std::max(maxWidth, boxExtent(sorted.first.minX, sorted.first.maxX));
+	}
+	m_nodeMaxWidth.push_back(maxWidth);
+}
+
+// Append a node's values
+template<class Value, class NodeCompare, class Predicate>
+void FrozenSearchTree2D<Value, NodeCompare, Predicate>::appendValues(std::vector<Value>& vecValues, std::false_type) {
+
+	m_values.insert(m_values.end(), vecValues.begin(), vecValues.end());
+}
+
+// Freeze this tree
+template<class Value, class NodeCompare, class Predicate>
+FrozenSearchTree2D<Value, NodeCompare, Predicate> SearchTree2D<Value, NodeCompare, Predicate>::freeze() const {
+
+	return FrozenSearchTree2D<Value, NodeCompare, Predicate>(*this);
+}
+
+#endif
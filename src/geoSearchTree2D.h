@@ -0,0 +1,325 @@
+/*
+
+	- Geographic search tree built on the generic 2D search tree
+
+	Usage:
+	GeoSearchTree2D<Value, LonLatOf> indexes values by longitude/latitude in degrees.
+	LonLatOf is a default constructible functor returning the GeoPoint of a value.
+
+	Values are stored in a cylindrical equal-area projection (x = longitude,
+	y = sin(latitude)) so that splitting a node at its projected midpoint gives
+	quadrants of equal surface area, which keeps polar nodes from being oversized.
+	The root always spans the whole globe.
+
+	Query rects whose west edge is greater than their east edge cross the antimeridian
+	and are searched as two rects, one on each side of +-180 degrees.
+*/
+
+#ifndef __GEO_SEARCH_TREE_2D_H_
+#define __GEO_SEARCH_TREE_2D_H_
+
+#include <vector>
+#include <set>
+#include <map>
+#include <algorithm>
+#include <utility>
+#include <cmath>
+#include <cstdint>
+
+#include "searchTree2D.h"
+#include "boxPredicate2D.h"
+
+// Longitude and latitude in degrees
+struct GeoPoint {
+	double lon;
+	double lat;
+};
+
+// Longitude/latitude rect in degrees. west > east crosses the antimeridian
+struct GeoRect {
+	double west;
+	double south;
+	double east;
+	double north;
+};
+
+// Wraps a longitude into [-180, 180]
+inline double geoWrapLongitude(double lon) {
+	if (lon >= -180.0 && lon <= 180.0) {
+		return lon;
+	}
+	double wrapped = std::fmod(lon + 180.0, 360.0);
+	if (wrapped < 0) {
+		wrapped += 360.0;
+	}
+	return wrapped - 180.0;
+}
+
+// Projects a latitude in degrees onto the equal-area y axis [-1, 1]
+inline double geoProjectLatitude(double lat) {
+	const double degToRad = 3.14159265358979323846 / 180.0;
+	lat = std::min(std::max(lat, -90.0), 90.0);
+	return std::sin(lat * degToRad);
+}
+
+// Returns the position of a point along a Hilbert curve covering the projected globe
+// order is the number of bits per axis, at most 31
+inline std::uint64_t geoHilbertIndex(const GeoPoint& point, unsigned order = 16) {
+
+	const std::uint64_t cells = std::uint64_t(1) << order;
+
+	// Map the projected point onto the curve's integer grid
+	double fx = (geoWrapLongitude(point.lon) + 180.0) / 360.0;
+	double fy = (geoProjectLatitude(point.lat) + 1.0) / 2.0;
+	std::uint64_t x = std::min(static_cast<std::uint64_t>(fx * cells), cells - 1);
+	std::uint64_t y = std::min(static_cast<std::uint64_t>(fy * cells), cells - 1);
+
+	// Standard Hilbert xy to distance conversion, rotating each quadrant into place
+	std::uint64_t index = 0;
+	for (std::uint64_t s = cells / 2; s > 0; s /= 2) {
+		std::uint64_t rx = (x & s) ? 1 : 0;
+		std::uint64_t ry = (y & s) ? 1 : 0;
+		index += s * s * ((3 * rx) ^ ry);
+
+		if (ry == 0) {
+			if (rx == 1) {
+				x = s - 1 - (x & (s - 1));
+				y = s - 1 - (y & (s - 1));
+			}
+			std::swap(x, y);
+		}
+	}
+	return index;
+}
+
+//=======================================
+// Geographic Tree
+//=======================================
+template<class Value, class LonLatOf>
+class GeoSearchTree2D {
+public:
+
+	using SetValue = std::set<Value>;
+	using Box = Box2D<double>;
+
+	// Projected position of a value
+	struct ProjectedPointOf {
+		Point2D<double> operator()(const Value& val) const {
+			GeoPoint point = LonLatOf()(val);
+			Point2D<double> projected = { geoWrapLongitude(point.lon), geoProjectLatitude(point.lat) };
+			return projected;
+		}
+	};
+
+	using ProjectedBoxOf = PointBoxOf<Value, double, ProjectedPointOf>;
+
+	// Point predicate whose root is always the whole projected globe
+	class Predicate : public PointPredicate2D<Value, double, ProjectedPointOf> {
+	public:
+		virtual Box buildRegionFromData(const SetValue&) override {
+			return worldBox();
+		}
+
+		// Every value projects inside the globe, so the root never grows
+		Box growRegion(const Box& region, const Value& val, RegionCode& childCode) const = delete;
+	};
+
+	using Tree = SearchTree2D<Value, Box, Predicate>;
+	using NodeRestore = typename Tree::NodeRestore;
+
+	// Inserts a value into the tree
+	void add(const Value& val) {
+		m_tree.add(val);
+	}
+
+	// Removes a value from the tree
+	void remove(const Value& val) {
+		m_tree.remove(val);
+	}
+
+	// Empties the tree
+	void clear() {
+		m_tree.clear();
+	}
+
+	// Rebalances the tree. Call after values have moved
+	RebalanceProfile rebalance() {
+		return m_tree.rebalance();
+	}
+
+	// Rebuilds the tree from its values plus a batch of new ones. The values are sorted along
+	// a Hilbert curve, so each node's values are one contiguous run that splits into its
+	// children's runs, and the nodes are built from those runs instead of by inserting values
+	// one at a time. Values equivalent to one already in the tree are ignored, as with add
+	template<class Iterator>
+	void bulkLoad(Iterator first, Iterator last) {
+
+		SetValue setAll;
+		m_tree.visitNodes([&](const typename Tree::NodeVisit& node) {
+			setAll.insert(node.values.begin(), node.values.end());
+			return true;
+		});
+		setAll.insert(first, last);
+
+		std::vector<std::pair<std::uint64_t, Value> > vecOrdered;
+		vecOrdered.reserve(setAll.size());
+		for (auto&& val : setAll) {
+			vecOrdered.push_back(std::make_pair(geoHilbertIndex(LonLatOf()(val)), val));
+		}
+
+		std::sort(vecOrdered.begin(), vecOrdered.end(),
+			[](const std::pair<std::uint64_t, Value>& left, const std::pair<std::uint64_t, Value>& right) {
+				return left.first < right.first;
+			});
+
+		std::vector<Value> vecValues;
+		vecValues.reserve(vecOrdered.size());
+		for (auto&& ordered : vecOrdered) {
+			vecValues.push_back(ordered.second);
+		}
+
+		std::vector<NodeRestore> vecNodes;
+		buildNodes(vecValues.begin(), vecValues.end(), worldBox(), 0, vecNodes);
+
+		std::size_t next = 0;
+		m_tree.restoreNodes([&](NodeRestore& restored) {
+			if (next == vecNodes.size()) {
+				return false;
+			}
+			restored = std::move(vecNodes[next++]);
+			return true;
+		});
+	}
+
+	// Returns values belonging to nodes that overlap the rect.
+	// This is a superset of the values inside the rect
+	SetValue getNearbyValues(const GeoRect& rect) const {
+
+		SetValue nearbyVals;
+		for (auto&& box : projectRect(rect)) {
+			SetValue boxVals = m_tree.getNearbyValues(box);
+			nearbyVals.insert(boxVals.begin(), boxVals.end());
+		}
+		return nearbyVals;
+	}
+
+	// Returns exactly the values inside the rect
+	std::vector<Value> getValuesInRect(const GeoRect& rect) const {
+
+		std::vector<Value> vecInside;
+		for (auto&& box : projectRect(rect)) {
+			std::vector<Value> vecBox = filterOverlapping<Value, double, ProjectedBoxOf>(box, m_tree.getNearbyValues(box));
+			vecInside.insert(vecInside.end(), vecBox.begin(), vecBox.end());
+		}
+
+		// A value on the antimeridian can land in both halves of a crossing rect
+		searchTreeDetail::sortUnique(vecInside, 0);
+		return vecInside;
+	}
+
+	// Returns the underlying tree, i.e. for stats and exports
+	const Tree& tree() const {
+		return m_tree;
+	}
+
+	Tree& tree() {
+		return m_tree;
+	}
+
+	// Projected box spanning the whole globe
+	static Box worldBox() {
+		Box box = { -180.0, -1.0, 180.0, 1.0 };
+		return box;
+	}
+
+	// Projects a rect into one box, or two if it crosses the antimeridian
+	static std::vector<Box> projectRect(const GeoRect& rect) {
+
+		double south = geoProjectLatitude(std::min(rect.south, rect.north));
+		double north = geoProjectLatitude(std::max(rect.south, rect.north));
+
+		std::vector<Box> vecBoxes;
+
+		// Rects at least a full turn wide cover every longitude
+		if (rect.east - rect.west >= 360.0) {
+			Box box = { -180.0, south, 180.0, north };
+			vecBoxes.push_back(box);
+			return vecBoxes;
+		}
+
+		double west = geoWrapLongitude(rect.west);
+		double east = geoWrapLongitude(rect.east);
+		if (west <= east) {
+			Box box = { west, south, east, north };
+			vecBoxes.push_back(box);
+		}
+		else {
+			Box eastSide = { west, south, 180.0, north };
+			Box westSide = { -180.0, south, east, north };
+			vecBoxes.push_back(eastSide);
+			vecBoxes.push_back(westSide);
+		}
+		return vecBoxes;
+	}
+
+private:
+
+	using ValueIterator = typename std::vector<Value>::iterator;
+
+	// Appends the node for a run of values and the nodes below it in visitNodes order. The run
+	// is split the way a rebalance would, and its values keep their curve order in every child
+	static void buildNodes(ValueIterator first, ValueIterator last, const Box& region, std::size_t depth, std::vector<NodeRestore>& out) {
+
+		Predicate predicate;
+
+		std::map<RegionCode, Box> mapQuads;
+		std::map<RegionCode, Box&> mapRefs;
+		for (RegionCode code : { RegionCode::UPPER_LEFT, RegionCode::UPPER_RIGHT, RegionCode::LOWER_LEFT, RegionCode::LOWER_RIGHT }) {
+			mapRefs.insert(std::pair<RegionCode, Box&>(code, mapQuads[code] = region));
+		}
+		predicate.buildQuadrantsFromData(region, SetValue(), mapRefs);
+
+		// Runs whose values all lie on every quadrant stay in one node
+		bool subdivide = false;
+		if (static_cast<std::size_t>(last - first) > g_minDataSize) {
+			for (ValueIterator itVal = first; itVal != last && !subdivide; ++itVal) {
+				for (auto&& quad : mapQuads) {
+					if (!predicate.satisfies(quad.second, *itVal)) {
+						subdivide = true;
+						break;
+					}
+				}
+			}
+		}
+
+		out.push_back(NodeRestore());
+		out.back().compare = region;
+		out.back().depth = depth;
+		if (!subdivide) {
+			out.back().values.assign(first, last);
+			return;
+		}
+
+		// Upper quadrants come before lower ones and left before right, as in region order
+		auto isUpper = [&](const Value& val) {
+			RegionCode code = predicate.quadrantOf(region, val);
+			return code == RegionCode::UPPER_LEFT || code == RegionCode::UPPER_RIGHT;
+		};
+		auto isLeft = [&](const Value& val) {
+			RegionCode code = predicate.quadrantOf(region, val);
+			return code == RegionCode::UPPER_LEFT || code == RegionCode::LOWER_LEFT;
+		};
+		ValueIterator itLower = std::stable_partition(first, last, isUpper);
+		ValueIterator itUpperRight = std::stable_partition(first, itLower, isLeft);
+		ValueIterator itLowerRight = std::stable_partition(itLower, last, isLeft);
+
+		buildNodes(first, itUpperRight, mapQuads.at(RegionCode::UPPER_LEFT), depth + 1, out);
+		buildNodes(itUpperRight, itLower, mapQuads.at(RegionCode::UPPER_RIGHT), depth + 1, out);
+		buildNodes(itLower, itLowerRight, mapQuads.at(RegionCode::LOWER_LEFT), depth + 1, out);
+		buildNodes(itLowerRight, last, mapQuads.at(RegionCode::LOWER_RIGHT), depth + 1, out);
+	}
+
+	Tree m_tree;
+};
+
+#endif
@@ -10,7 +10,21 @@
 	a defined vector position and NodeCompare could be a Rect
 
 	The search space for each node is divided into four quadrants. A value can belong to
-	more than one quadrant.
+	more than one quadrant, unless the predicate implements the optional point extension
+	quadrantOf, in which case each value is routed to exactly one quadrant.
+
+	Values added outside of the root search space are held by the root until the next
+	rebalance, unless the predicate implements the optional growth extension growRegion,
+	in which case the root grows upward to hold them.
+
+	Predicates that implement containsStrictly can answer repeated queries through a
+	QueryCache, which starts each query from the node that held the previous one.
+
+	Predicates that implement timeOf timestamp their values. Every node then keeps the
+	time range of its subtree so queries can skip subtrees outside a time window.
+	Likewise predicates that implement categoryOf let queries skip subtrees holding no
+	values of the requested categories, and predicates that implement priorityOf let
+	top k queries skip subtrees that cannot beat the values found so far.
 */
 
 #ifndef __SEARCH_TREE_2D_H_
@@ -21,6 +35,17 @@
 #include <map>
 #include <utility>
 #include <memory>
+#include <algorithm>
+#include <functional>
+#include <type_traits>
+#include <cstdint>
+#include <limits>
+#include <queue>
+#include <random>
+#include <atomic>
+
+#include "searchTreeStats.h"
+#include "box2D.h"
 
 // Utility enum to mark each search quadrant
 // The values are chosen to allow bitwise operations
@@ -32,8 +57,298 @@ enum class RegionCode {
 	LOWER_RIGHT = 1 << 3
 };
 
+// Number of quadrants, i.e. children of a node with children
+const std::size_t g_regionCount = 4;
+
 const std::size_t g_minDataSize = 3;
 
+// Most times the root may grow to fit a single added value
+const std::size_t g_maxRootGrowths = 64;
+
+namespace searchTreeDetail {
+
+	// Detects the optional point predicate extension:
+	//		RegionCode quadrantOf(const NodeCompare& parentRegion, const Value& val)
+	// which returns the single quadrant of parentRegion a value belongs to
+	template<class Predicate, class NodeCompare, class Value>
+	class HasQuadrantOf {
+		template<class P>
+		static auto test(int) -> decltype(std::declval<P&>().quadrantOf(std::declval<const NodeCompare&>(), std::declval<const Value&>()), std::true_type());
+
+		template<class P>
+		static std::false_type test(...);
+
+	public:
+		static const bool value = decltype(test<Predicate>(0))::value;
+	};
+
+	// Detects the optional growth extension:
+	//		NodeCompare growRegion(const NodeCompare& region, const Value& val, RegionCode& childCode)
+	// which returns a larger search space extending region towards val. The quadrant
+	// childCode of the returned search space must be region
+	template<class Predicate, class NodeCompare, class Value>
+	class HasGrowRegion {
+		template<class P>
+		static auto test(int) -> decltype(std::declval<P&>().growRegion(std::declval<const NodeCompare&>(), std::declval<const Value&>(), std::declval<RegionCode&>()), std::true_type());
+
+		template<class P>
+		static std::false_type test(...);
+
+	public:
+		static const bool value = decltype(test<Predicate>(0))::value;
+	};
+
+	// Detects the optional query cache extension:
+	//		bool containsStrictly(const NodeCompare& outer, const NodeCompare& inner)
+	// which returns true if inner lies inside outer and overlaps no search space that
+	// only touches outer, i.e. outer's sibling quadrants
+	template<class Predicate, class NodeCompare>
+	class HasContainsStrictly {
+		template<class P>
+		static auto test(int) -> decltype(std::declval<P&>().containsStrictly(std::declval<const NodeCompare&>(), std::declval<const NodeCompare&>()), std::true_type());
+
+		template<class P>
+		static std::false_type test(...);
+
+	public:
+		static const bool value = decltype(test<Predicate>(0))::value;
+	};
+
+	// Detects the optional time extension:
+	//		Time timeOf(const Value& val)
+	// which returns the arithmetic timestamp of a value. type is void if the predicate has no timeOf
+	template<class Predicate, class Value>
+	class TimeOfResult {
+		template<class P>
+		static auto test(int) -> decltype(std::declval<P&>().timeOf(std::declval<const Value&>()));
+
+		template<class P>
+		static void test(...);
+
+	public:
+		using type = decltype(test<Predicate>(0));
+	};
+
+	// Timestamp type of a predicate. int for predicates without timeOf so unused members still compile
+	template<class Predicate, class Value>
+	struct TimeTraits {
+		using Result = typename TimeOfResult<Predicate, Value>::type;
+		static const bool value = !std::is_void<Result>::value;
+		using Time = typename std::conditional<value, typename std::decay<Result>::type, int>::type;
+	};
+
+	// Detects the optional category extension:
+	//		Category categoryOf(const Value& val)
+	// which returns the unsigned category bitmask of a value, i.e. its collision layers.
+	// type is void if the predicate has no categoryOf
+	template<class Predicate, class Value>
+	class CategoryOfResult {
+		template<class P>
+		static auto test(int) -> decltype(std::declval<P&>().categoryOf(std::declval<const Value&>()));
+
+		template<class P>
+		static void test(...);
+
+	public:
+		using type = decltype(test<Predicate>(0));
+	};
+
+	// Category mask type of a predicate. std::uint32_t for predicates without categoryOf
+	template<class Predicate, class Value>
+	struct CategoryTraits {
+		using Result = typename CategoryOfResult<Predicate, Value>::type;
+		static const bool value = !std::is_void<Result>::value;
+		using Category = typename std::conditional<value, typename std::decay<Result>::type, std::uint32_t>::type;
+	};
+
+	// Detects the optional priority extension:
+	//		Priority priorityOf(const Value& val)
+	// which returns the arithmetic priority of a value. type is void if the predicate has no priorityOf
+	template<class Predicate, class Value>
+	class PriorityOfResult {
+		template<class P>
+		static auto test(int) -> decltype(std::declval<P&>().priorityOf(std::declval<const Value&>()));
+
+		template<class P>
+		static void test(...);
+
+	public:
+		using type = decltype(test<Predicate>(0));
+	};
+
+	// Priority type of a predicate. int for predicates without priorityOf
+	template<class Predicate, class Value>
+	struct PriorityTraits {
+		using Result = typename PriorityOfResult<Predicate, Value>::type;
+		static const bool value = !std::is_void<Result>::value;
+		using Priority = typename std::conditional<value, typename std::decay<Result>::type, int>::type;
+	};
+
+	// Detects operator== so identical queries can be recognized
+	template<class T>
+	class IsEqualityComparable {
+		template<class U>
+		static auto test(int) -> decltype(bool(std::declval<const U&>() == std::declval<const U&>()), std::true_type());
+
+		template<class U>
+		static std::false_type test(...);
+
+	public:
+		static const bool value = decltype(test<T>(0))::value;
+	};
+
+	// Detects the optional box extension:
+	//		Box2D<Coord> boxOf(const Value& val)
+	// which returns the bounds of a value. type is void if the predicate has no boxOf
+	template<class Predicate, class Value>
+	class BoxOfResult {
+		template<class P>
+		static auto test(int) -> decltype(std::declval<P&>().boxOf(std::declval<const Value&>()));
+
+		template<class P>
+		static void test(...);
+
+	public:
+		using type = decltype(test<Predicate>(0));
+	};
+
+	// Coordinate type of a Box2D. float for anything else so unused members still compile
+	template<class Box>
+	struct BoxCoord {
+		using type = float;
+	};
+
+	template<class Coord>
+	struct BoxCoord<Box2D<Coord> > {
+		using type = Coord;
+	};
+
+	// Leaves can be sorted when boxOf returns the same Box2D type used for search spaces
+	template<class Predicate, class Value, class NodeCompare>
+	struct LeafSortTraits {
+		using Box = typename BoxOfResult<Predicate, Value>::type;
+		using Coord = typename BoxCoord<Box>::type;
+		static const bool value = std::is_same<Box, NodeCompare>::value && std::is_same<Box, Box2D<Coord> >::value;
+	};
+
+	// Parts of a node summary. Each is empty unless the predicate has the matching extension,
+	// so nodes don't carry fields no query reads
+
+	// Range of the values' timestamps
+	template<class Time, bool isKept>
+	struct TimeSummary {
+		Time minTime;
+		Time maxTime;
+
+		void resetTime() {
+			minTime = std::numeric_limits<Time>::max();
+			maxTime = std::numeric_limits<Time>::lowest();
+		}
+
+		void mergeTime(const TimeSummary& other) {
+			minTime = std::min(minTime, other.minTime);
+			maxTime = std::max(maxTime, other.maxTime);
+		}
+	};
+
+	template<class Time>
+	struct TimeSummary<Time, false> {
+		void resetTime() {}
+		void mergeTime(const TimeSummary&) {}
+	};
+
+	// Bitwise or of the values' categories
+	template<class Category, bool isKept>
+	struct CategorySummary {
+		Category categories;
+
+		void resetCategories() {
+			categories = 0;
+		}
+
+		void mergeCategories(const CategorySummary& other) {
+			categories |= other.categories;
+		}
+	};
+
+	template<class Category>
+	struct CategorySummary<Category, false> {
+		void resetCategories() {}
+		void mergeCategories(const CategorySummary&) {}
+	};
+
+	// Highest priority of the values
+	template<class Priority, bool isKept>
+	struct PrioritySummary {
+		Priority maxPriority;
+
+		void resetPriority() {
+			maxPriority = std::numeric_limits<Priority>::lowest();
+		}
+
+		void mergePriority(const PrioritySummary& other) {
+			maxPriority = std::max(maxPriority, other.maxPriority);
+		}
+	};
+
+	template<class Priority>
+	struct PrioritySummary<Priority, false> {
+		void resetPriority() {}
+		void mergePriority(const PrioritySummary&) {}
+	};
+
+	// Bounds of the values' boxes, the sums of their box centers and the number of values
+	// whose centers are owned here (see Node::ownsCenter)
+	template<class Coord, bool isKept>
+	struct BoundsSummary {
+		Box2D<Coord> bounds;
+		double sumX;
+		double sumY;
+		std::size_t ownedCount;
+
+		void resetBounds() {
+			bounds.minX = std::numeric_limits<Coord>::max();
+			bounds.minY = std::numeric_limits<Coord>::max();
+			bounds.maxX = std::numeric_limits<Coord>::lowest();
+			bounds.maxY = std::numeric_limits<Coord>::lowest();
+			sumX = 0;
+			sumY = 0;
+			ownedCount = 0;
+		}
+
+		void mergeBounds(const BoundsSummary& other) {
+			bounds = boxUnion(bounds, other.bounds);
+			sumX += other.sumX;
+			sumY += other.sumY;
+			ownedCount += other.ownedCount;
+		}
+	};
+
+	template<class Coord>
+	struct BoundsSummary<Coord, false> {
+		void resetBounds() {}
+		void mergeBounds(const BoundsSummary&) {}
+	};
+
+	// Returns an id no tree has had before. Query caches compare ids rather than addresses,
+	// so a new tree at the address of a destroyed one is never mistaken for it
+	inline std::uint64_t nextTreeId() {
+		static std::atomic<std::uint64_t> nextId(1);
+		return nextId++;
+	}
+
+	// Sorts the values from index first on and drops all but one of each run of equivalent
+	// values. Equivalence is !(a < b) && !(b < a), as in the sets held by nodes
+	template<class Value>
+	void sortUnique(std::vector<Value>& vec, std::size_t first) {
+		auto itFirst = vec.begin() + first;
+		std::sort(itFirst, vec.end());
+		vec.erase(std::unique(itFirst, vec.end(), [](const Value& left, const Value& right) {
+			return !(left < right) && !(right < left);
+		}), vec.end());
+	}
+}
+
 //=======================================
 // Implementation interface
 //=======================================
@@ -52,7 +367,8 @@ public:
 	virtual NodeCompare buildRegionFromData(const std::set<Value>& values) = 0;
 
 	// Subdivides the search space of a parent into quadrants given a set of values belonging
-	// to the parent
+	// to the parent. Child search spaces must lie inside parentRegion, since queries that miss
+	// a node skip its children
 	// inputs: 
 	//		parentRegion - search space for the parent node
 	//		values - values belonging to the parent
@@ -78,6 +394,10 @@ public:
 	virtual bool overlaps(const NodeCompare& compareLeft, const NodeCompare& compareRight) = 0;
 };
 
+// Read-only form of the tree returned by SearchTree2D::freeze (see frozenSearchTree2D.h)
+template<class Value, class NodeCompare, class Predicate>
+class FrozenSearchTree2D;
+
 //=======================================
 // Main Tree Interface
 //=======================================
@@ -93,8 +413,8 @@ public:
 	// Destructor
 	~SearchTree2D();
 
-	// Copy constructor
-	SearchTree2D(const SearchTree2D&) = default;
+	// Copy constructor. The copy has its own id
+	SearchTree2D(const SearchTree2D& otherTree);
 
 	// Move Constructor
 	SearchTree2D(SearchTree2D&&);
@@ -106,6 +426,15 @@ public:
 	friend void swap(SearchTree2D& left, SearchTree2D& right) {
 		using std::swap;
 		swap(left.m_tree, right.m_tree);
+		swap(left.m_profileRebalance, right.m_profileRebalance);
+		swap(left.m_statsEnabled, right.m_statsEnabled);
+		swap(left.m_stats, right.m_stats);
+		swap(left.m_sortLeaves, right.m_sortLeaves);
+		swap(left.m_structureVersion, right.m_structureVersion);
+
+		// Both trees now hold different nodes, so invalidate every query cache
+		left.m_treeId = searchTreeDetail::nextTreeId();
+		right.m_treeId = searchTreeDetail::nextTreeId();
 	}
 
 	// Inserts a value into the tree
@@ -122,423 +451,3548 @@ public:
 	// with the input search space
 	SetValue getNearbyValues(const NodeCompare& compare) const;
 
-	// Rebalances the tree, possibly removing or adding nodes as necessary.
-	// This should be called if the location of values in the tree may have changed
-	// as the tree will not update on value changes
-	void rebalance();
+	// Appends the same values as getNearbyValues to out. Point trees append without
+	// any deduplication. Other trees sort and deduplicate the appended values
+	void getNearbyValues(const NodeCompare& compare, std::vector<Value>& out) const;
+
+	// True if the predicate routes each value to exactly one quadrant (see quadrantOf)
+	static const bool isPointTree = searchTreeDetail::HasQuadrantOf<Predicate, NodeCompare, Value>::value;
+
+	// True if the predicate supports query caches (see containsStrictly)
+	static const bool supportsQueryCache = searchTreeDetail::HasContainsStrictly<Predicate, NodeCompare>::value;
+
+	// True if the predicate timestamps values (see timeOf)
+	static const bool isTimed = searchTreeDetail::TimeTraits<Predicate, Value>::value;
+
+	// Timestamp type returned by the predicate's timeOf
+	using Time = typename searchTreeDetail::TimeTraits<Predicate, Value>::Time;
+
+	// True if the predicate assigns values category bitmasks (see categoryOf)
+	static const bool isCategorized = searchTreeDetail::CategoryTraits<Predicate, Value>::value;
+
+	// Category bitmask type returned by the predicate's categoryOf
+	using Category = typename searchTreeDetail::CategoryTraits<Predicate, Value>::Category;
+
+	// True if the predicate ranks values (see priorityOf)
+	static const bool isPrioritized = searchTreeDetail::PriorityTraits<Predicate, Value>::value;
+
+	// Priority type returned by the predicate's priorityOf
+	using Priority = typename searchTreeDetail::PriorityTraits<Predicate, Value>::Priority;
+
+	// True if the root grows to hold values added outside of it (see growRegion)
+	static const bool isGrowable = searchTreeDetail::HasGrowRegion<Predicate, NodeCompare, Value>::value;
+
+	// True if the predicate provides boxOf and NodeCompare is the Box2D it returns
+	static const bool supportsLeafSorting = searchTreeDetail::LeafSortTraits<Predicate, Value, NodeCompare>::value;
+
+	// Coordinate type of the boxes returned by the predicate's boxOf
+	using LeafCoord = typename searchTreeDetail::LeafSortTraits<Predicate, Value, NodeCompare>::Coord;
 
 private:
+	class Node;
 
-	// Private Node class used for nodes in the tree
-	class Node {
+public:
+
+	// Remembers where a query found its values so the next query from the same site,
+	// i.e. one camera or the mouse box, can start from there instead of from the root.
+	// Keep one cache per query site. A cache may be handed to any tree and starts over
+	// whenever the tree it was last used with changes structure
+	class QueryCache {
 	public:
 
-		// Constructor
-		Node();
+		// Number of queries answered with the previous result, unchanged
+		std::uint64_t reusedQueries() const {
+			return m_reusedQueries;
+		}
 
-		// Destructor
-		~Node();
+		// Number of queries started below the root, from a node holding the query
+		std::uint64_t anchoredQueries() const {
+			return m_anchoredQueries;
+		}
 
-		// Copy constructor
-		Node(const Node&);
+		// Number of queries started from the root
+		std::uint64_t rootQueries() const {
+			return m_rootQueries;
+		}
 
-		// Assignments and Move constructor
-		// Node is an internal class so we don't expect the client to need
-		// these functions. Internally, we only use the copy constructor when
-		// copying trees.
-		Node(Node&&) = delete;
-		Node& operator=(Node) = delete;
-		Node& operator=(Node&&) = delete;
+		// Forgets the previous query
+		void reset() {
+			m_treeId = 0;
+			m_vecPath.clear();
+			m_vecTouched.clear();
+			m_vecResult.clear();
+			m_hasResult = false;
+		}
 
-		// Adds value to the node
-		void add(const Value& val);
+	private:
+		friend class SearchTree2D;
 
-		// Removes value from the node
-		void remove(const Value& val);
+		// id of the tree the cache was last used with and its structure version at the time
+		std::uint64_t m_treeId = 0;
+		std::uint64_t m_structureVersion = 0;
 
-		// clears the node
-		void clear();
+		// nodes from the root down to the node the last query started from
+		std::vector<const Node*> m_vecPath;
 
-		// Returns all values belonging to nodes whose search spaces overlap (as defined by the predicate)
-		// with the input search space
-		SetValue getNearbyValues(const NodeCompare& compare) const;
+		// nodes whose values made up the last result, with their versions at the time
+		std::vector<std::pair<const Node*, std::uint64_t> > m_vecTouched;
 
-		// Uses this node's data to build the search space as defined
-		// by the predicate for the root node.
-		void buildRootRegion();
+		// last query and its deduplicated result
+		NodeCompare m_compare = NodeCompare();
+		std::vector<Value> m_vecResult;
+		bool m_hasResult = false;
 
-		// Rebalances the tree, creating and deleting nodes as necessary
-		void rebalance();
+		std::uint64_t m_reusedQueries = 0;
+		std::uint64_t m_anchoredQueries = 0;
+		std::uint64_t m_rootQueries = 0;
+	};
+
+	// Returns the same values as getNearbyValues. Repeating the previous query on unchanged
+	// nodes returns the remembered result and a query that moved only slightly starts from
+	// the deepest node that still holds it. Requires supportsQueryCache
+	SetValue getNearbyValues(const NodeCompare& compare, QueryCache& cache) const;
+
+	// Appends the same values as getNearbyValues(compare, out) using a query cache
+	void getNearbyValues(const NodeCompare& compare, QueryCache& cache, std::vector<Value>& out) const;
+
+	// Returns values belonging to nodes whose search spaces overlap compare and whose
+	// timestamps lie in [begin, end]. Subtrees with no values in the window are skipped.
+	// Requires isTimed
+	SetValue getNearbyValues(const NodeCompare& compare, Time begin, Time end) const;
+
+	// Appends the same values as getNearbyValues(compare, begin, end) to out
+	void getNearbyValues(const NodeCompare& compare, Time begin, Time end, std::vector<Value>& out) const;
+
+	// Returns values belonging to nodes whose search spaces overlap compare and whose
+	// categories share a bit with mask. Subtrees with no such values are skipped.
+	// Requires isCategorized
+	SetValue getNearbyValues(const NodeCompare& compare, Category mask) const;
+
+	// Appends the same values as getNearbyValues(compare, mask) to out
+	void getNearbyValues(const NodeCompare& compare, Category mask, std::vector<Value>& out) const;
+
+	// Boolean expression of search spaces for getExpressionValues, i.e. vision cones minus walls.
+	// A value is in a search space if it satisfies it (as defined by the predicate)
+	class RegionExpression {
+	public:
+
+		// Expression of the values in compare
+		static RegionExpression region(const NodeCompare& compare) {
+			RegionExpression expression;
+			expression.m_regions.push_back(compare);
+			expression.m_terms.push_back(Term{ Op::REGION, 0 });
+			return expression;
+		}
+
+		// Expression of the values in either left or right
+		static RegionExpression unite(const RegionExpression& left, const RegionExpression& right) {
+			return combine(Op::UNION, left, right);
+		}
+
+		// Expression of the values in both left and right
+		static RegionExpression intersect(const RegionExpression& left, const RegionExpression& right) {
+			return combine(Op::INTERSECTION, left, right);
+		}
+
+		// Expression of the values in left but not in right
+		static RegionExpression subtract(const RegionExpression& left, const RegionExpression& right) {
+			return combine(Op::DIFFERENCE, left, right);
+		}
 
 	private:
+		friend class SearchTree2D;
 
-		using RegionMap = std::map<RegionCode, std::unique_ptr<Node> >;
-		using QuadMap = std::map<RegionCode, NodeCompare&>;
-		using QuadPair = std::pair<RegionCode, NodeCompare&>;
+		enum class Op {
+			REGION,
+			UNION,
+			INTERSECTION,
+			DIFFERENCE
+		};
+
+		// region indexes m_regions for Op::REGION
+		struct Term {
+			Op op;
+			std::size_t region;
+		};
+
+		static RegionExpression combine(Op op, const RegionExpression& left, const RegionExpression& right) {
+			RegionExpression expression = left;
+			std::size_t firstRegion = expression.m_regions.size();
+			expression.m_regions.insert(expression.m_regions.end(), right.m_regions.begin(), right.m_regions.end());
+			for (auto&& term : right.m_terms) {
+				expression.m_terms.push_back(Term{ term.op, term.region + firstRegion });
+			}
+			expression.m_terms.push_back(Term{ op, 0 });
+			return expression;
+		}
+
+		std::vector<NodeCompare> m_regions;
+
+		// Terms in postfix order. Empty for an expression with no values
+		std::vector<Term> m_terms;
+	};
 
+	// Returns the values in expression, replacing several getNearbyValues calls and set algebra
+	// on their results. The whole expression is classified for every node in one traversal: each
+	// search space holds none, all or some of a node's values, subtrees where the expression holds
+	// none are skipped, and values are only tested against the search spaces left undecided.
+	// Search spaces strictly holding a node hold all of its values with supportsQueryCache. With
+	// supportsLeafSorting nodes are classified by the bounds of their values rather than their
+	// search spaces. Values that moved since they were added or last rebalanced may be misplaced
+	SetValue getExpressionValues(const RegionExpression& expression) const;
+
+	// Appends the same values as getExpressionValues(expression) to out
+	void getExpressionValues(const RegionExpression& expression, std::vector<Value>& out) const;
+
+	// Returns up to k of the values getNearbyValues(compare) would return, highest priority
+	// first. Equal priorities are ordered by value. Nodes are searched best first by the
+	// highest priority below them and the search stops once no node can beat the k-th
+	// value found. Requires isPrioritized
+	std::vector<Value> getTopValues(const NodeCompare& compare, std::size_t k) const;
+
+	// Returns n distinct values of those getNearbyValues(compare) would return, or all of them
+	// if there are fewer, i.e. for level of detail. Each node's share of n is proportional to the number of values below it, so the
+	// sample follows the density of the query region and only nodes with a share are visited.
+	// The same seed samples an unchanged tree the same way, so samples do not flicker between frames
+	std::vector<Value> getSampleValues(const NodeCompare& compare, std::size_t n, std::uint32_t seed = 0) const;
+
+	// Aggregate of the values below one node, returned by the cluster queries
+	struct Cluster {
 		// node's search space
-		NodeCompare m_compare;
+		NodeCompare region;
 
-		// map holding child nodes keyed by region
-		RegionMap m_mapRegions;
+		// depth below the root. The root is depth 0
+		std::size_t depth;
+
+		// Number of values below the node. Values belonging to more than one node are
+		// counted once per node
+		std::size_t count;
+
+		// Mean of the values' box centers
+		Point2D<double> centroid;
+
+		// Bounds of the values' boxes
+		Box2D<LeafCoord> bounds;
+	};
+
+	// Returns one cluster per node overlapping compare at depth, or per shallower leaf.
+	// Clusters come from aggregates every node keeps, so only nodes down to depth are visited.
+	// Values orphaned above depth get clusters of their own. Requires supportsLeafSorting
+	std::vector<Cluster> getClustersAtDepth(const NodeCompare& compare, std::size_t depth) const;
+
+	// Returns one cluster per node overlapping compare whose search space is at most cellSize
+	// wide and high, or per larger leaf. Requires supportsLeafSorting
+	std::vector<Cluster> getClustersBySize(const NodeCompare& compare, LeafCoord cellSize) const;
+
+	// Returns a width * height grid of value counts over region in row major order with row 0
+	// at region's min y. Each value is counted once, in the cell holding its box center, by the
+	// one node owning that center. Subtrees whose values all fall in one cell are added from
+	// their maintained counts of owned values, so the tree is walked once. Requires supportsLeafSorting
+	std::vector<std::size_t> getDensityRaster(const NodeCompare& region, std::size_t width, std::size_t height) const;
+
+	// Adds a slice of values, i.e. every value of the newest time step
+	template<class Iterator>
+	void appendSlice(Iterator first, Iterator last);
+
+	// Removes every value timestamped before time. Subtrees holding only newer values
+	// are skipped. Requires isTimed
+	void retireBefore(Time time);
+
+	// Keeps each node's values sorted by min x alongside a structure of arrays of their boxes.
+	// Queries binary search the query's x range inside a node and test only that slice,
+	// so from sorted nodes getNearbyValues returns just the values whose boxes overlap
+	// the query. Boxes are cached when values are added and refreshed by rebalance.
+	// Requires supportsLeafSorting. Disabled by default
+	void setLeafSorting(bool enabled);
+
+	// Returns true if node values are kept sorted
+	bool isLeafSorting() const;
+
+	// Rebalances the tree, possibly removing or adding nodes as necessary.
+	// This should be called if the location of values in the tree may have changed
+	// as the tree will not update on value changes
+	// Returns a phase breakdown of the rebalance if profiling is enabled
+	RebalanceProfile rebalance();
+
+	// Read-only view of a node handed to visitNodes
+	struct NodeVisit {
+		// node's search space
+		const NodeCompare& compare;
+
+		// values held by the node. For a node with children these are orphaned values
+		const SetValue& values;
+
+		// depth below the root. The root is depth 0
+		std::size_t depth;
+
+		// true if the node has no children
+		bool isLeaf;
+
+		// true if the node or any node below it changed since the last markCheckpoint
+		bool isChanged;
+	};
+
+	// Calls visitor(const NodeVisit&) for every node, parents before children.
+	// The visitor returns false to skip a node's children
+	template<class Visitor>
+	void visitNodes(Visitor visitor) const;
+
+	// Marks every node unchanged, i.e. once the tree has been checkpointed (see searchTreeSnapshot.h).
+	// Nodes are changed by adding or removing their values and by rebalances that move values,
+	// search spaces or children. Values whose boxes changed in place count as moved once the
+	// next rebalance sees them, even if they stay in the same node. Rebalances only change
+	// search spaces that compare unequal, so without NodeCompare::operator== every rebalanced
+	// node is changed. Growing the root changes every node
+	void markCheckpoint();
+
+	// A node handed back to restoreNodes
+	struct NodeRestore {
+		// node's search space
+		NodeCompare compare;
+
+		// values held by the node
+		std::vector<Value> values;
+
+		// depth below the root. The root is depth 0
+		std::size_t depth;
+	};
+
+	// Replaces the tree with nodes read one at a time by reader(NodeRestore&), which returns false
+	// once there are no more. Nodes come in visitNodes order, i.e. as a snapshot recorded them.
+	// Nodes are rebuilt as they are read, without the predicate choosing where values go.
+	// Returns false if the nodes don't form a tree with zero or four children per node
+	template<class Reader>
+	bool restoreNodes(Reader reader);
+
+	// Calls onPair(const Value&, const Value&) once for every pair of values whose boxes overlap.
+	// Each leaf is sorted by min x (or its sorted index is used) and swept in SIMD batches, and
+	// a pair found in several leaves is reported only by the leaf holding the min corner of
+	// the pair's overlap. Pairs with orphaned values are tested separately.
+	// Values that moved since they were added or last rebalanced may be missed.
+	// Requires supportsLeafSorting
+	template<class OnPair>
+	void forEachOverlappingPair(OnPair onPair) const;
+
+	// Calls onPair(const Value&, const Value&) once for every pair of values whose boxes are at
+	// most distance apart, i.e. for flocking. Pairs of nodes are walked together and skipped once
+	// the bounds of their values are further apart than distance, so the values of distant nodes
+	// are never compared. Values belonging to several nodes are compared from one of them only.
+	// Requires supportsLeafSorting
+	template<class OnPair>
+	void forEachPairWithin(LeafCoord distance, OnPair onPair) const;
+
+	// Nearest values to one value, returned by getAllNearestNeighbors
+	struct Neighbors {
+		Value value;
+
+		// up to k other values, nearest first. Equal distances are ordered by value
+		std::vector<Value> nearest;
+	};
+
+	// Returns the k nearest other values of every value, measured between the closest points of
+	// their boxes, i.e. for steering. Values are searched in groups of one node's values: each group
+	// gathers the nodes that can hold any member's neighbors once, then searches only those for
+	// every member. Values are returned grouped by node. Requires supportsLeafSorting
+	std::vector<Neighbors> getAllNearestNeighbors(std::size_t k) const;
+
+	// Same as getAllNearestNeighbors(k), with the groups run by runRanges(count, runRange), which
+	// must call runRange(first, last) for disjoint ranges covering [0, count), from any threads,
+	// and return once every call has. The predicate is only called before runRanges.
+	// See ParallelRanges in searchTreeParallel.h
+	template<class RunRanges>
+	std::vector<Neighbors> getAllNearestNeighbors(std::size_t k, RunRanges runRanges) const;
+
+	// Value hit by a swept query
+	struct SweptHit {
+		Value value;
+
+		// fraction of the displacement moved when the box first touches the value's box, in [0, 1]
+		double time;
+	};
+
+	// Returns the values whose boxes box touches while moving by displacement, i.e. for continuous
+	// collision detection, ordered by time of first contact and then by value. Nodes are searched
+	// best first by when the box reaches the bounds of their values, so only nodes the swept box
+	// passes through are visited. Requires supportsLeafSorting
+	std::vector<SweptHit> getSweptValues(const NodeCompare& box, const Point2D<LeafCoord>& displacement) const;
+
+	// Calls onHit(const Value&, double time) for the hits of getSweptValues in the same order
+	// until it returns false, i.e. to stop at the first hit
+	template<class OnHit>
+	void forEachSweptValue(const NodeCompare& box, const Point2D<LeafCoord>& displacement, OnHit onHit) const;
+
+	// Returns an immutable copy of the tree with flat node and value arrays.
+	// Use it for trees that are built once and only queried afterwards
+	FrozenSearchTree2D<Value, NodeCompare, Predicate> freeze() const;
+
+	// Enables or disables the phase profiler for rebalance. Disabled by default
+	void setRebalanceProfiling(bool enabled);
+
+	// Returns true if rebalance will be profiled
+	bool isRebalanceProfiling() const;
+
+	// Enables or disables operation and predicate call counters. Disabled by default
+	// Counting is not thread safe, so queries should not run concurrently while enabled
+	void setStatsEnabled(bool enabled);
+
+	// Returns true if operations are being counted
+	bool isStatsEnabled() const;
+
+	// Returns the counters gathered since stats were enabled or last reset
+	const SearchTreeStats& getStats() const;
+
+	// Zeroes all counters
+	void resetStats();
+
+private:
+
+	// Forwards calls to the user predicate, counting each call
+	class CountedPredicate {
+	public:
+
+		// counts may be nullptr, in which case nothing is counted
+		explicit CountedPredicate(PredicateCallCounts* counts)
+			: m_predicate()
+			, m_counts(counts)
+		{
+		}
+
+		NodeCompare nilCompare() {
+			if (m_counts) {
+				++m_counts->nilCompare;
+			}
+			return m_predicate.nilCompare();
+		}
+
+		NodeCompare buildRegionFromData(const SetValue& values) {
+			if (m_counts) {
+				++m_counts->buildRegionFromData;
+			}
+			return m_predicate.buildRegionFromData(values);
+		}
+
+		void buildQuadrantsFromData(const NodeCompare& parentRegion, const SetValue& values, const std::map<RegionCode, NodeCompare&>& quads) {
+			if (m_counts) {
+				++m_counts->buildQuadrantsFromData;
+			}
+			m_predicate.buildQuadrantsFromData(parentRegion, values, quads);
+		}
+
+		bool satisfies(const NodeCompare& nodeCompare, const Value& val) {
+			if (m_counts) {
+				++m_counts->satisfies;
+			}
+			return m_predicate.satisfies(nodeCompare, val);
+		}
+
+		bool overlaps(const NodeCompare& compareLeft, const NodeCompare& compareRight) {
+			if (m_counts) {
+				++m_counts->overlaps;
+			}
+			return m_predicate.overlaps(compareLeft, compareRight);
+		}
+
+		RegionCode quadrantOf(const NodeCompare& parentRegion, const Value& val) {
+			if (m_counts) {
+				++m_counts->quadrantOf;
+			}
+			return m_predicate.quadrantOf(parentRegion, val);
+		}
+
+		NodeCompare growRegion(const NodeCompare& region, const Value& val, RegionCode& childCode) {
+			if (m_counts) {
+				++m_counts->growRegion;
+			}
+			return m_predicate.growRegion(region, val, childCode);
+		}
+
+		bool containsStrictly(const NodeCompare& outer, const NodeCompare& inner) {
+			if (m_counts) {
+				++m_counts->containsStrictly;
+			}
+			return m_predicate.containsStrictly(outer, inner);
+		}
+
+		NodeCompare boxOf(const Value& val) {
+			if (m_counts) {
+				++m_counts->boxOf;
+			}
+			return m_predicate.boxOf(val);
+		}
+
+		Time timeOf(const Value& val) {
+			if (m_counts) {
+				++m_counts->timeOf;
+			}
+			return m_predicate.timeOf(val);
+		}
+
+		Category categoryOf(const Value& val) {
+			if (m_counts) {
+				++m_counts->categoryOf;
+			}
+			return m_predicate.categoryOf(val);
+		}
+
+		Priority priorityOf(const Value& val) {
+			if (m_counts) {
+				++m_counts->priorityOf;
+			}
+			return m_predicate.priorityOf(val);
+		}
+
+	private:
+		Predicate m_predicate;
+		PredicateCallCounts* m_counts;
+	};
+
+	// Settings and counters shared by the nodes during one tree operation
+	struct OpContext {
+		// Predicate call counters. nullptr when stats are disabled
+		PredicateCallCounts* counts;
+
+		// Rebalance profile. nullptr unless profiling a rebalance
+		RebalanceProfile* profile;
+
+		// Keep node values sorted (see setLeafSorting)
+		bool sortLeaves;
+
+		// Search space of the root, which decides the node owning a value's center
+		const NodeCompare* root;
+	};
+
+	using LeafSortTag = std::integral_constant<bool, supportsLeafSorting>;
+	using GrowTag = std::integral_constant<bool, isGrowable>;
+	using EqualityTag = std::integral_constant<bool, searchTreeDetail::IsEqualityComparable<NodeCompare>::value>;
+
+	// Nodes whose values were returned by a query, with their versions at the time
+	using TouchedNodes = std::vector<std::pair<const Node*, std::uint64_t> >;
+
+	// Runs a query through a cache, leaving the result in the cache
+	void getCachedValues(const NodeCompare& compare, QueryCache& cache, const OpContext& ctx) const;
+
+	// Returns true if two queries are known to be identical
+	static bool isSameCompare(const NodeCompare& left, const NodeCompare& right, std::true_type) {
+		return left == right;
+	}
+	static bool isSameCompare(const NodeCompare&, const NodeCompare&, std::false_type) {
+		return false;
+	}
+
+	using TimeTag = std::integral_constant<bool, isTimed>;
+	using CategoryTag = std::integral_constant<bool, isCategorized>;
+	using PriorityTag = std::integral_constant<bool, isPrioritized>;
+	using QueryCacheTag = std::integral_constant<bool, supportsQueryCache>;
+
+	// Share of a node's values held by a search space or expression
+	enum class Coverage {
+		NONE,
+		SOME,
+		ALL
+	};
+
+	// Evaluates expression over the coverages coverageOf(regionIndex) of its search spaces
+	template<class CoverageOf>
+	static Coverage evaluateExpression(const RegionExpression& expression, CoverageOf& coverageOf, std::vector<Coverage>& stack);
+
+	// Aggregates of the values held by a node and its children. Timestamps, categories,
+	// priorities and bounds are only kept when isTimed, isCategorized, isPrioritized and
+	// supportsLeafSorting respectively
+	struct Summary
+		: searchTreeDetail::TimeSummary<Time, isTimed>
+		, searchTreeDetail::CategorySummary<Category, isCategorized>
+		, searchTreeDetail::PrioritySummary<Priority, isPrioritized>
+		, searchTreeDetail::BoundsSummary<LeafCoord, supportsLeafSorting> {
+		// Number of values held by the node and its children. Values belonging to more
+		// than one node are counted once per node
+		std::size_t count;
+	};
+
+	// Orders (priority, value) pairs highest priority first, then by value
+	struct RankOrder {
+		bool operator()(const std::pair<Priority, Value>& left, const std::pair<Priority, Value>& right) const {
+			if (right.first < left.first) {
+				return true;
+			}
+			if (left.first < right.first) {
+				return false;
+			}
+			return left.second < right.second;
+		}
+	};
+
+	// Best values found so far by getTopValues, best first
+	using RankedValues = std::set<std::pair<Priority, Value>, RankOrder>;
+
+	// Query filter keeping values timestamped in [begin, end]
+	struct TimeWindowFilter {
+		Time begin;
+		Time end;
+		CountedPredicate predicate;
+
+		bool acceptsSummary(const Summary& summary) const {
+			return !(summary.maxTime < begin) && !(end < summary.minTime);
+		}
+
+		bool acceptsValue(const Value& val) {
+			Time time = predicate.timeOf(val);
+			return !(time < begin) && !(end < time);
+		}
+	};
+
+	// Query filter keeping values whose categories share a bit with mask
+	struct CategoryFilter {
+		Category mask;
+		CountedPredicate predicate;
+
+		bool acceptsSummary(const Summary& summary) const {
+			return (summary.categories & mask) != 0;
+		}
+
+		bool acceptsValue(const Value& val) {
+			return (predicate.categoryOf(val) & mask) != 0;
+		}
+	};
+
+	// Shared state of forEachOverlappingPair
+	struct PairSweep {
+		// search space of the root
+		NodeCompare rootRegion;
+
+		// values held by nodes with children
+		SetValue setOrphans;
+
+		// pairs reported once all leaves are swept, ordered (smaller, larger)
+		std::set<std::pair<Value, Value> > setDeferred;
+
+		// scratch arrays for sorting unindexed leaves
+		std::vector<std::pair<NodeCompare, Value> > vecSorted;
+		std::vector<Value> vecValues;
+		BoxArray2D<LeafCoord> boxes;
+	};
+
+	// Copy of a node made by forEachPairWithin. Each value is held by one copy only
+	struct JoinNode {
+		std::vector<Value> values;
+		BoxArray2D<LeafCoord> boxes;
+
+		// Bounds of this node's values, and of its values and all values below it
+		Box2D<LeafCoord> valueBounds;
+		Box2D<LeafCoord> bounds;
+
+		// children holding any values
+		std::vector<JoinNode> children;
+	};
+
+	// Shared state of forEachPairWithin
+	template<class OnPair>
+	struct PairJoin {
+		LeafCoord distance;
+		double distanceSquared;
+		OnPair& onPair;
+		std::vector<std::size_t> vecHits;
+	};
+
+	// Reports the pairs between the values of left and right
+	template<class OnPair>
+	static void joinValues(const JoinNode& left, const JoinNode& right, PairJoin<OnPair>& join);
+
+	// Reports the pairs between the values of owner and the values of node and its children
+	template<class OnPair>
+	static void joinOwnValues(const JoinNode& owner, const JoinNode& node, PairJoin<OnPair>& join);
+
+	// Reports the pairs between the values below left and the values below right
+	template<class OnPair>
+	static void joinNodes(const JoinNode& left, const JoinNode& right, PairJoin<OnPair>& join);
+
+	// Reports the pairs among the values below node
+	template<class OnPair>
+	static void joinSelf(const JoinNode& node, PairJoin<OnPair>& join);
+
+	// Scratch space of one range of getAllNearestNeighbors groups
+	struct NeighborSearch {
+		// min heap of nodes by distance
+		std::vector<std::pair<double, const JoinNode*> > vecQueue;
+		std::vector<const JoinNode*> vecFrontier;
+		std::vector<std::pair<double, const JoinNode*> > vecOrdered;
+		std::vector<double> vecDistances;
+		std::vector<std::pair<double, Value> > vecNearest;
+	};
+
+	// Appends node and the nodes below it that hold values to out
+	static void gatherJoinGroups(const JoinNode& node, std::vector<const JoinNode*>& out);
+
+	// Appends the nodes below node whose values may lie within the squared radius of bounds to out
+	static void gatherJoinFrontier(const JoinNode& node, const Box2D<LeafCoord>& bounds, double radiusSquared,
+								   std::vector<const JoinNode*>& out);
+
+	// Appends the k nearest neighbors of each of group's values to out
+	static void findGroupNeighbors(const JoinNode& root, const JoinNode& group, std::size_t k,
+								   NeighborSearch& search, std::vector<Neighbors>& out);
+
+	// Cells of getDensityRaster
+	struct RasterGrid {
+		NodeCompare region;
+		std::size_t width;
+		std::size_t height;
+		double cellWidth;
+		double cellHeight;
+
+		// Finds the column and row holding (x, y). Returns false if it lies outside region
+		bool cellOf(double x, double y, std::size_t& column, std::size_t& row) const {
+			if (x < region.minX || region.maxX < x || y < region.minY || region.maxY < y) {
+				return false;
+			}
+			column = std::min(static_cast<std::size_t>((x - region.minX) / cellWidth), width - 1);
+			row = std::min(static_cast<std::size_t>((y - region.minY) / cellHeight), height - 1);
+			return true;
+		}
+	};
+
+	// Counts a call to an operation and returns the context for its nodes
+	OpContext beginOperation(OperationStats& operation) const;
+
+	// Private Node class used for nodes in the tree
+	class Node {
+	public:
+
+		// Constructor. counts may be nullptr
+		explicit Node(PredicateCallCounts* counts = nullptr);
+
+		// Destructor
+		~Node();
+
+		// Copy constructor
+		Node(const Node&);
+
+		// Assignments and Move constructor
+		// Node is an internal class so we don't expect the client to need
+		// these functions. Internally, we only use the copy constructor when
+		// copying trees.
+		Node(Node&&) = delete;
+		Node& operator=(Node) = delete;
+		Node& operator=(Node&&) = delete;
+
+		// swap operation. Used by the tree's swap
+		friend void swap(Node& left, Node& right) {
+			using std::swap;
+			swap(left.m_compare, right.m_compare);
+			swap(left.m_mapRegions, right.m_mapRegions);
+			swap(left.m_data, right.m_data);
+			swap(left.m_dataIndex, right.m_dataIndex);
+			swap(left.m_version, right.m_version);
+			swap(left.m_summary, right.m_summary);
+			swap(left.m_isChanged, right.m_isChanged);
+			swap(left.m_hasChanges, right.m_hasChanges);
+			swap(left.m_boxDigest, right.m_boxDigest);
+		}
+
+		// Adds value to the node
+		void add(const Value& val, const OpContext& ctx);
+
+		// Removes value from the node
+		// Returns true if the value was removed from this node or its children
+		bool remove(const Value& val, const OpContext& ctx);
+
+		// clears the node
+		void clear();
+
+		// Adds all values belonging to nodes whose search spaces overlap (as defined by the predicate)
+		// with the input search space to out. Output is a SetValue or a std::vector<Value>.
+		// Nodes that add their values are recorded in touched unless it is nullptr
+		template<class Output>
+		void getNearbyValues(const NodeCompare& compare, const OpContext& ctx, Output& out, TouchedNodes* touched = nullptr) const;
+
+		// Adds values of nodes overlapping compare that the filter accepts to out. Subtrees
+		// whose summaries the filter rejects are skipped
+		template<class Output, class Filter>
+		void getFilteredValues(const NodeCompare& compare, Filter& filter, const OpContext& ctx, Output& out) const;
+
+		// Adds the k best ranked values of this subtree that overlap compare to ranked
+		void getTopValues(const NodeCompare& compare, std::size_t k, const OpContext& ctx, RankedValues& ranked) const;
+
+		// Adds a sample of at most quota values of this subtree that overlap compare to out,
+		// skipping values already in pSeen unless pSeen is nullptr. compare must overlap this node.
+		// Returns the number of values added
+		std::size_t sampleValues(const NodeCompare& compare, std::size_t quota, const OpContext& ctx, std::mt19937& rng, SetValue* pSeen, std::vector<Value>& out) const;
+
+		// Adds clusters for the nodes of this subtree overlapping compare. isCut(compare, depth)
+		// returns true for nodes that should not be descended into
+		template<class CutTest>
+		void getClusters(const NodeCompare& compare, CutTest& isCut, std::size_t depth, const OpContext& ctx, std::vector<Cluster>& out) const;
+
+		// Adds the values of this subtree to the cells of grid
+		void rasterize(const RasterGrid& grid, const OpContext& ctx, std::vector<std::size_t>& out) const;
+
+		// Removes values timestamped before time from this node and its children
+		// Returns true if any value was removed
+		bool retireBefore(Time time, const OpContext& ctx);
+
+		// Adds this node's own values to a query result, without checking the search space
+		template<class Output>
+		void appendOwnValues(const NodeCompare& compare, Output& out) const;
+
+		// Returns true if the query overlaps this node's search space
+		bool overlaps(const NodeCompare& compare, const OpContext& ctx) const;
+
+		// Returns true if the query lies strictly inside this node's search space
+		bool containsStrictly(const NodeCompare& compare, const OpContext& ctx) const;
+
+		// Returns the child whose search space strictly holds the query, or nullptr
+		const Node* childContainingStrictly(const NodeCompare& compare, const OpContext& ctx) const;
+
+		// Changes whenever this node's values change
+		std::uint64_t version() const;
+
+		// Returns this node's search space
+		const NodeCompare& searchSpace() const;
+
+		// Adds this node's and its children's orphaned values to sweep
+		void gatherOrphans(PairSweep& sweep) const;
+
+		// Sweeps the leaves below this node for overlapping pairs (see forEachOverlappingPair)
+		template<class OnPair>
+		void sweepPairs(PairSweep& sweep, OnPair& onPair, const OpContext& ctx) const;
+
+		// Copies this node and its children into join, skipping values already in pSeen
+		// unless pSeen is nullptr. Returns false if no values were copied
+		bool buildJoin(JoinNode& join, SetValue* pSeen, const OpContext& ctx) const;
+
+		// Best first search for the values box touches while moving by displacement
+		template<class OnHit>
+		void sweep(const NodeCompare& box, const Point2D<LeafCoord>& displacement, const OpContext& ctx, OnHit& onHit) const;
+
+		// Returns the values in expression below this node. parentCoverage holds the parent's
+		// coverage of each of the expression's search spaces, or is empty at the root
+		template<class Output>
+		void getExpressionValues(const RegionExpression& expression, const std::vector<Coverage>& parentCoverage,
+								 const OpContext& ctx, std::vector<Coverage>& stack, Output& out) const;
+
+		// Returns the share of this node's values satisfying region
+		Coverage coverageOf(const NodeCompare& region, const OpContext& ctx) const;
+
+		// Uses this node's data to build the search space as defined
+		// by the predicate for the root node.
+		void buildRootRegion(const OpContext& ctx);
+
+		// Rebalances the tree, creating and deleting nodes as necessary
+		// depth is this node's depth below the root
+		void rebalance(const OpContext& ctx, std::size_t depth);
+
+		// Visits this node and its children. depth is this node's depth below the root
+		template<class Visitor>
+		void visit(Visitor& visitor, std::size_t depth) const;
+
+		// Builds or drops the sorted index of this node's and its children's values
+		void setDataIndexed(bool enabled, const OpContext& ctx);
+
+		// Sets this node's search space and values as read by restoreNodes
+		void restore(const NodeRestore& restored, const OpContext& ctx);
+
+		// Creates the child at index in region order and returns it, or nullptr if index is
+		// past the last region
+		Node* restoreChild(std::size_t index, const OpContext& ctx);
+
+		// Rebuilds the summaries of this node and its children once restoring is done
+		void finishRestore(const OpContext& ctx);
+
+		// Rebuilds the summaries of this node and its children
+		void updateSummaries(const OpContext& ctx);
+
+		// Sets whether this node and every node below it changed since the last checkpoint
+		void setChanged(bool changed);
+
+		// Grows this root node until its search space holds val, moving the current
+		// tree down into a quadrant of the new root each time.
+		// Returns the number of times the root grew
+		std::size_t growToFit(const Value& val, const OpContext& ctx, std::true_type isGrowable);
+		std::size_t growToFit(const Value&, const OpContext&, std::false_type) { return 0; }
+
+	private:
+
+		using RegionMap = std::map<RegionCode, std::unique_ptr<Node> >;
+		using QuadMap = std::map<RegionCode, NodeCompare&>;
+		using QuadPair = std::pair<RegionCode, NodeCompare&>;
+
+		// node's search space
+		NodeCompare m_compare;
+
+		// map holding child nodes keyed by region
+		RegionMap m_mapRegions;
+
+		// data belonging to this node (should be empty if this node has children)
+		SetValue m_data;
+
+		// m_data sorted by min x with the value boxes stored as structure of arrays
+		struct DataIndex {
+			std::vector<Value> values;
+			BoxArray2D<LeafCoord> boxes;
+
+			// widest box in the index, bounding how far left of a query a hit can start
+			LeafCoord maxWidth;
+		};
+
+		// index of m_data. nullptr unless leaf sorting is enabled and m_data isn't empty
+		std::unique_ptr<DataIndex> m_dataIndex;
+
+		// incremented by every change to m_data
+		std::uint64_t m_version;
+
+		// aggregates of this node's and its children's values
+		Summary m_summary;
+
+		// true if this node's values, search space or children changed since the last checkpoint
+		bool m_isChanged;
+
+		// true if this node or any node below it changed since the last checkpoint
+		bool m_hasChanges;
+
+		// digest of the boxes of m_data as of the last rebalance or restore. Values may move
+		// without leaving the node, so rebalance compares it to tell whether the node changed
+		std::uint64_t m_boxDigest;
+
+		// Marks this node changed. Parents pick it up in updateCount
+		void markChanged();
+
+		// Returns true if m_data holds exactly values
+		bool hasSameData(const SetValue& values) const;
+
+		// Returns a digest of the boxes of m_data in order. 0 without supportsLeafSorting
+		std::uint64_t digestBoxes(CountedPredicate& predicate, std::true_type supportsLeafSorting) const;
+		std::uint64_t digestBoxes(CountedPredicate&, std::false_type) const {
+			return 0;
+		}
+
+		// Empties m_summary
+		void resetSummary();
+
+		// Adds a value to m_summary
+		void summarize(const Value& val, CountedPredicate& predicate);
+
+		// Merges a child's summary into m_summary
+		void summarize(const Summary& summary);
+
+		// Rebuilds m_summary from m_data and the children's summaries
+		void updateSummary(const OpContext& ctx);
+
+		// Recounts m_summary.count from m_data and the children's counts
+		void updateCount();
+
+		// Summary parts kept only for predicates with the matching extension
+		void summarizeTime(const Value& val, CountedPredicate& predicate, std::true_type isTimed);
+		void summarizeTime(const Value&, CountedPredicate&, std::false_type) {}
+		void summarizeCategory(const Value& val, CountedPredicate& predicate, std::true_type isCategorized);
+		void summarizeCategory(const Value&, CountedPredicate&, std::false_type) {}
+		void summarizePriority(const Value& val, CountedPredicate& predicate, std::true_type isPrioritized);
+		void summarizePriority(const Value&, CountedPredicate&, std::false_type) {}
+		void summarizeBounds(const Value& val, CountedPredicate& predicate, std::true_type supportsLeafSorting);
+		void summarizeBounds(const Value&, CountedPredicate&, std::false_type) {}
+
+		// Adds a value's box center to the centroid sums once per node it was added to
+		void summarizeCenter(const Value& val, std::size_t memberships, const OpContext& ctx, CountedPredicate& predicate, std::true_type supportsLeafSorting);
+		void summarizeCenter(const Value&, std::size_t, const OpContext&, CountedPredicate&, std::false_type) {}
+
+		// Returns true if the value with box is owned by this node or one of its children.
+		// Point trees hold every value once and the root owns every value. Other nodes own the
+		// values whose centers, moved into the root if outside of it, lie in their search space.
+		// Search spaces are half open on their max sides unless on the root's, so children
+		// sharing an edge never both own a center on it
+		bool ownsCenter(const NodeCompare& box, const OpContext& ctx) const;
+
+		// Returns true if the bounds of this node's values overlap region. Without
+		// supportsLeafSorting the node's search space stands in for the bounds
+		bool valuesOverlap(const NodeCompare& region, CountedPredicate& predicate, std::true_type supportsLeafSorting) const;
+		bool valuesOverlap(const NodeCompare& region, CountedPredicate& predicate, std::false_type) const;
+
+		// Returns true if region strictly holds this node's search space
+		bool isInside(const NodeCompare& region, CountedPredicate& predicate, std::true_type supportsQueryCache) const;
+		bool isInside(const NodeCompare&, CountedPredicate&, std::false_type) const {
+			return false;
+		}
+
+		// Insert, erase, replace or clear m_data, keeping m_dataIndex in sync
+		void insertData(const Value& val, const OpContext& ctx);
+		void eraseData(const Value& val);
+		void assignData(const SetValue& values, const OpContext& ctx);
+		void clearData();
+
+		// Adds a value to m_dataIndex
+		void indexValue(const Value& val, CountedPredicate& predicate, std::true_type supportsLeafSorting);
+		void indexValue(const Value&, CountedPredicate&, std::false_type) {}
+
+		// Rebuilds m_dataIndex from m_data
+		void rebuildDataIndex(CountedPredicate& predicate, std::true_type supportsLeafSorting);
+		void rebuildDataIndex(CountedPredicate&, std::false_type) {}
+
+		// Appends the values of m_dataIndex that overlap compare
+		template<class Output>
+		void appendIndexedValues(const NodeCompare& compare, Output& out, std::true_type supportsLeafSorting) const;
+		template<class Output>
+		void appendIndexedValues(const NodeCompare&, Output&, std::false_type) const {}
+
+		// Returns true if this node has children
+		bool hasChildren() const;
+
+		// Adds a value to the children whose search spaces it satisfies.
+		// Returns false if no child took the value
+		bool addToChildren(const Value& val, const OpContext& ctx, std::false_type isPointTree);
+
+		// Adds a value to the single child chosen by the predicate's quadrantOf.
+		// Returns false if that child does not satisfy the value
+		bool addToChildren(const Value& val, const OpContext& ctx, std::true_type isPointTree);
+
+		// Appends values to a query result
+		static void appendValues(SetValue& out, const SetValue& values);
+		static void appendValues(std::vector<Value>& out, const SetValue& values);
+		static void appendValue(SetValue& out, const Value& val);
+		static void appendValue(std::vector<Value>& out, const Value& val);
+
+		// Returns all values belonging to this node and its children
+		SetValue getAllChildValues() const;
+
+		// Deletes child nodes
+		void deleteChildren();
+
+		// Returns false if this node should be a leaf in the tree
+		bool shouldSubdivide(const SetValue& values, const QuadMap& quads, const OpContext& ctx) const;
+
+		// Sets the search space for this node
+		void setCompare(const NodeCompare& compare);
+	};
+
+	Node m_tree;
+
+	// Whether or not rebalance records a RebalanceProfile
+	bool m_profileRebalance = false;
+
+	// Whether or not operations are counted in m_stats
+	bool m_statsEnabled = false;
+
+	// Operation counters. Mutable so const queries can be counted
+	mutable SearchTreeStats m_stats;
+
+	// Whether or not node values are kept sorted
+	bool m_sortLeaves = false;
+
+	// Incremented whenever nodes are created, deleted or moved, or their search spaces
+	// change. Query caches holding an older version start over from the root
+	std::uint64_t m_structureVersion = 0;
+
+	// Unique to this tree and replaced whenever its nodes are swapped out (see nextTreeId)
+	std::uint64_t m_treeId = searchTreeDetail::nextTreeId();
+};
+
+// =========================================================
+// Main Tree Implementation
+// =========================================================
+// Destructor
+template<class Value, class NodeCompare, class Predicate>
+SearchTree2D<Value, NodeCompare, Predicate>::~SearchTree2D() {
+
+	clear();
+}
+
+// Copy constructor
+template<class Value, class NodeCompare, class Predicate>
+SearchTree2D<Value, NodeCompare, Predicate>::SearchTree2D(const SearchTree2D& otherTree)
+	: m_tree(otherTree.m_tree)
+	, m_profileRebalance(otherTree.m_profileRebalance)
+	, m_statsEnabled(otherTree.m_statsEnabled)
+	, m_stats(otherTree.m_stats)
+	, m_sortLeaves(otherTree.m_sortLeaves)
+	, m_structureVersion(otherTree.m_structureVersion)
+	, m_treeId(searchTreeDetail::nextTreeId())
+{
+}
+
+// Move constructor
+template<class Value, class NodeCompare, class Predicate>
+SearchTree2D<Value, NodeCompare, Predicate>::SearchTree2D(SearchTree2D&& otherTree)
+	: SearchTree2D()
+{
+	swap(*this, otherTree);
+}
+
+// Assignment operator. Passing other by value handles both lvalue and rvalue references
+// lvalues will be copy contructed and rvalues will be move constructed
+template<class Value, class NodeCompare, class Predicate>
+SearchTree2D<Value, NodeCompare, Predicate>& SearchTree2D<Value, NodeCompare, Predicate>::operator=(SearchTree2D<Value, NodeCompare, Predicate> other) {
+	swap(*this, other);
+	return *this;
+}
+
+// Add a value to the tree
+template<class Value, class NodeCompare, class Predicate>
+void SearchTree2D<Value, NodeCompare, Predicate>::add(const Value& val) {
+
+	OpContext ctx = beginOperation(m_stats.add);
+
+	// Grow the root rather than orphan a value outside of it
+	std::size_t growths = m_tree.growToFit(val, ctx, GrowTag());
+	if (growths > 0) {
+		++m_structureVersion;
+
+		// Every node moved down a level, so the next checkpoint must write them all
+		m_tree.setChanged(true);
+	}
+	if (m_statsEnabled) {
+		m_stats.rootGrowths += growths;
+	}
+
+	m_tree.add(val, ctx);
+}
+
+// Remove a value from the tree
+template<class Value, class NodeCompare, class Predicate>
+void SearchTree2D<Value, NodeCompare, Predicate>::remove(const Value& val) {
+
+	OpContext ctx = beginOperation(m_stats.remove);
+	m_tree.remove(val, ctx);
+}
+
+// Clear the tree of all values
+template<class Value, class NodeCompare, class Predicate>
+void SearchTree2D<Value, NodeCompare, Predicate>::clear() {
+
+	m_tree.clear();
+	++m_structureVersion;
+}
+
+// Get values belonging to leafs whose search space satisfies the test compare
+template<class Value, class NodeCompare, class Predicate>
+auto SearchTree2D<Value, NodeCompare, Predicate>::getNearbyValues(const NodeCompare& compare) const -> SetValue {
+
+	SetValue nearbyVals;
+	m_tree.getNearbyValues(compare, beginOperation(m_stats.query), nearbyVals);
+	return nearbyVals;
+}
+
+// Append values belonging to leafs whose search space satisfies the test compare
+template<class Value, class NodeCompare, class Predicate>
+void SearchTree2D<Value, NodeCompare, Predicate>::getNearbyValues(const NodeCompare& compare, std::vector<Value>& out) const {
+
+	std::size_t firstNew = out.size();
+	m_tree.getNearbyValues(compare, beginOperation(m_stats.query), out);
+
+	// Values can belong to more than one node unless each value is routed to a single quadrant
+	if (!isPointTree) {
+		searchTreeDetail::sortUnique(out, firstNew);
+	}
+}
+
+// Get values near a query, starting from where the cached query left off
+template<class Value, class NodeCompare, class Predicate>
+auto SearchTree2D<Value, NodeCompare, Predicate>::getNearbyValues(const NodeCompare& compare, QueryCache& cache) const -> SetValue {
+
+	getCachedValues(compare, cache, beginOperation(m_stats.query));
+	return SetValue(cache.m_vecResult.begin(), cache.m_vecResult.end());
+}
+
+// Append values near a query, starting from where the cached query left off
+template<class Value, class NodeCompare, class Predicate>
+void SearchTree2D<Value, NodeCompare, Predicate>::getNearbyValues(const NodeCompare& compare, QueryCache& cache, std::vector<Value>& out) const {
+
+	getCachedValues(compare, cache, beginOperation(m_stats.query));
+	out.insert(out.end(), cache.m_vecResult.begin(), cache.m_vecResult.end());
+}
+
+// Run a query through a cache
+template<class Value, class NodeCompare, class Predicate>
+void SearchTree2D<Value, NodeCompare, Predicate>::getCachedValues(const NodeCompare& compare, QueryCache& cache, const OpContext& ctx) const {
+
+	static_assert(supportsQueryCache, "Query caches require a predicate with containsStrictly");
+
+	bool isCurrent = cache.m_treeId == m_treeId && cache.m_structureVersion == m_structureVersion && !cache.m_vecPath.empty();
+
+	// The same query over unchanged nodes returns the same values
+	if (isCurrent && cache.m_hasResult && isSameCompare(cache.m_compare, compare, EqualityTag())) {
+		bool isUnchanged = true;
+		for (auto&& touched : cache.m_vecTouched) {
+			if (touched.first->version() != touched.second) {
+				isUnchanged = false;
+				break;
+			}
+		}
+		if (isUnchanged) {
+			++cache.m_reusedQueries;
+			return;
+		}
+	}
+
+	std::vector<const Node*>& vecPath = cache.m_vecPath;
+	if (!isCurrent) {
+		vecPath.assign(1, &m_tree);
+		cache.m_treeId = m_treeId;
+		cache.m_structureVersion = m_structureVersion;
+	}
+
+	// Climb back up the previous path to the deepest node still holding the query,
+	// then descend as far as a single child holds it. A query strictly inside a node
+	// overlaps nothing outside of it but its ancestors
+	while (vecPath.size() > 1 && !vecPath.back()->containsStrictly(compare, ctx)) {
+		vecPath.pop_back();
+	}
+	while (const Node* child = vecPath.back()->childContainingStrictly(compare, ctx)) {
+		vecPath.push_back(child);
+	}
+
+	if (vecPath.size() > 1) {
+		++cache.m_anchoredQueries;
+	}
+	else {
+		++cache.m_rootQueries;
+	}
+
+	cache.m_vecResult.clear();
+	cache.m_vecTouched.clear();
+
+	// Ancestors hold the query, so their orphaned values are always nearby
+	for (std::size_t i = 0; i + 1 < vecPath.size(); ++i) {
+		cache.m_vecTouched.push_back(std::make_pair(vecPath[i], vecPath[i]->version()));
+		vecPath[i]->appendOwnValues(compare, cache.m_vecResult);
+	}
+	vecPath.back()->getNearbyValues(compare, ctx, cache.m_vecResult, &cache.m_vecTouched);
+
+	if (!isPointTree) {
+		searchTreeDetail::sortUnique(cache.m_vecResult, 0);
+	}
+
+	cache.m_compare = compare;
+	cache.m_hasResult = true;
+}
+
+// Get values near a query inside a time window
+template<class Value, class NodeCompare, class Predicate>
+auto SearchTree2D<Value, NodeCompare, Predicate>::getNearbyValues(const NodeCompare& compare, Time begin, Time end) const -> SetValue {
+
+	static_assert(isTimed, "Time windows require a predicate with timeOf");
+
+	OpContext ctx = beginOperation(m_stats.query);
+	TimeWindowFilter filter = { begin, end, CountedPredicate(ctx.counts) };
+	SetValue nearbyVals;
+	m_tree.getFilteredValues(compare, filter, ctx, nearbyVals);
+	return nearbyVals;
+}
+
+// Append values near a query inside a time window
+template<class Value, class NodeCompare, class Predicate>
+void SearchTree2D<Value, NodeCompare, Predicate>::getNearbyValues(const NodeCompare& compare, Time begin, Time end, std::vector<Value>& out) const {
+
+	static_assert(isTimed, "Time windows require a predicate with timeOf");
+
+	OpContext ctx = beginOperation(m_stats.query);
+	TimeWindowFilter filter = { begin, end, CountedPredicate(ctx.counts) };
+	std::size_t firstNew = out.size();
+	m_tree.getFilteredValues(compare, filter, ctx, out);
+
+	if (!isPointTree) {
+		searchTreeDetail::sortUnique(out, firstNew);
+	}
+}
+
+// Get values near a query in any of the masked categories
+template<class Value, class NodeCompare, class Predicate>
+auto SearchTree2D<Value, NodeCompare, Predicate>::getNearbyValues(const NodeCompare& compare, Category mask) const -> SetValue {
+
+	static_assert(isCategorized, "Category masks require a predicate with categoryOf");
+
+	OpContext ctx = beginOperation(m_stats.query);
+	CategoryFilter filter = { mask, CountedPredicate(ctx.counts) };
+	SetValue nearbyVals;
+	m_tree.getFilteredValues(compare, filter, ctx, nearbyVals);
+	return nearbyVals;
+}
+
+// Append values near a query in any of the masked categories
+template<class Value, class NodeCompare, class Predicate>
+void SearchTree2D<Value, NodeCompare, Predicate>::getNearbyValues(const NodeCompare& compare, Category mask, std::vector<Value>& out) const {
+
+	static_assert(isCategorized, "Category masks require a predicate with categoryOf");
+
+	OpContext ctx = beginOperation(m_stats.query);
+	CategoryFilter filter = { mask, CountedPredicate(ctx.counts) };
+	std::size_t firstNew = out.size();
+	m_tree.getFilteredValues(compare, filter, ctx, out);
+
+	if (!isPointTree) {
+		searchTreeDetail::sortUnique(out, firstNew);
+	}
+}
+
+// Get the values in a region expression
+template<class Value, class NodeCompare, class Predicate>
+auto SearchTree2D<Value, NodeCompare, Predicate>::getExpressionValues(const RegionExpression& expression) const -> SetValue {
+
+	SetValue expressionVals;
+	OpContext ctx = beginOperation(m_stats.query);
+	if (!expression.m_terms.empty()) {
+		std::vector<Coverage> stack;
+		m_tree.getExpressionValues(expression, std::vector<Coverage>(), ctx, stack, expressionVals);
+	}
+	return expressionVals;
+}
+
+// Append the values in a region expression
+template<class Value, class NodeCompare, class Predicate>
+void SearchTree2D<Value, NodeCompare, Predicate>::getExpressionValues(const RegionExpression& expression, std::vector<Value>& out) const {
+
+	OpContext ctx = beginOperation(m_stats.query);
+	if (expression.m_terms.empty()) {
+		return;
+	}
+
+	std::size_t firstNew = out.size();
+	std::vector<Coverage> stack;
+	m_tree.getExpressionValues(expression, std::vector<Coverage>(), ctx, stack, out);
+
+	if (!isPointTree) {
+		searchTreeDetail::sortUnique(out, firstNew);
+	}
+}
+
+// Evaluate a region expression over three valued coverages
+template<class Value, class NodeCompare, class Predicate>
+template<class CoverageOf>
+auto SearchTree2D<Value, NodeCompare, Predicate>::evaluateExpression(const RegionExpression& expression, CoverageOf& coverageOf,
+																	  std::vector<Coverage>& stack) -> Coverage {
+
+	using Op = typename RegionExpression::Op;
+
+	stack.clear();
+	for (auto&& term : expression.m_terms) {
+		if (term.op == Op::REGION) {
+			stack.push_back(coverageOf(term.region));
+			continue;
+		}
+
+		Coverage right = stack.back();
+		stack.pop_back();
+		Coverage& left = stack.back();
+
+		switch (term.op) {
+		case Op::UNION:
+			if (left == Coverage::ALL || right == Coverage::ALL) {
+				left = Coverage::ALL;
+			}
+			else if (left != Coverage::NONE || right != Coverage::NONE) {
+				left = Coverage::SOME;
+			}
+			break;
+		case Op::INTERSECTION:
+			if (left == Coverage::NONE || right == Coverage::NONE) {
+				left = Coverage::NONE;
+			}
+			else if (left != Coverage::ALL || right != Coverage::ALL) {
+				left = Coverage::SOME;
+			}
+			break;
+		case Op::DIFFERENCE:
+			if (left == Coverage::NONE || right == Coverage::ALL) {
+				left = Coverage::NONE;
+			}
+			else if (left != Coverage::ALL || right != Coverage::NONE) {
+				left = Coverage::SOME;
+			}
+			break;
+		case Op::REGION:
+			break;
+		}
+	}
+	return stack.back();
+}
+
+// Get the highest priority values near a query
+template<class Value, class NodeCompare, class Predicate>
+std::vector<Value> SearchTree2D<Value, NodeCompare, Predicate>::getTopValues(const NodeCompare& compare, std::size_t k) const {
+
+	static_assert(isPrioritized, "Top values require a predicate with priorityOf");
+
+	RankedValues ranked;
+	if (k > 0) {
+		m_tree.getTopValues(compare, k, beginOperation(m_stats.query), ranked);
+	}
+
+	std::vector<Value> vecTop;
+	vecTop.reserve(ranked.size());
+	for (auto&& rankedVal : ranked) {
+		vecTop.push_back(rankedVal.second);
+	}
+	return vecTop;
+}
+
+// Get a sample of the values near a query
+template<class Value, class NodeCompare, class Predicate>
+std::vector<Value> SearchTree2D<Value, NodeCompare, Predicate>::getSampleValues(const NodeCompare& compare, std::size_t n, std::uint32_t seed) const {
+
+	OpContext ctx = beginOperation(m_stats.query);
+
+	std::vector<Value> vecSample;
+	if (n == 0 || !m_tree.overlaps(compare, ctx)) {
+		return vecSample;
+	}
+
+	// Values belonging to more than one node are drawn once
+	std::mt19937 rng(seed);
+	SetValue setSeen;
+	m_tree.sampleValues(compare, n, ctx, rng, isPointTree ? nullptr : &setSeen, vecSample);
+
+	// Shares a node couldn't fill are passed on to later nodes only, so make up any shortfall
+	// from the rest of the matches
+	if (vecSample.size() < n) {
+		if (isPointTree) {
+			setSeen.insert(vecSample.begin(), vecSample.end());
+		}
+		std::vector<Value> vecRest;
+		m_tree.getNearbyValues(compare, ctx, vecRest);
+		for (std::size_t i = 0; vecSample.size() < n && i < vecRest.size(); ++i) {
+			std::uniform_int_distribution<std::size_t> pick(i, vecRest.size() - 1);
+			std::swap(vecRest[i], vecRest[pick(rng)]);
+			if (setSeen.insert(vecRest[i]).second) {
+				vecSample.push_back(vecRest[i]);
+			}
+		}
+	}
+	return vecSample;
+}
+
+// Get clusters down to a depth
+template<class Value, class NodeCompare, class Predicate>
+auto SearchTree2D<Value, NodeCompare, Predicate>::getClustersAtDepth(const NodeCompare& compare, std::size_t depth) const -> std::vector<Cluster> {
+
+	static_assert(supportsLeafSorting, "Clusters require a predicate with boxOf returning NodeCompare");
+
+	auto isCut = [depth](const NodeCompare&, std::size_t nodeDepth) {
+		return nodeDepth >= depth;
+	};
+
+	std::vector<Cluster> vecClusters;
+	m_tree.getClusters(compare, isCut, 0, beginOperation(m_stats.query), vecClusters);
+	return vecClusters;
+}
+
+// Get clusters down to a cell size
+template<class Value, class NodeCompare, class Predicate>
+auto SearchTree2D<Value, NodeCompare, Predicate>::getClustersBySize(const NodeCompare& compare, LeafCoord cellSize) const -> std::vector<Cluster> {
+
+	static_assert(supportsLeafSorting, "Clusters require a predicate with boxOf returning NodeCompare");
+
+	auto isCut = [cellSize](const NodeCompare& region, std::size_t) {
+		return !(cellSize < boxExtent(region.minX, region.maxX)) && !(cellSize < boxExtent(region.minY, region.maxY));
+	};
+
+	std::vector<Cluster> vecClusters;
+	m_tree.getClusters(compare, isCut, 0, beginOperation(m_stats.query), vecClusters);
+	return vecClusters;
+}
+
+// Count values per cell
+template<class Value, class NodeCompare, class Predicate>
+std::vector<std::size_t> SearchTree2D<Value, NodeCompare, Predicate>::getDensityRaster(const NodeCompare& region, std::size_t width, std::size_t height) const {
+
+	static_assert(supportsLeafSorting, "Density rasters require a predicate with boxOf returning NodeCompare");
+
+	std::vector<std::size_t> vecCounts(width * height, 0);
+	if (width == 0 || height == 0 || region.maxX < region.minX || region.maxY < region.minY) {
+		return vecCounts;
+	}
+
+	OpContext ctx = beginOperation(m_stats.query);
+
+	RasterGrid grid;
+	grid.region = region;
+	grid.width = width;
+	grid.height = height;
+	grid.cellWidth = (static_cast<double>(region.maxX) - region.minX) / width;
+	grid.cellHeight = (static_cast<double>(region.maxY) - region.minY) / height;
+
+	// Degenerate regions put everything in the first column or row
+	if (!(grid.cellWidth > 0)) {
+		grid.cellWidth = 1;
+	}
+	if (!(grid.cellHeight > 0)) {
+		grid.cellHeight = 1;
+	}
+
+	m_tree.rasterize(grid, ctx, vecCounts);
+	return vecCounts;
+}
+
+// Add a slice of values
+template<class Value, class NodeCompare, class Predicate>
+template<class Iterator>
+void SearchTree2D<Value, NodeCompare, Predicate>::appendSlice(Iterator first, Iterator last) {
+
+	for (; first != last; ++first) {
+		add(*first);
+	}
+}
+
+// Remove values older than a time
+template<class Value, class NodeCompare, class Predicate>
+void SearchTree2D<Value, NodeCompare, Predicate>::retireBefore(Time time) {
+
+	static_assert(isTimed, "Retiring values requires a predicate with timeOf");
+
+	OpContext ctx = beginOperation(m_stats.remove);
+	m_tree.retireBefore(time, ctx);
+}
+
+// Rebalance our tree
+template<class Value, class NodeCompare, class Predicate>
+RebalanceProfile SearchTree2D<Value, NodeCompare, Predicate>::rebalance() {
+
+	RebalanceProfile profile;
+	OpContext ctx = beginOperation(m_stats.rebalance);
+
+	RebalancePhaseTimer::Clock::time_point start;
+	if (m_profileRebalance) {
+		profile.enabled = true;
+		ctx.profile = &profile;
+
+		// Count into the profile so the call's predicate work is reported
+		// even when stats are disabled
+		ctx.counts = &profile.predicateCalls;
+		start = RebalancePhaseTimer::Clock::now();
+	}
+
+	++m_structureVersion;
+
+	// Build the root search space for our tree
+	m_tree.buildRootRegion(ctx);
+
+	// Rebalance the tree for the new search space
+	m_tree.rebalance(ctx, 0);
+
+	if (ctx.profile) {
+		profile.totalNanoseconds = static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+			RebalancePhaseTimer::Clock::now() - start).count());
+
+		if (m_statsEnabled) {
+			m_stats.rebalance.predicateCalls += profile.predicateCalls;
+		}
+	}
+
+	return profile;
+}
+
+// Visit every node in the tree
+template<class Value, class NodeCompare, class Predicate>
+template<class Visitor>
+void SearchTree2D<Value, NodeCompare, Predicate>::visitNodes(Visitor visitor) const {
+
+	m_tree.visit(visitor, 0);
+}
+
+// Mark every node unchanged
+template<class Value, class NodeCompare, class Predicate>
+void SearchTree2D<Value, NodeCompare, Predicate>::markCheckpoint() {
+
+	m_tree.setChanged(false);
+}
+
+// Rebuild the tree node by node
+template<class Value, class NodeCompare, class Predicate>
+template<class Reader>
+bool SearchTree2D<Value, NodeCompare, Predicate>::restoreNodes(Reader reader) {
+
+	clear();
+	OpContext ctx = beginOperation(m_stats.add);
+
+	// Open nodes from the root down and the number of children each has been given
+	std::vector<std::pair<Node*, std::size_t> > vecPath;
+	bool isTree = true;
+
+	NodeRestore restored;
+	while (reader(restored)) {
+		// Only the first node may be the root, and no node may skip a depth
+		if (restored.depth > vecPath.size() || (restored.depth == 0 && !vecPath.empty())) {
+			isTree = false;
+			break;
+		}
+
+		// Nodes deeper than this one are complete and must have all of their children
+		while (vecPath.size() > restored.depth) {
+			std::size_t children = vecPath.back().second;
+			if (children != 0 && children != g_regionCount) {
+				isTree = false;
+			}
+			vecPath.pop_back();
+		}
+		if (!isTree) {
+			break;
+		}
+
+		Node* node = &m_tree;
+		if (restored.depth > 0) {
+			node = vecPath.back().first->restoreChild(vecPath.back().second++, ctx);
+			if (!node) {
+				isTree = false;
+				break;
+			}
+		}
+
+		node->restore(restored, ctx);
+		vecPath.push_back(std::make_pair(node, std::size_t(0)));
+	}
+
+	for (auto&& open : vecPath) {
+		if (open.second != 0 && open.second != g_regionCount) {
+			isTree = false;
+		}
+	}
+
+	m_tree.finishRestore(ctx);
+	return isTree;
+}
+
+// Report every pair of overlapping values
+template<class Value, class NodeCompare, class Predicate>
+template<class OnPair>
+void SearchTree2D<Value, NodeCompare, Predicate>::forEachOverlappingPair(OnPair onPair) const {
+
+	static_assert(supportsLeafSorting, "Overlapping pairs require a predicate with boxOf returning NodeCompare");
+
+	OpContext ctx = beginOperation(m_stats.query);
+	CountedPredicate predicate(ctx.counts);
+
+	PairSweep sweep;
+	sweep.rootRegion = predicate.nilCompare();
+	visitNodes([&](const NodeVisit& node) {
+		sweep.rootRegion = node.compare;
+		return false;
+	});
+
+	m_tree.gatherOrphans(sweep);
+	m_tree.sweepPairs(sweep, onPair, ctx);
+
+	// Orphans may lie outside of every node they overlap, so test them against all values
+	if (!sweep.setOrphans.empty()) {
+		SetValue setAll;
+		visitNodes([&](const NodeVisit& node) {
+			setAll.insert(node.values.begin(), node.values.end());
+			return true;
+		});
+
+		std::vector<Value> vecAll(setAll.begin(), setAll.end());
+		BoxArray2D<LeafCoord> boxes;
+		boxes.reserve(vecAll.size());
+		for (auto&& val : vecAll) {
+			boxes.push_back(predicate.boxOf(val));
+		}
+
+		std::vector<std::size_t> vecHits;
+		for (auto&& orphan : sweep.setOrphans) {
+			boxOverlapBatch(predicate.boxOf(orphan), boxes, vecHits);
+			for (std::size_t index : vecHits) {
+				const Value& other = vecAll[index];
+				if (orphan < other) {
+					sweep.setDeferred.insert(std::make_pair(orphan, other));
+				}
+				else if (other < orphan) {
+					sweep.setDeferred.insert(std::make_pair(other, orphan));
+				}
+			}
+		}
+	}
+
+	for (auto&& pair : sweep.setDeferred) {
+		onPair(pair.first, pair.second);
+	}
+}
+
+// Report every pair of values within a distance of each other
+template<class Value, class NodeCompare, class Predicate>
+template<class OnPair>
+void SearchTree2D<Value, NodeCompare, Predicate>::forEachPairWithin(LeafCoord distance, OnPair onPair) const {
+
+	static_assert(supportsLeafSorting, "Distance joins require a predicate with boxOf returning NodeCompare");
+
+	// Points belong to a single node. Other values are kept by the first node copied
+	OpContext ctx = beginOperation(m_stats.query);
+	SetValue setSeen;
+	JoinNode root;
+	if (!m_tree.buildJoin(root, isPointTree ? nullptr : &setSeen, ctx)) {
+		return;
+	}
+
+	PairJoin<OnPair> join = { distance, static_cast<double>(distance) * distance, onPair, std::vector<std::size_t>() };
+	joinSelf(root, join);
+}
+
+// Compare the values of two join nodes
+template<class Value, class NodeCompare, class Predicate>
+template<class OnPair>
+void SearchTree2D<Value, NodeCompare, Predicate>::joinValues(const JoinNode& left, const JoinNode& right, PairJoin<OnPair>& join) {
+
+	if (left.values.empty() || right.values.empty() ||
+		boxDistanceSquared(left.valueBounds, right.valueBounds) > join.distanceSquared) {
+		return;
+	}
+
+	// Boxes grown by distance find the candidates in SIMD batches, then the exact distance decides
+	for (std::size_t i = 0; i < left.values.size(); ++i) {
+		Box2D<LeafCoord> box = left.boxes.at(i);
+		Box2D<LeafCoord> grown = boxInflate(box, join.distance);
+		boxOverlapBatch(grown, right.boxes, join.vecHits);
+		for (std::size_t hit : join.vecHits) {
+			if (boxDistanceSquared(box, right.boxes.at(hit)) <= join.distanceSquared) {
+				join.onPair(left.values[i], right.values[hit]);
+			}
+		}
+	}
+}
+
+// Compare a join node's values with a subtree
+template<class Value, class NodeCompare, class Predicate>
+template<class OnPair>
+void SearchTree2D<Value, NodeCompare, Predicate>::joinOwnValues(const JoinNode& owner, const JoinNode& node, PairJoin<OnPair>& join) {
+
+	if (boxDistanceSquared(owner.valueBounds, node.bounds) > join.distanceSquared) {
+		return;
+	}
+
+	joinValues(owner, node, join);
+	for (auto&& child : node.children) {
+		joinOwnValues(owner, child, join);
+	}
+}
+
+// Compare two disjoint subtrees
+template<class Value, class NodeCompare, class Predicate>
+template<class OnPair>
+void SearchTree2D<Value, NodeCompare, Predicate>::joinNodes(const JoinNode& left, const JoinNode& right, PairJoin<OnPair>& join) {
+
+	if (boxDistanceSquared(left.bounds, right.bounds) > join.distanceSquared) {
+		return;
+	}
+
+	joinValues(left, right, join);
+	if (!left.values.empty()) {
+		for (auto&& child : right.children) {
+			joinOwnValues(left, child, join);
+		}
+	}
+	if (!right.values.empty()) {
+		for (auto&& child : left.children) {
+			joinOwnValues(right, child, join);
+		}
+	}
+
+	for (auto&& leftChild : left.children) {
+		for (auto&& rightChild : right.children) {
+			joinNodes(leftChild, rightChild, join);
+		}
+	}
+}
+
+// Compare all values within a subtree
+template<class Value, class NodeCompare, class Predicate>
+template<class OnPair>
+void SearchTree2D<Value, NodeCompare, Predicate>::joinSelf(const JoinNode& node, PairJoin<OnPair>& join) {
+
+	const BoxArray2D<LeafCoord>& boxes = node.boxes;
+	std::size_t count = node.values.size();
+	join.vecHits.resize(count);
+	for (std::size_t i = 0; i + 1 < count; ++i) {
+		Box2D<LeafCoord> box = boxes.at(i);
+		Box2D<LeafCoord> grown = boxInflate(box, join.distance);
+		std::size_t hitCount = boxOverlapBatch(grown, boxes.minX.data(), boxes.minY.data(), boxes.maxX.data(), boxes.maxY.data(),
+											   i + 1, count, join.vecHits.data());
+		for (std::size_t hit = 0; hit < hitCount; ++hit) {
+			std::size_t other = join.vecHits[hit];
+			if (boxDistanceSquared(box, boxes.at(other)) <= join.distanceSquared) {
+				join.onPair(node.values[i], node.values[other]);
+			}
+		}
+	}
+
+	if (count > 0) {
+		for (auto&& child : node.children) {
+			joinOwnValues(node, child, join);
+		}
+	}
+
+	for (std::size_t i = 0; i < node.children.size(); ++i) {
+		joinSelf(node.children[i], join);
+		for (std::size_t j = i + 1; j < node.children.size(); ++j) {
+			joinNodes(node.children[i], node.children[j], join);
+		}
+	}
+}
+
+// Find the k nearest neighbors of every value
+template<class Value, class NodeCompare, class Predicate>
+auto SearchTree2D<Value, NodeCompare, Predicate>::getAllNearestNeighbors(std::size_t k) const -> std::vector<Neighbors> {
+
+	return getAllNearestNeighbors(k, [](std::size_t count, const std::function<void(std::size_t, std::size_t)>& runRange) {
+		runRange(0, count);
+	});
+}
+
+// Find the k nearest neighbors of every value, running the groups through runRanges
+template<class Value, class NodeCompare, class Predicate>
+template<class RunRanges>
+auto SearchTree2D<Value, NodeCompare, Predicate>::getAllNearestNeighbors(std::size_t k, RunRanges runRanges) const -> std::vector<Neighbors> {
+
+	static_assert(supportsLeafSorting, "Nearest neighbors require a predicate with boxOf returning NodeCompare");
+
+	std::vector<Neighbors> vecNeighbors;
+
+	// The copy caches every box, so the ranges below never call the predicate
+	OpContext ctx = beginOperation(m_stats.query);
+	SetValue setSeen;
+	JoinNode root;
+	if (!m_tree.buildJoin(root, isPointTree ? nullptr : &setSeen, ctx)) {
+		return vecNeighbors;
+	}
+
+	std::vector<const JoinNode*> vecGroups;
+	gatherJoinGroups(root, vecGroups);
+
+	// Each group writes its own results, so ranges share nothing but the tree copy
+	std::vector<std::vector<Neighbors> > vecResults(vecGroups.size());
+	runRanges(vecGroups.size(), [&](std::size_t first, std::size_t last) {
+		NeighborSearch search;
+		for (std::size_t group = first; group < last; ++group) {
+			findGroupNeighbors(root, *vecGroups[group], k, search, vecResults[group]);
+		}
+	});
+
+	for (auto&& result : vecResults) {
+		for (auto&& neighbors : result) {
+			vecNeighbors.push_back(std::move(neighbors));
+		}
+	}
+	return vecNeighbors;
+}
+
+// Get the values hit by a moving box
+template<class Value, class NodeCompare, class Predicate>
+auto SearchTree2D<Value, NodeCompare, Predicate>::getSweptValues(const NodeCompare& box, const Point2D<LeafCoord>& displacement) const -> std::vector<SweptHit> {
+
+	std::vector<SweptHit> vecHits;
+	forEachSweptValue(box, displacement, [&](const Value& val, double time) {
+		SweptHit hit = { val, time };
+		vecHits.push_back(hit);
+		return true;
+	});
+	return vecHits;
+}
+
+// Visit the values hit by a moving box
+template<class Value, class NodeCompare, class Predicate>
+template<class OnHit>
+void SearchTree2D<Value, NodeCompare, Predicate>::forEachSweptValue(const NodeCompare& box, const Point2D<LeafCoord>& displacement, OnHit onHit) const {
+
+	static_assert(supportsLeafSorting, "Swept queries require a predicate with boxOf returning NodeCompare");
+
+	OpContext ctx = beginOperation(m_stats.query);
+	m_tree.sweep(box, displacement, ctx, onHit);
+}
+
+// Collect the join nodes holding values
+template<class Value, class NodeCompare, class Predicate>
+void SearchTree2D<Value, NodeCompare, Predicate>::gatherJoinGroups(const JoinNode& node, std::vector<const JoinNode*>& out) {
+
+	if (!node.values.empty()) {
+		out.push_back(&node);
+	}
+	for (auto&& child : node.children) {
+		gatherJoinGroups(child, out);
+	}
+}
+
+// Collect the join nodes near a box
+template<class Value, class NodeCompare, class Predicate>
+void SearchTree2D<Value, NodeCompare, Predicate>::gatherJoinFrontier(const JoinNode& node, const Box2D<LeafCoord>& bounds, double radiusSquared,
+																	  std::vector<const JoinNode*>& out) {
+
+	if (boxDistanceSquared(node.bounds, bounds) > radiusSquared) {
+		return;
+	}
+
+	if (!node.values.empty() && boxDistanceSquared(node.valueBounds, bounds) <= radiusSquared) {
+		out.push_back(&node);
+	}
+	for (auto&& child : node.children) {
+		gatherJoinFrontier(child, bounds, radiusSquared, out);
+	}
+}
+
+// Find the nearest neighbors of one group's values
+template<class Value, class NodeCompare, class Predicate>
+void SearchTree2D<Value, NodeCompare, Predicate>::findGroupNeighbors(const JoinNode& root, const JoinNode& group, std::size_t k,
+																	  NeighborSearch& search, std::vector<Neighbors>& out) {
+
+	std::size_t memberCount = group.values.size();
+	out.reserve(memberCount);
+
+	// Take the nodes nearest the group until they hold k values besides any one member.
+	// The k-th nearest of those bounds every member's k-th neighbor
+	search.vecFrontier.clear();
+	std::size_t found = 0;
+	std::greater<std::pair<double, const JoinNode*> > isFurther;
+	search.vecQueue.assign(1, std::make_pair(0.0, &root));
+	while (!search.vecQueue.empty() && found <= k) {
+		std::pop_heap(search.vecQueue.begin(), search.vecQueue.end(), isFurther);
+		const JoinNode& node = *search.vecQueue.back().second;
+		search.vecQueue.pop_back();
+
+		if (!node.values.empty()) {
+			search.vecFrontier.push_back(&node);
+			found += node.values.size();
+		}
+		for (auto&& child : node.children) {
+			search.vecQueue.push_back(std::make_pair(boxDistanceSquared(child.bounds, group.valueBounds), &child));
+			std::push_heap(search.vecQueue.begin(), search.vecQueue.end(), isFurther);
+		}
+	}
+
+	double radiusSquared = std::numeric_limits<double>::infinity();
+	if (found > k && k > 0) {
+		radiusSquared = 0;
+		for (std::size_t member = 0; member < memberCount; ++member) {
+			Box2D<LeafCoord> box = group.boxes.at(member);
+			search.vecDistances.clear();
+			for (const JoinNode* pNode : search.vecFrontier) {
+				for (std::size_t i = 0; i < pNode->values.size(); ++i) {
+					if (pNode != &group || i != member) {
+						search.vecDistances.push_back(boxDistanceSquared(box, pNode->boxes.at(i)));
+					}
+				}
+			}
+			std::nth_element(search.vecDistances.begin(), search.vecDistances.begin() + (k - 1), search.vecDistances.end());
+			radiusSquared = std::max(radiusSquared, search.vecDistances[k - 1]);
+		}
+	}
+
+	// Every member's neighbors lie in nodes whose values are within the radius of the group
+	search.vecFrontier.clear();
+	if (k > 0) {
+		gatherJoinFrontier(root, group.valueBounds, radiusSquared, search.vecFrontier);
+	}
+
+	auto isNearer = [](const std::pair<double, Value>& left, const std::pair<double, Value>& right) {
+		return left.first < right.first || (left.first == right.first && left.second < right.second);
+	};
+
+	for (std::size_t member = 0; member < memberCount; ++member) {
+		Box2D<LeafCoord> box = group.boxes.at(member);
+
+		search.vecOrdered.clear();
+		for (const JoinNode* pNode : search.vecFrontier) {
+			search.vecOrdered.push_back(std::make_pair(boxDistanceSquared(box, pNode->valueBounds), pNode));
+		}
+		std::sort(search.vecOrdered.begin(), search.vecOrdered.end());
+
+		// Max heap of the k nearest values so far
+		search.vecNearest.clear();
+		for (auto&& ordered : search.vecOrdered) {
+			if (search.vecNearest.size() == k && ordered.first > search.vecNearest.front().first) {
+				break;
+			}
+
+			const JoinNode& node = *ordered.second;
+			for (std::size_t i = 0; i < node.values.size(); ++i) {
+				if (&node == &group && i == member) {
+					continue;
+				}
+				std::pair<double, Value> candidate(boxDistanceSquared(box, node.boxes.at(i)), node.values[i]);
+				if (search.vecNearest.size() < k) {
+					search.vecNearest.push_back(candidate);
+					std::push_heap(search.vecNearest.begin(), search.vecNearest.end(), isNearer);
+				}
+				else if (isNearer(candidate, search.vecNearest.front())) {
+					std::pop_heap(search.vecNearest.begin(), search.vecNearest.end(), isNearer);
+					search.vecNearest.back() = candidate;
+					std::push_heap(search.vecNearest.begin(), search.vecNearest.end(), isNearer);
+				}
+			}
+		}
+		std::sort_heap(search.vecNearest.begin(), search.vecNearest.end(), isNearer);
+
+		Neighbors neighbors = { group.values[member], std::vector<Value>() };
+		neighbors.nearest.reserve(search.vecNearest.size());
+		for (auto&& nearest : search.vecNearest) {
+			neighbors.nearest.push_back(nearest.second);
+		}
+		out.push_back(std::move(neighbors));
+	}
+}
+
+// Turn rebalance profiling on or off
+template<class Value, class NodeCompare, class Predicate>
+void SearchTree2D<Value, NodeCompare, Predicate>::setRebalanceProfiling(bool enabled) {
+
+	m_profileRebalance = enabled;
+}
+
+// Test if rebalance profiling is on
+template<class Value, class NodeCompare, class Predicate>
+bool SearchTree2D<Value, NodeCompare, Predicate>::isRebalanceProfiling() const {
+
+	return m_profileRebalance;
+}
+
+// Turn operation counters on or off
+template<class Value, class NodeCompare, class Predicate>
+void SearchTree2D<Value, NodeCompare, Predicate>::setStatsEnabled(bool enabled) {
+
+	m_statsEnabled = enabled;
+}
+
+// Test if operation counters are on
+template<class Value, class NodeCompare, class Predicate>
+bool SearchTree2D<Value, NodeCompare, Predicate>::isStatsEnabled() const {
+
+	return m_statsEnabled;
+}
+
+// Get the operation counters
+template<class Value, class NodeCompare, class Predicate>
+const SearchTreeStats& SearchTree2D<Value, NodeCompare, Predicate>::getStats() const {
+
+	return m_stats;
+}
+
+// Zero the operation counters
+template<class Value, class NodeCompare, class Predicate>
+void SearchTree2D<Value, NodeCompare, Predicate>::resetStats() {
+
+	m_stats = SearchTreeStats();
+}
+
+// Turn leaf sorting on or off
+template<class Value, class NodeCompare, class Predicate>
+void SearchTree2D<Value, NodeCompare, Predicate>::setLeafSorting(bool enabled) {
+
+	static_assert(supportsLeafSorting, "Leaf sorting requires a predicate with boxOf returning NodeCompare");
+
+	if (enabled != m_sortLeaves) {
+		m_sortLeaves = enabled;
+		OpContext ctx = beginOperation(m_stats.rebalance);
+		m_tree.setDataIndexed(enabled, ctx);
+
+		// Sorted nodes return different values for the same query
+		++m_structureVersion;
+	}
+}
+
+// Test if leaf sorting is on
+template<class Value, class NodeCompare, class Predicate>
+bool SearchTree2D<Value, NodeCompare, Predicate>::isLeafSorting() const {
+
+	return m_sortLeaves;
+}
+
+// Count a call to an operation and build the context its nodes will use
+template<class Value, class NodeCompare, class Predicate>
+auto SearchTree2D<Value, NodeCompare, Predicate>::beginOperation(OperationStats& operation) const -> OpContext {
+
+	OpContext ctx = { nullptr, nullptr, m_sortLeaves, &m_tree.searchSpace() };
+	if (m_statsEnabled) {
+		++operation.calls;
+		ctx.counts = &operation.predicateCalls;
+	}
+	return ctx;
+}
+
+// =========================================================
+// Node Implementation
+// =========================================================
+// Default Constructor
+template<class Value, class NodeCompare, class Predicate>
+SearchTree2D<Value, NodeCompare, Predicate>::Node::Node(PredicateCallCounts* counts)
+	: m_compare()
+	, m_mapRegions()
+	, m_data()
+	, m_dataIndex()
+	, m_version(0)
+	, m_summary()
+	, m_isChanged(true)
+	, m_hasChanges(true)
+	, m_boxDigest(0)
+{
+	CountedPredicate predicate(counts);
+	m_compare = predicate.nilCompare();
+	resetSummary();
+
+	// build our child node mapping
+	m_mapRegions[RegionCode::UPPER_LEFT] = nullptr;
+	m_mapRegions[RegionCode::UPPER_RIGHT] = nullptr;
+	m_mapRegions[RegionCode::LOWER_LEFT] = nullptr;
+	m_mapRegions[RegionCode::LOWER_RIGHT] = nullptr;
+}
+
+// Destructor
+template<class Value, class NodeCompare, class Predicate>
+SearchTree2D<Value, NodeCompare, Predicate>::Node::~Node() {
+
+	clear();
+}
+
+// Copy constructor
+template<class Value, class NodeCompare, class Predicate>
+SearchTree2D<Value, NodeCompare, Predicate>::Node::Node(const Node& other)
+	: m_compare(other.m_compare)
+	, m_mapRegions()
+	, m_data(other.m_data)
+	, m_dataIndex(other.m_dataIndex ? new DataIndex(*other.m_dataIndex) : nullptr)
+	, m_version(other.m_version)
+	, m_summary(other.m_summary)
+	, m_isChanged(other.m_isChanged)
+	, m_hasChanges(other.m_hasChanges)
+	, m_boxDigest(other.m_boxDigest)
+{
+	// build our child node mapping
+	m_mapRegions[RegionCode::UPPER_LEFT] = nullptr;
+	m_mapRegions[RegionCode::UPPER_RIGHT] = nullptr;
+	m_mapRegions[RegionCode::LOWER_LEFT] = nullptr;
+	m_mapRegions[RegionCode::LOWER_RIGHT] = nullptr;
+
+	for (auto&& region : other.m_mapRegions) {
+		if (region.second) {
+			m_mapRegions[region.first] = std::unique_ptr<Node>(new Node(*(region.second)));
+		}
+	}
+}
+
+// Add a value to the node
+template<class Value, class NodeCompare, class Predicate>
+void SearchTree2D<Value, NodeCompare, Predicate>::Node::add(const Value& val, const OpContext& ctx) {
+
+	std::size_t oldCount = m_summary.count;
+
+	if (hasChildren()) {
+		bool wasAdded = addToChildren(val, ctx, std::integral_constant<bool, isPointTree>());
+
+		if (!wasAdded) {
+			// The new value wasn't added to any children. This means that there is
+			// either a bug in predicate implementation or this is the root node
+			// and the new value belongs outside of the root search space.
+			// Either way, let's hold onto this value as part of this node and let a future
+			// rebalance ensure the child search spaces satisfy this value
+			insertData(val, ctx);
+		}
+	}
+	else {
+		insertData(val, ctx);
+	}
+
+	// Only values that were inserted somewhere below us change the summary
+	updateCount();
+	if (m_summary.count > oldCount) {
+		CountedPredicate predicate(ctx.counts);
+		summarize(val, predicate);
+		summarizeCenter(val, m_summary.count - oldCount, ctx, predicate, LeafSortTag());
+	}
+}
+
+// Remove a value from the node or its children
+template<class Value, class NodeCompare, class Predicate>
+bool SearchTree2D<Value, NodeCompare, Predicate>::Node::remove(const Value& val, const OpContext& ctx) {
+
+	bool wasRemoved = false;
+	if (hasChildren()) {
+		for (auto&& region : m_mapRegions) {
+			if (region.second && region.second->remove(val, ctx)) {
+				wasRemoved = true;
+			}
+		}
+	}
+
+	std::uint64_t oldVersion = m_version;
+	eraseData(val);
+	if (m_version != oldVersion) {
+		wasRemoved = true;
+	}
+
+	if (wasRemoved) {
+		updateSummary(ctx);
+	}
+	return wasRemoved;
+}
+
+// Clear the node and its children of all values
+template<class Value, class NodeCompare, class Predicate>
+void SearchTree2D<Value, NodeCompare, Predicate>::Node::clear() {
+	if (hasChildren()) {
+		for (auto&& region : m_mapRegions) {
+			if (region.second) {
+				region.second->clear();
+			}
+		}
+		deleteChildren();
+	}
+
+	clearData();
+	resetSummary();
+}
+
+// Get values belonging to child leafs whos search space satisfies the test compare
+template<class Value, class NodeCompare, class Predicate>
+template<class Output>
+void SearchTree2D<Value, NodeCompare, Predicate>::Node::getNearbyValues(const NodeCompare& compare, const OpContext& ctx, Output& out, TouchedNodes* touched) const {
+
+	CountedPredicate predicate(ctx.counts);
+
+	// Child search spaces are quadrants of this search space, so if compare misses us
+	// it misses all of our children as well
+	if (!predicate.overlaps(m_compare, compare)) {
+		return;
+	}
+
+	if (touched) {
+		touched->push_back(std::make_pair(this, m_version));
+	}
+
+	// Return our values. This will also return orphaned values that belong to this node but not its children
+	appendOwnValues(compare, out);
+
+	if (hasChildren()) {
+		// Check children and get their values if compare overlaps with the childs's search space
+		for (auto&& region : m_mapRegions) {
+			if (region.second) {
+				region.second->getNearbyValues(compare, ctx, out, touched);
+			}
+		}
+	}
+}
+
+// Get values in a region expression below this node
+template<class Value, class NodeCompare, class Predicate>
+template<class Output>
+void SearchTree2D<Value, NodeCompare, Predicate>::Node::getExpressionValues(const RegionExpression& expression, const std::vector<Coverage>& parentCoverage,
+																			 const OpContext& ctx, std::vector<Coverage>& stack, Output& out) const {
+
+	// Search spaces holding none or all of the parent's values do the same for ours
+	std::size_t regionCount = expression.m_regions.size();
+	std::vector<Coverage> vecCoverage(regionCount);
+	for (std::size_t region = 0; region < regionCount; ++region) {
+		if (!parentCoverage.empty() && parentCoverage[region] != Coverage::SOME) {
+			vecCoverage[region] = parentCoverage[region];
+		}
+		else {
+			vecCoverage[region] = coverageOf(expression.m_regions[region], ctx);
+		}
+	}
+
+	auto nodeCoverage = [&](std::size_t region) {
+		return vecCoverage[region];
+	};
+	Coverage coverage = evaluateExpression(expression, nodeCoverage, stack);
+	if (coverage == Coverage::NONE) {
+		return;
+	}
+
+	// Without supportsLeafSorting NONE only says a search space misses ours, and values
+	// straddling our edge may still satisfy it, so our values are tested against it too
+	auto heldCoverage = [&](std::size_t region) {
+		return !supportsLeafSorting && vecCoverage[region] == Coverage::NONE ? Coverage::SOME : vecCoverage[region];
+	};
+
+	// Orphans may lie outside of our search space, so search spaces holding all of it are still tested
+	CountedPredicate predicate(ctx.counts);
+	bool isLeaf = !hasChildren();
+	bool isAllHeld = isLeaf && evaluateExpression(expression, heldCoverage, stack) == Coverage::ALL;
+	for (auto&& val : m_data) {
+		auto valueCoverage = [&](std::size_t region) {
+			Coverage held = heldCoverage(region);
+			if (held == Coverage::NONE || (isLeaf && held == Coverage::ALL)) {
+				return held;
+			}
+			return predicate.satisfies(expression.m_regions[region], val) ? Coverage::ALL : Coverage::NONE;
+		};
+		if (isAllHeld || evaluateExpression(expression, valueCoverage, stack) == Coverage::ALL) {
+			appendValue(out, val);
+		}
+	}
+
+	for (auto&& region : m_mapRegions) {
+		if (region.second) {
+			region.second->getExpressionValues(expression, vecCoverage, ctx, stack, out);
+		}
+	}
+}
+
+// Classify this node's values against a search space
+template<class Value, class NodeCompare, class Predicate>
+auto SearchTree2D<Value, NodeCompare, Predicate>::Node::coverageOf(const NodeCompare& region, const OpContext& ctx) const -> Coverage {
+
+	CountedPredicate predicate(ctx.counts);
+
+	if (m_summary.count == 0 || !valuesOverlap(region, predicate, LeafSortTag())) {
+		return Coverage::NONE;
+	}
+	if (isInside(region, predicate, QueryCacheTag())) {
+		return Coverage::ALL;
+	}
+	return Coverage::SOME;
+}
+
+// Test the bounds of this node's values against a search space
+template<class Value, class NodeCompare, class Predicate>
+bool SearchTree2D<Value, NodeCompare, Predicate>::Node::valuesOverlap(const NodeCompare& region, CountedPredicate& predicate, std::true_type) const {
+
+	return predicate.overlaps(m_summary.bounds, region);
+}
+
+template<class Value, class NodeCompare, class Predicate>
+bool SearchTree2D<Value, NodeCompare, Predicate>::Node::valuesOverlap(const NodeCompare& region, CountedPredicate& predicate, std::false_type) const {
+
+	return predicate.overlaps(m_compare, region);
+}
+
+// Test if a search space strictly holds this node
+template<class Value, class NodeCompare, class Predicate>
+bool SearchTree2D<Value, NodeCompare, Predicate>::Node::isInside(const NodeCompare& region, CountedPredicate& predicate, std::true_type) const {
+
+	return predicate.containsStrictly(region, m_compare);
+}
+
+// Get filtered values from nodes overlapping the query
+template<class Value, class NodeCompare, class Predicate>
+template<class Output, class Filter>
+void SearchTree2D<Value, NodeCompare, Predicate>::Node::getFilteredValues(const NodeCompare& compare, Filter& filter, const OpContext& ctx, Output& out) const {
+
+	CountedPredicate predicate(ctx.counts);
+
+	// Test the summary first as it needs no predicate call
+	if (!filter.acceptsSummary(m_summary) || !predicate.overlaps(m_compare, compare)) {
+		return;
+	}
+
+	if (m_dataIndex) {
+		std::vector<Value> vecIndexed;
+		appendIndexedValues(compare, vecIndexed, LeafSortTag());
+		for (auto&& val : vecIndexed) {
+			if (filter.acceptsValue(val)) {
+				appendValue(out, val);
+			}
+		}
+	}
+	else {
+		for (auto&& val : m_data) {
+			if (filter.acceptsValue(val)) {
+				appendValue(out, val);
+			}
+		}
+	}
+
+	if (hasChildren()) {
+		for (auto&& region : m_mapRegions) {
+			if (region.second) {
+				region.second->getFilteredValues(compare, filter, ctx, out);
+			}
+		}
+	}
+}
+
+// Best first search for the highest priority values
+template<class Value, class NodeCompare, class Predicate>
+void SearchTree2D<Value, NodeCompare, Predicate>::Node::getTopValues(const NodeCompare& compare, std::size_t k, const OpContext& ctx, RankedValues& ranked) const {
+
+	CountedPredicate predicate(ctx.counts);
+
+	// Nodes waiting to be searched, highest subtree priority first
+	std::priority_queue<std::pair<Priority, const Node*> > queNodes;
+	queNodes.push(std::make_pair(m_summary.maxPriority, this));
+
+	std::vector<Value> vecValues;
+	while (!queNodes.empty()) {
+		Priority bound = queNodes.top().first;
+		const Node* node = queNodes.top().second;
+		queNodes.pop();
+
+		// Nothing left can beat the k-th value. Equal priorities may still win on value order
+		if (ranked.size() == k && bound < ranked.rbegin()->first) {
+			break;
+		}
+
+		if (!predicate.overlaps(node->m_compare, compare)) {
+			continue;
+		}
+
+		vecValues.clear();
+		node->appendOwnValues(compare, vecValues);
+		for (auto&& val : vecValues) {
+			Priority priority = predicate.priorityOf(val);
+			if (ranked.size() == k && priority < ranked.rbegin()->first) {
+				continue;
+			}
+
+			ranked.insert(std::make_pair(priority, val));
+			if (ranked.size() > k) {
+				auto itWorst = ranked.end();
+				ranked.erase(--itWorst);
+			}
+		}
+
+		for (auto&& region : node->m_mapRegions) {
+			if (region.second) {
+				queNodes.push(std::make_pair(region.second->m_summary.maxPriority, region.second.get()));
+			}
+		}
+	}
+}
+
+// Sample values near a query in proportion to node counts
+template<class Value, class NodeCompare, class Predicate>
+std::size_t SearchTree2D<Value, NodeCompare, Predicate>::Node::sampleValues(const NodeCompare& compare, std::size_t quota, const OpContext& ctx, std::mt19937& rng, SetValue* pSeen, std::vector<Value>& out) const {
+
+	CountedPredicate predicate(ctx.counts);
+
+	// Our own values and each child overlapping the query share the quota
+	std::vector<const Node*> vecChildren;
+	std::vector<std::size_t> vecCounts(1, m_data.size());
+	std::size_t total = m_data.size();
+	for (auto&& region : m_mapRegions) {
+		if (region.second && region.second->m_summary.count > 0 && predicate.overlaps(region.second->m_compare, compare)) {
+			vecChildren.push_back(region.second.get());
+			vecCounts.push_back(region.second->m_summary.count);
+			total += region.second->m_summary.count;
+		}
+	}
+
+	// Small enough to take everything
+	std::size_t firstNew = out.size();
+	if (total <= quota) {
+		appendOwnValues(compare, out);
+		for (const Node* child : vecChildren) {
+			child->getNearbyValues(compare, ctx, out);
+		}
+		if (pSeen) {
+			out.erase(std::remove_if(out.begin() + firstNew, out.end(), [pSeen](const Value& val) {
+				return !pSeen->insert(val).second;
+			}), out.end());
+		}
+		return out.size() - firstNew;
+	}
+
+	// Split the quota by count, handing what rounding leaves over to the largest remainders
+	std::vector<std::size_t> vecQuotas(vecCounts.size());
+	std::vector<std::pair<std::uint64_t, std::size_t> > vecRemainders;
+	std::size_t assigned = 0;
+	for (std::size_t i = 0; i < vecCounts.size(); ++i) {
+		std::uint64_t share = static_cast<std::uint64_t>(quota) * vecCounts[i];
+		vecQuotas[i] = static_cast<std::size_t>(share / total);
+		vecRemainders.push_back(std::make_pair(share % total, i));
+		assigned += vecQuotas[i];
+	}
+	std::sort(vecRemainders.begin(), vecRemainders.end(), [](const std::pair<std::uint64_t, std::size_t>& left, const std::pair<std::uint64_t, std::size_t>& right) {
+		return right.first < left.first;
+	});
+	for (std::size_t i = 0; assigned < quota && i < vecRemainders.size(); ++i, ++assigned) {
+		++vecQuotas[vecRemainders[i].second];
+	}
+
+	// Counts include values outside of the query, so a child may fill less than its share.
+	// What it leaves over is passed on to the next child and finally to our own values
+	std::size_t carry = 0;
+	for (std::size_t i = 0; i < vecChildren.size(); ++i) {
+		std::size_t share = vecQuotas[i + 1] + carry;
+		if (share > 0) {
+			carry = share - vecChildren[i]->sampleValues(compare, share, ctx, rng, pSeen, out);
+		}
+	}
+
+	// Pick our share of our own values at random, passing over values already drawn
+	std::size_t share = vecQuotas[0] + carry;
+	if (share > 0) {
+		std::vector<Value> vecOwn;
+		appendOwnValues(compare, vecOwn);
+		std::size_t picks = 0;
+		for (std::size_t i = 0; picks < share && i < vecOwn.size(); ++i) {
+			std::uniform_int_distribution<std::size_t> pick(i, vecOwn.size() - 1);
+			std::swap(vecOwn[i], vecOwn[pick(rng)]);
+			if (!pSeen || pSeen->insert(vecOwn[i]).second) {
+				out.push_back(vecOwn[i]);
+				++picks;
+			}
+		}
+	}
+	return out.size() - firstNew;
+}
+
+// Gather clusters from the nodes overlapping a query
+template<class Value, class NodeCompare, class Predicate>
+template<class CutTest>
+void SearchTree2D<Value, NodeCompare, Predicate>::Node::getClusters(const NodeCompare& compare, CutTest& isCut, std::size_t depth, const OpContext& ctx, std::vector<Cluster>& out) const {
+
+	CountedPredicate predicate(ctx.counts);
+
+	if (m_summary.count == 0 || !predicate.overlaps(m_compare, compare)) {
+		return;
+	}
+
+	Cluster cluster;
+	cluster.region = m_compare;
+	cluster.depth = depth;
+
+	// The whole subtree becomes one cluster
+	if (!hasChildren() || isCut(m_compare, depth)) {
+		cluster.count = m_summary.count;
+		cluster.centroid.x = m_summary.sumX / m_summary.count;
+		cluster.centroid.y = m_summary.sumY / m_summary.count;
+		cluster.bounds = m_summary.bounds;
+		out.push_back(cluster);
+		return;
+	}
+
+	// Orphaned values are summarized on their own
+	if (!m_data.empty()) {
+		cluster.count = m_data.size();
+		cluster.centroid.x = 0;
+		cluster.centroid.y = 0;
+		cluster.bounds = predicate.boxOf(*m_data.begin());
+		for (auto&& val : m_data) {
+			NodeCompare box = predicate.boxOf(val);
+			cluster.centroid.x += (static_cast<double>(box.minX) + box.maxX) / 2;
+			cluster.centroid.y += (static_cast<double>(box.minY) + box.maxY) / 2;
+			cluster.bounds = boxUnion(cluster.bounds, box);
+		}
+		cluster.centroid.x /= cluster.count;
+		cluster.centroid.y /= cluster.count;
+		out.push_back(cluster);
+	}
+
+	for (auto&& region : m_mapRegions) {
+		if (region.second) {
+			region.second->getClusters(compare, isCut, depth + 1, ctx, out);
+		}
+	}
+}
+
+// Add the values this subtree owns to a raster
+template<class Value, class NodeCompare, class Predicate>
+void SearchTree2D<Value, NodeCompare, Predicate>::Node::rasterize(const RasterGrid& grid, const OpContext& ctx, std::vector<std::size_t>& out) const {
+
+	const Box2D<LeafCoord>& bounds = m_summary.bounds;
+	const NodeCompare& region = grid.region;
+	if (m_summary.ownedCount == 0 || bounds.maxX < region.minX || region.maxX < bounds.minX ||
+		bounds.maxY < region.minY || region.maxY < bounds.minY) {
+		return;
+	}
+
+	// Box centers lie inside the bounds, so bounds within one cell put every value in it
+	std::size_t minColumn, minRow, maxColumn, maxRow;
+	if (grid.cellOf(bounds.minX, bounds.minY, minColumn, minRow) && grid.cellOf(bounds.maxX, bounds.maxY, maxColumn, maxRow) &&
+		minColumn == maxColumn && minRow == maxRow) {
+		out[minRow * grid.width + minColumn] += m_summary.ownedCount;
+		return;
+	}
+
+	CountedPredicate predicate(ctx.counts);
+
+	for (auto&& val : m_data) {
+		NodeCompare box = predicate.boxOf(val);
+		std::size_t column, row;
+		if (ownsCenter(box, ctx) &&
+			grid.cellOf((static_cast<double>(box.minX) + box.maxX) / 2, (static_cast<double>(box.minY) + box.maxY) / 2, column, row)) {
+			++out[row * grid.width + column];
+		}
+	}
+
+	for (auto&& child : m_mapRegions) {
+		if (child.second) {
+			child.second->rasterize(grid, ctx, out);
+		}
+	}
+}
+
+// Remove values older than a time
+template<class Value, class NodeCompare, class Predicate>
+bool SearchTree2D<Value, NodeCompare, Predicate>::Node::retireBefore(Time time, const OpContext& ctx) {
+
+	// Nothing below us is old enough
+	if (!(m_summary.minTime < time)) {
+		return false;
+	}
+
+	bool wasRemoved = false;
+	if (hasChildren()) {
+		for (auto&& region : m_mapRegions) {
+			if (region.second && region.second->retireBefore(time, ctx)) {
+				wasRemoved = true;
+			}
+		}
+	}
+
+	CountedPredicate predicate(ctx.counts);
+	std::vector<Value> vecRetired;
+	for (auto&& val : m_data) {
+		if (predicate.timeOf(val) < time) {
+			vecRetired.push_back(val);
+		}
+	}
+	for (auto&& val : vecRetired) {
+		eraseData(val);
+	}
+
+	if (wasRemoved || !vecRetired.empty()) {
+		updateSummary(ctx);
+		return true;
+	}
+	return false;
+}
+
+// Get this node's own values
+template<class Value, class NodeCompare, class Predicate>
+template<class Output>
+void SearchTree2D<Value, NodeCompare, Predicate>::Node::appendOwnValues(const NodeCompare& compare, Output& out) const {
+
+	if (m_dataIndex) {
+		appendIndexedValues(compare, out, LeafSortTag());
+	}
+	else {
+		appendValues(out, m_data);
+	}
+}
+
+// Test if a query overlaps this node
+template<class Value, class NodeCompare, class Predicate>
+bool SearchTree2D<Value, NodeCompare, Predicate>::Node::overlaps(const NodeCompare& compare, const OpContext& ctx) const {
+
+	CountedPredicate predicate(ctx.counts);
+	return predicate.overlaps(m_compare, compare);
+}
+
+// Test if a query lies strictly inside this node
+template<class Value, class NodeCompare, class Predicate>
+bool SearchTree2D<Value, NodeCompare, Predicate>::Node::containsStrictly(const NodeCompare& compare, const OpContext& ctx) const {
+
+	CountedPredicate predicate(ctx.counts);
+	return predicate.containsStrictly(m_compare, compare);
+}
+
+// Find the child strictly holding a query
+template<class Value, class NodeCompare, class Predicate>
+auto SearchTree2D<Value, NodeCompare, Predicate>::Node::childContainingStrictly(const NodeCompare& compare, const OpContext& ctx) const -> const Node* {
+
+	for (auto&& region : m_mapRegions) {
+		if (region.second && region.second->containsStrictly(compare, ctx)) {
+			return region.second.get();
+		}
+	}
+	return nullptr;
+}
+
+// Get the version of this node's values
+template<class Value, class NodeCompare, class Predicate>
+std::uint64_t SearchTree2D<Value, NodeCompare, Predicate>::Node::version() const {
+
+	return m_version;
+}
+
+// Get the search space
+template<class Value, class NodeCompare, class Predicate>
+const NodeCompare& SearchTree2D<Value, NodeCompare, Predicate>::Node::searchSpace() const {
+
+	return m_compare;
+}
+
+// Build a root search space based off of current data
+template<class Value, class NodeCompare, class Predicate>
+void SearchTree2D<Value, NodeCompare, Predicate>::Node::buildRootRegion(const OpContext& ctx) {
+
+	CountedPredicate predicate(ctx.counts);
+
+	RebalancePhaseTimer timer(ctx.profile, &RebalancePhases::buildRootRegion, 0);
+
+	// Build our search space based off of our data
+	NodeCompare compare = predicate.buildRegionFromData(getAllChildValues());
+	if (!isSameCompare(m_compare, compare, EqualityTag())) {
+		markChanged();
+	}
+	m_compare = compare;
+}
+
+// Rebalance this node and its children
+template<class Value, class NodeCompare, class Predicate>
+void SearchTree2D<Value, NodeCompare, Predicate>::Node::rebalance(const OpContext& ctx, std::size_t depth) {
+
+	CountedPredicate predicate(ctx.counts);
+
+	if (ctx.profile) {
+		++ctx.profile->nodesVisited;
+	}
+
+	// Rebalancing empties and refills the node, so it only counts as changed if it ends up
+	// with different values, boxes or children
+	bool wasChanged = m_isChanged;
+	bool hadChanges = m_hasChanges;
+	bool hadChildren = hasChildren();
+
+	SetValue setAllData;
+	{
+		RebalancePhaseTimer timer(ctx.profile, &RebalancePhases::gatherValues, depth);
+		setAllData = getAllChildValues();
+	}
+
+	// Remove data that no longer satisfies this node's compare
+	{
+		RebalancePhaseTimer timer(ctx.profile, &RebalancePhases::filterValues, depth);
+		for (typename SetValue::iterator itSet = setAllData.begin(); itSet != setAllData.end(); ) {
+			if (!predicate.satisfies(m_compare, *itSet)) {
+				setAllData.erase(itSet++);
+			}
+			else {
+				++itSet;
+			}
+		}
+	}
+
+	// Clear our local set. This set will be reset if necessary and will also
+	// hold onto orphaned values if necessary. The old values are swapped out rather than
+	// copied, to compare against once we are done
+	SetValue setOldData;
+	setOldData.swap(m_data);
+	clearData();
+
+	if (hasChildren()) {
+		// Should we keep the children?
+		// first just check raw data size
+
+		if (setAllData.size() <= g_minDataSize) {
+			// Our data set is small enough that we don't need children for our search space
+			{
+				RebalancePhaseTimer timer(ctx.profile, &RebalancePhases::allocateNodes, depth);
+				deleteChildren();
+			}
+			assignData(setAllData, ctx);
+		}
+		else {
+
+			// Now check if subdividing will do anything
+
+			// Let's update our child quadrants
+			// First grab references to our children's search spaces
+			QuadMap mapQuads;
+			std::vector<NodeCompare> vecOldCompares;
+			for (auto&& region : m_mapRegions) {
+				mapQuads.insert(QuadPair(region.first, region.second->m_compare));
+				vecOldCompares.push_back(region.second->m_compare);
+			}
+
+			// Use our predicate to rebuild our quadrant search spaces
+			{
+				RebalancePhaseTimer timer(ctx.profile, &RebalancePhases::buildQuadrants, depth);
+				predicate.buildQuadrantsFromData(m_compare, setAllData, mapQuads);
+			}
+
+			auto itOldCompare = vecOldCompares.begin();
+			for (auto&& region : m_mapRegions) {
+				if (!isSameCompare(*itOldCompare++, region.second->m_compare, EqualityTag())) {
+					region.second->markChanged();
+				}
+			}
+
+			// Do we still need children?
+			bool subdivide;
+			{
+				RebalancePhaseTimer timer(ctx.profile, &RebalancePhases::subdivideTest, depth);
+				subdivide = shouldSubdivide(setAllData, mapQuads, ctx);
+			}
+
+			if (subdivide) {
+
+				// Re-add our data to our children
+				{
+					RebalancePhaseTimer timer(ctx.profile, &RebalancePhases::addValues, depth);
+					for (auto thisVal : setAllData) {
+						// This may modify m_data of the value is orphaned
+						add(thisVal, ctx);
+					}
+				}
+
+				// rebalance our child nodes
+				for (auto&& region : m_mapRegions) {
+					if (region.second) {
+						region.second->rebalance(ctx, depth + 1);
+					}
+				}
+			}
+			else {
+				// We no longer need children. Just hold onto the data ourselves
+				{
+					RebalancePhaseTimer timer(ctx.profile, &RebalancePhases::allocateNodes, depth);
+					deleteChildren();
+				}
+				assignData(setAllData, ctx);
+			}
+		}
+	}
+	// Should we subdivide and create children?
+	else {
+		// check raw data size
+		if (setAllData.size() <= g_minDataSize) {
+			// The data set is small enough that we don't need to create children
+			assignData(setAllData, ctx);
+		}
+		else {
+
+			// Let's build some test quads and see if they will subdivide
+
+			NodeCompare ulComp = predicate.nilCompare();
+			NodeCompare urComp = predicate.nilCompare();
+			NodeCompare llComp = predicate.nilCompare();
+			NodeCompare lrComp = predicate.nilCompare();
+
+			QuadMap mapQuads;
+			mapQuads.insert(QuadPair(RegionCode::UPPER_LEFT, ulComp));
+			mapQuads.insert(QuadPair(RegionCode::UPPER_RIGHT, urComp));
+			mapQuads.insert(QuadPair(RegionCode::LOWER_LEFT, llComp));
+			mapQuads.insert(QuadPair(RegionCode::LOWER_RIGHT, lrComp));
+
+			// Build our test quads from our data
+			{
+				RebalancePhaseTimer timer(ctx.profile, &RebalancePhases::buildQuadrants, depth);
+				predicate.buildQuadrantsFromData(m_compare, setAllData, mapQuads);
+			}
+
+			// Do we need children?
+			bool subdivide;
+			{
+				RebalancePhaseTimer timer(ctx.profile, &RebalancePhases::subdivideTest, depth);
+				subdivide = shouldSubdivide(setAllData, mapQuads, ctx);
+			}
+
+			if (subdivide) {
+
+				// We need children, so build some child nodes and set their search spaces
+				{
+					RebalancePhaseTimer timer(ctx.profile, &RebalancePhases::allocateNodes, depth);
+					for (auto& region : m_mapRegions) {
+						if (!region.second) {
+							region.second = std::unique_ptr<Node>(new Node(ctx.counts));
+						}
+						region.second->setCompare(mapQuads.at(region.first));
+					}
+				}
+
+				// Add the values to our children
+				{
+					RebalancePhaseTimer timer(ctx.profile, &RebalancePhases::addValues, depth);
+					for (auto&& thisVal : setAllData) {
+						// This may modify m_data of the value is orphaned
+						add(thisVal, ctx);
+					}
+				}
+
+				// Rebalance our newly created children so they may create
+				// children of their own
+				for (auto&& region : m_mapRegions) {
+					if (region.second) {
+						region.second->rebalance(ctx, depth + 1);
+					}
+				}
+			}
+			else {
+
+				// We don't need children
+				assignData(setAllData, ctx);
+			}
+		}
+	}
+
+	std::uint64_t boxDigest = digestBoxes(predicate, LeafSortTag());
+	m_isChanged = wasChanged || hadChildren != hasChildren() || !hasSameData(setOldData) || boxDigest != m_boxDigest;
+	m_hasChanges = hadChanges || m_isChanged;
+	m_boxDigest = boxDigest;
+
+	// Values were re-added and children rebalanced, so rebuild our aggregates from scratch
+	updateSummary(ctx);
+}
+
+// Visit this node and then its children
+template<class Value, class NodeCompare, class Predicate>
+template<class Visitor>
+void SearchTree2D<Value, NodeCompare, Predicate>::Node::visit(Visitor& visitor, std::size_t depth) const {
+
+	bool isLeaf = !hasChildren();
+
+	NodeVisit nodeVisit = { m_compare, m_data, depth, isLeaf, m_hasChanges };
+	if (!visitor(static_cast<const NodeVisit&>(nodeVisit)) || isLeaf) {
+		return;
+	}
+
+	for (auto&& region : m_mapRegions) {
+		if (region.second) {
+			region.second->visit(visitor, depth + 1);
+		}
+	}
+}
+
+// Add a value to every child that it satisfies
+template<class Value, class NodeCompare, class Predicate>
+bool SearchTree2D<Value, NodeCompare, Predicate>::Node::addToChildren(const Value& val, const OpContext& ctx, std::false_type) {
+
+	CountedPredicate predicate(ctx.counts);
+
+	bool wasAdded = false;
+	for (auto&& region : m_mapRegions) {
+		// Check children of they should hold the value
+		if (region.second && predicate.satisfies(region.second->m_compare, val)) {
+			region.second->add(val, ctx);
+			wasAdded = true;
+		}
+	}
+	return wasAdded;
+}
+
+// Add a value to the one child it is routed to
+template<class Value, class NodeCompare, class Predicate>
+bool SearchTree2D<Value, NodeCompare, Predicate>::Node::addToChildren(const Value& val, const OpContext& ctx, std::true_type) {
+
+	CountedPredicate predicate(ctx.counts);
+
+	// The routed child still has to satisfy the value. It won't if this is the root
+	// and the value lies outside of the root search space
+	auto&& child = m_mapRegions.at(predicate.quadrantOf(m_compare, val));
+	if (child && predicate.satisfies(child->m_compare, val)) {
+		child->add(val, ctx);
+		return true;
+	}
+	return false;
+}
+
+// Append values to a set result
+template<class Value, class NodeCompare, class Predicate>
+void SearchTree2D<Value, NodeCompare, Predicate>::Node::appendValues(SetValue& out, const SetValue& values) {
+
+	// std::set guarantees uniqueness (values may belong to more than one node)
+	out.insert(values.begin(), values.end());
+}
+
+// Append values to a vector result
+template<class Value, class NodeCompare, class Predicate>
+void SearchTree2D<Value, NodeCompare, Predicate>::Node::appendValues(std::vector<Value>& out, const SetValue& values) {
+
+	out.insert(out.end(), values.begin(), values.end());
+}
+
+// Append a value to a set result
+template<class Value, class NodeCompare, class Predicate>
+void SearchTree2D<Value, NodeCompare, Predicate>::Node::appendValue(SetValue& out, const Value& val) {
+
+	out.insert(val);
+}
+
+// Append a value to a vector result
+template<class Value, class NodeCompare, class Predicate>
+void SearchTree2D<Value, NodeCompare, Predicate>::Node::appendValue(std::vector<Value>& out, const Value& val) {
+
+	out.push_back(val);
+}
+
+// Build or drop the value index for this node and its children
+template<class Value, class NodeCompare, class Predicate>
+void SearchTree2D<Value, NodeCompare, Predicate>::Node::setDataIndexed(bool enabled, const OpContext& ctx) {
+
+	if (enabled) {
+		CountedPredicate predicate(ctx.counts);
+		rebuildDataIndex(predicate, LeafSortTag());
+	}
+	else {
+		m_dataIndex.reset();
+	}
+
+	for (auto&& region : m_mapRegions) {
+		if (region.second) {
+			region.second->setDataIndexed(enabled, ctx);
+		}
+	}
+}
+
+// Grow the root until it holds a value
+template<class Value, class NodeCompare, class Predicate>
+std::size_t SearchTree2D<Value, NodeCompare, Predicate>::Node::growToFit(const Value& val, const OpContext& ctx, std::true_type) {
+
+	CountedPredicate predicate(ctx.counts);
+
+	std::size_t growths = 0;
+	while (growths < g_maxRootGrowths && !predicate.satisfies(m_compare, val)) {
+		++growths;
+
+		RegionCode childCode;
+		NodeCompare grown = predicate.growRegion(m_compare, val, childCode);
+
+		// A saturated search space can't grow any further
+		if (isSameCompare(grown, m_compare, EqualityTag())) {
+			break;
+		}
+
+		if (!hasChildren()) {
+			// A leaf root holds all of its values itself, so only its search space changes
+			m_compare = grown;
+			continue;
+		}
+
+		// Move our contents into a new node that takes its place as a quadrant of the new root
+		std::unique_ptr<Node> oldRoot(new Node(ctx.counts));
+		swap(*oldRoot, *this);
+		m_compare = grown;
+
+		// Build the other quadrants. The old root keeps its own search space
+		NodeCompare oldCompare = predicate.nilCompare();
+		QuadMap mapQuads;
+		for (auto&& region : m_mapRegions) {
+			if (region.first == childCode) {
+				mapQuads.insert(QuadPair(region.first, oldCompare));
+			}
+			else {
+				region.second = std::unique_ptr<Node>(new Node(ctx.counts));
+				mapQuads.insert(QuadPair(region.first, region.second->m_compare));
+			}
+		}
+		predicate.buildQuadrantsFromData(m_compare, SetValue(), mapQuads);
+
+		// Values orphaned by the old root may belong to the new quadrants
+		SetValue setOrphans = oldRoot->m_data;
+		oldRoot->clearData();
+		oldRoot->updateSummary(ctx);
+		m_mapRegions[childCode] = std::move(oldRoot);
+		updateSummary(ctx);
+
+		for (auto&& orphan : setOrphans) {
+			add(orphan, ctx);
+		}
+	}
+
+	// The root's search space decides which nodes own the values' centers
+	if (growths > 0 && supportsLeafSorting) {
+		updateSummaries(ctx);
+	}
+	return growths;
+}
+
+// Restore this node's search space and values
+template<class Value, class NodeCompare, class Predicate>
+void SearchTree2D<Value, NodeCompare, Predicate>::Node::restore(const NodeRestore& restored, const OpContext& ctx) {
+
+	m_compare = restored.compare;
+	for (auto&& val : restored.values) {
+		insertData(val, ctx);
+	}
+}
+
+// Create a child while restoring
+template<class Value, class NodeCompare, class Predicate>
+auto SearchTree2D<Value, NodeCompare, Predicate>::Node::restoreChild(std::size_t index, const OpContext& ctx) -> Node* {
+
+	if (index >= m_mapRegions.size()) {
+		return nullptr;
+	}
+
+	auto itRegion = m_mapRegions.begin();
+	std::advance(itRegion, index);
+	itRegion->second = std::unique_ptr<Node>(new Node(ctx.counts));
+	return itRegion->second.get();
+}
+
+// Rebuild every summary bottom up
+template<class Value, class NodeCompare, class Predicate>
+void SearchTree2D<Value, NodeCompare, Predicate>::Node::updateSummaries(const OpContext& ctx) {
+
+	for (auto&& region : m_mapRegions) {
+		if (region.second) {
+			region.second->updateSummaries(ctx);
+		}
+	}
+	updateSummary(ctx);
+}
+
+// Rebuild summaries bottom up
+template<class Value, class NodeCompare, class Predicate>
+void SearchTree2D<Value, NodeCompare, Predicate>::Node::finishRestore(const OpContext& ctx) {
+
+	for (auto&& region : m_mapRegions) {
+		if (region.second) {
+			region.second->finishRestore(ctx);
+		}
+	}
+	updateSummary(ctx);
+
+	CountedPredicate predicate(ctx.counts);
+	m_boxDigest = digestBoxes(predicate, LeafSortTag());
+}
+
+// Set the change state of this subtree
+template<class Value, class NodeCompare, class Predicate>
+void SearchTree2D<Value, NodeCompare, Predicate>::Node::setChanged(bool changed) {
+
+	// Unchanged subtrees have nothing below them to clear
+	if (!changed && !m_hasChanges) {
+		return;
+	}
+
+	m_isChanged = changed;
+	m_hasChanges = changed;
+	for (auto&& region : m_mapRegions) {
+		if (region.second) {
+			region.second->setChanged(changed);
+		}
+	}
+}
+
+// Best first search along a moving box
+template<class Value, class NodeCompare, class Predicate>
+template<class OnHit>
+void SearchTree2D<Value, NodeCompare, Predicate>::Node::sweep(const NodeCompare& box, const Point2D<LeafCoord>& displacement, const OpContext& ctx, OnHit& onHit) const {
+
+	CountedPredicate predicate(ctx.counts);
+
+	// Nodes by when the box reaches the bounds of their values, and values by when it reaches them
+	std::priority_queue<std::pair<double, const Node*>, std::vector<std::pair<double, const Node*> >,
+						std::greater<std::pair<double, const Node*> > > queNodes;
+	std::priority_queue<std::pair<double, Value>, std::vector<std::pair<double, Value> >,
+						std::greater<std::pair<double, Value> > > queValues;
+
+	double time;
+	if (m_summary.count > 0 && boxSweepTime(box, displacement, m_summary.bounds, time)) {
+		queNodes.push(std::make_pair(time, this));
+	}
+
+	// Values belonging to several nodes are queued by each of them
+	SetValue setReported;
+	while (!queNodes.empty() || !queValues.empty()) {
+
+		// A value is reported once no node left could hold an earlier hit
+		if (queNodes.empty() || (!queValues.empty() && queValues.top().first < queNodes.top().first)) {
+			std::pair<double, Value> hit = queValues.top();
+			queValues.pop();
+			if (!isPointTree && !setReported.insert(hit.second).second) {
+				continue;
+			}
+			if (!onHit(hit.second, hit.first)) {
+				return;
+			}
+			continue;
+		}
+
+		const Node* node = queNodes.top().second;
+		queNodes.pop();
+
+		for (auto&& val : node->m_data) {
+			if (boxSweepTime(box, displacement, predicate.boxOf(val), time)) {
+				queValues.push(std::make_pair(time, val));
+			}
+		}
+
+		for (auto&& region : node->m_mapRegions) {
+			const Node* child = region.second.get();
+			if (child && child->m_summary.count > 0 && boxSweepTime(box, displacement, child->m_summary.bounds, time)) {
+				queNodes.push(std::make_pair(time, child));
+			}
+		}
+	}
+}
+
+// Copy the subtree for a distance join
+template<class Value, class NodeCompare, class Predicate>
+bool SearchTree2D<Value, NodeCompare, Predicate>::Node::buildJoin(JoinNode& join, SetValue* pSeen, const OpContext& ctx) const {
+
+	CountedPredicate predicate(ctx.counts);
+
+	for (auto&& val : m_data) {
+		if (pSeen && !pSeen->insert(val).second) {
+			continue;
+		}
+		NodeCompare box = predicate.boxOf(val);
+		join.valueBounds = join.values.empty() ? box : boxUnion(join.valueBounds, box);
+		join.values.push_back(val);
+		join.boxes.push_back(box);
+	}
+
+	bool hasValues = !join.values.empty();
+	join.bounds = join.valueBounds;
+
+	for (auto&& region : m_mapRegions) {
+		if (!region.second) {
+			continue;
+		}
+		join.children.emplace_back();
+		if (!region.second->buildJoin(join.children.back(), pSeen, ctx)) {
+			join.children.pop_back();
+			continue;
+		}
+		const Box2D<LeafCoord>& childBounds = join.children.back().bounds;
+		join.bounds = hasValues ? boxUnion(join.bounds, childBounds) : childBounds;
+		hasValues = true;
+	}
+	return hasValues;
+}
+
+// Gather the orphaned values of this node and its children
+template<class Value, class NodeCompare, class Predicate>
+void SearchTree2D<Value, NodeCompare, Predicate>::Node::gatherOrphans(PairSweep& sweep) const {
+
+	if (!hasChildren()) {
+		return;
+	}
+
+	sweep.setOrphans.insert(m_data.begin(), m_data.end());
+	for (auto&& region : m_mapRegions) {
+		if (region.second) {
+			region.second->gatherOrphans(sweep);
+		}
+	}
+}
+
+// Sweep each leaf for overlapping pairs
+template<class Value, class NodeCompare, class Predicate>
+template<class OnPair>
+void SearchTree2D<Value, NodeCompare, Predicate>::Node::sweepPairs(PairSweep& sweep, OnPair& onPair, const OpContext& ctx) const {
+
+	if (hasChildren()) {
+		for (auto&& region : m_mapRegions) {
+			if (region.second) {
+				region.second->sweepPairs(sweep, onPair, ctx);
+			}
+		}
+		return;
+	}
+
+	if (m_data.size() < 2) {
+		return;
+	}
 
-		// data belonging to this node (should be empty if this node has children)
-		SetValue m_data;
+	// Sorted leaves already hold their boxes in order. Sort the others into scratch arrays
+	const std::vector<Value>* pValues = &sweep.vecValues;
+	const BoxArray2D<LeafCoord>* pBoxes = &sweep.boxes;
+	if (m_dataIndex) {
+		pValues = &m_dataIndex->values;
+		pBoxes = &m_dataIndex->boxes;
+	}
+	else {
+		CountedPredicate predicate(ctx.counts);
 
-		// Returns true if this node has children
-		bool hasChildren() const;
+		sweep.vecSorted.clear();
+		for (auto&& val : m_data) {
+			sweep.vecSorted.push_back(std::make_pair(predicate.boxOf(val), val));
+		}
+		std::sort(sweep.vecSorted.begin(), sweep.vecSorted.end(),
+			[](const std::pair<NodeCompare, Value>& left, const std::pair<NodeCompare, Value>& right) {
+				return left.first.minX < right.first.minX;
+			});
 
-		// Returns all values belonging to this node and its children
-		SetValue getAllChildValues() const;
+		sweep.vecValues.clear();
+		sweep.boxes.clear();
+		for (auto&& sorted : sweep.vecSorted) {
+			sweep.vecValues.push_back(sorted.second);
+			sweep.boxes.push_back(sorted.first);
+		}
+	}
 
-		// Deletes child nodes
-		void deleteChildren();
+	const std::vector<Value>& vecValues = *pValues;
+	const BoxArray2D<LeafCoord>& boxes = *pBoxes;
+	const NodeCompare& root = sweep.rootRegion;
 
-		// Returns false if this node should be a leaf in the tree
-		bool shouldSubdivide(const SetValue& values, const QuadMap& quads) const;
+	boxOverlapPairs(boxes, [&](std::size_t left, std::size_t right) {
+		const Value& leftVal = vecValues[left];
+		const Value& rightVal = vecValues[right];
 
-		// Sets the search space for this node
-		void setCompare(const NodeCompare& compare);
-	};
+		// Pairs with orphans are found again by the orphan pass, so leave them to it
+		if (!sweep.setOrphans.empty() && (sweep.setOrphans.count(leftVal) || sweep.setOrphans.count(rightVal))) {
+			return;
+		}
 
-	Node m_tree;
-};
+		// Points are held by a single leaf, so every pair is found exactly once
+		if (isPointTree) {
+			onPair(leftVal, rightVal);
+			return;
+		}
 
-// =========================================================
-// Main Tree Implementation
-// =========================================================
-// Destructor
-template<class Value, class NodeCompare, class Predicate>
-SearchTree2D<Value, NodeCompare, Predicate>::~SearchTree2D() {
+		// Min corner of the overlap. Leaves tile the root, so exactly one leaf holds it when it
+		// lies inside the root. Leaves own their min edges and, on the root's edges, their max edges
+		LeafCoord x = std::max(boxes.minX[left], boxes.minX[right]);
+		LeafCoord y = std::max(boxes.minY[left], boxes.minY[right]);
+		if (x < root.minX || root.maxX < x || y < root.minY || root.maxY < y) {
+			if (leftVal < rightVal) {
+				sweep.setDeferred.insert(std::make_pair(leftVal, rightVal));
+			}
+			else {
+				sweep.setDeferred.insert(std::make_pair(rightVal, leftVal));
+			}
+			return;
+		}
 
-	clear();
+		bool ownsX = m_compare.minX <= x && (x < m_compare.maxX || (x == m_compare.maxX && x == root.maxX));
+		bool ownsY = m_compare.minY <= y && (y < m_compare.maxY || (y == m_compare.maxY && y == root.maxY));
+		if (ownsX && ownsY) {
+			onPair(leftVal, rightVal);
+		}
+	});
 }
 
-// Move constructor
+// Empty the summary
 template<class Value, class NodeCompare, class Predicate>
-SearchTree2D<Value, NodeCompare, Predicate>::SearchTree2D(SearchTree2D&& otherTree)
-	: SearchTree2D()
-{
-	swap(*this, otherTree);
-}
+void SearchTree2D<Value, NodeCompare, Predicate>::Node::resetSummary() {
 
-// Assignment operator. Passing other by value handles both lvalue and rvalue references
-// lvalues will be copy contructed and rvalues will be move constructed
-template<class Value, class NodeCompare, class Predicate>
-SearchTree2D<Value, NodeCompare, Predicate>& SearchTree2D<Value, NodeCompare, Predicate>::operator=(SearchTree2D<Value, NodeCompare, Predicate> other) {
-	swap(*this, other);
-	return *this;
+	m_summary.resetTime();
+	m_summary.resetCategories();
+	m_summary.resetPriority();
+	m_summary.resetBounds();
+	m_summary.count = 0;
 }
 
-// Add a value to the tree
+// Add a value to the summary
 template<class Value, class NodeCompare, class Predicate>
-void SearchTree2D<Value, NodeCompare, Predicate>::add(const Value& val) {
+void SearchTree2D<Value, NodeCompare, Predicate>::Node::summarize(const Value& val, CountedPredicate& predicate) {
 
-	m_tree.add(val);
+	summarizeTime(val, predicate, TimeTag());
+	summarizeCategory(val, predicate, CategoryTag());
+	summarizePriority(val, predicate, PriorityTag());
+	summarizeBounds(val, predicate, LeafSortTag());
 }
 
-// Remove a value from the tree
+// Merge a child's summary into ours
 template<class Value, class NodeCompare, class Predicate>
-void SearchTree2D<Value, NodeCompare, Predicate>::remove(const Value& val) {
+void SearchTree2D<Value, NodeCompare, Predicate>::Node::summarize(const Summary& summary) {
 
-	m_tree.remove(val);
+	m_summary.mergeTime(summary);
+	m_summary.mergeCategories(summary);
+	m_summary.mergePriority(summary);
+	m_summary.mergeBounds(summary);
 }
 
-// Clear the tree of all values
+// Rebuild the summary from our values and our children
 template<class Value, class NodeCompare, class Predicate>
-void SearchTree2D<Value, NodeCompare, Predicate>::clear() {
+void SearchTree2D<Value, NodeCompare, Predicate>::Node::updateSummary(const OpContext& ctx) {
 
-	m_tree.clear();
+	CountedPredicate predicate(ctx.counts);
+	resetSummary();
+	for (auto&& val : m_data) {
+		summarize(val, predicate);
+		summarizeCenter(val, 1, ctx, predicate, LeafSortTag());
+	}
+	for (auto&& region : m_mapRegions) {
+		if (region.second) {
+			summarize(region.second->m_summary);
+		}
+	}
+	updateCount();
 }
 
-// Get values belonging to leafs whose search space satisfies the test compare
+// Recount the values below us
 template<class Value, class NodeCompare, class Predicate>
-auto SearchTree2D<Value, NodeCompare, Predicate>::getNearbyValues(const NodeCompare& compare) const -> SetValue {
+void SearchTree2D<Value, NodeCompare, Predicate>::Node::updateCount() {
 
-	return m_tree.getNearbyValues(compare);
+	m_summary.count = m_data.size();
+	for (auto&& region : m_mapRegions) {
+		if (region.second) {
+			m_summary.count += region.second->m_summary.count;
+			m_hasChanges = m_hasChanges || region.second->m_hasChanges;
+		}
+	}
+	m_hasChanges = m_hasChanges || m_isChanged;
 }
 
-// Rebalance our tree
+// Add a value's timestamp to the summary
 template<class Value, class NodeCompare, class Predicate>
-void SearchTree2D<Value, NodeCompare, Predicate>::rebalance() {
-
-	// Build the root search space for our tree
-	m_tree.buildRootRegion();
+void SearchTree2D<Value, NodeCompare, Predicate>::Node::summarizeTime(const Value& val, CountedPredicate& predicate, std::true_type) {
 
-	// Rebalance the tree for the new search space
-	m_tree.rebalance();
+	Time time = predicate.timeOf(val);
+	m_summary.minTime = std::min(m_summary.minTime, time);
+	m_summary.maxTime = std::max(m_summary.maxTime, time);
 }
 
-// =========================================================
-// Node Implementation
-// =========================================================
-// Default Constructor
+// Add a value's categories to the summary
 template<class Value, class NodeCompare, class Predicate>
-SearchTree2D<Value, NodeCompare, Predicate>::Node::Node()
-	: m_compare()
-	, m_mapRegions()
-	, m_data()
-{
-	Predicate predicate;
-	m_compare = predicate.nilCompare();
+void SearchTree2D<Value, NodeCompare, Predicate>::Node::summarizeCategory(const Value& val, CountedPredicate& predicate, std::true_type) {
 
-	// build our child node mapping
-	m_mapRegions[RegionCode::UPPER_LEFT] = nullptr;
-	m_mapRegions[RegionCode::UPPER_RIGHT] = nullptr;
-	m_mapRegions[RegionCode::LOWER_LEFT] = nullptr;
-	m_mapRegions[RegionCode::LOWER_RIGHT] = nullptr;
+	m_summary.categories |= predicate.categoryOf(val);
 }
 
-// Destructor
+// Add a value's priority to the summary
 template<class Value, class NodeCompare, class Predicate>
-SearchTree2D<Value, NodeCompare, Predicate>::Node::~Node() {
+void SearchTree2D<Value, NodeCompare, Predicate>::Node::summarizePriority(const Value& val, CountedPredicate& predicate, std::true_type) {
 
-	clear();
+	m_summary.maxPriority = std::max(m_summary.maxPriority, predicate.priorityOf(val));
 }
 
-// Copy constructor
+// Add a value's box to the summary bounds
 template<class Value, class NodeCompare, class Predicate>
-SearchTree2D<Value, NodeCompare, Predicate>::Node::Node(const Node& other)
-	: m_compare(other.m_compare)
-	, m_mapRegions()
-	, m_data(other.m_data)
-{
-	// build our child node mapping
-	m_mapRegions[RegionCode::UPPER_LEFT] = nullptr;
-	m_mapRegions[RegionCode::UPPER_RIGHT] = nullptr;
-	m_mapRegions[RegionCode::LOWER_LEFT] = nullptr;
-	m_mapRegions[RegionCode::LOWER_RIGHT] = nullptr;
+void SearchTree2D<Value, NodeCompare, Predicate>::Node::summarizeBounds(const Value& val, CountedPredicate& predicate, std::true_type) {
 
-	for (auto&& region : other.m_mapRegions) {
-		if (region.second) {
-			m_mapRegions[region.first] = std::unique_ptr<Node>(new Node(*(region.second)));
-		}
-	}
+	m_summary.bounds = boxUnion(m_summary.bounds, predicate.boxOf(val));
 }
 
-// Add a value to the node
+// Add a value's box center to the centroid sums, and to the owned count if we own it
 template<class Value, class NodeCompare, class Predicate>
-void SearchTree2D<Value, NodeCompare, Predicate>::Node::add(const Value& val) {
-
-	Predicate predicate;
-
-	if (hasChildren()) {
-		bool wasAdded = false;
-		for (auto&& region : m_mapRegions) {
-			// Check children of they should hold the value
-			if (region.second && predicate.satisfies(region.second->m_compare, val)) {
-				region.second->add(val);
-				wasAdded = true;
-			}
-		}
+void SearchTree2D<Value, NodeCompare, Predicate>::Node::summarizeCenter(const Value& val, std::size_t memberships, const OpContext& ctx, CountedPredicate& predicate, std::true_type) {
 
-		if (!wasAdded) {
-			// The new value wasn't added to any children. This means that there is
-			// either a bug in predicate implementation or this is the root node
-			// and the new value belongs outside of the root search space.
-			// Either way, let's hold onto this value as part of this node and let a future
-			// rebalance ensure the child search spaces satisfy this value
-			m_data.insert(val);
-		}
-	}
-	else {
-		m_data.insert(val);
+	NodeCompare box = predicate.boxOf(val);
+	m_summary.sumX += memberships * ((static_cast<double>(box.minX) + box.maxX) / 2);
+	m_summary.sumY += memberships * ((static_cast<double>(box.minY) + box.maxY) / 2);
+	if (ownsCenter(box, ctx)) {
+		++m_summary.ownedCount;
 	}
 }
 
-// Remove a value from the node or its children
+// Test if a value's center is owned by us or our children
 template<class Value, class NodeCompare, class Predicate>
-void SearchTree2D<Value, NodeCompare, Predicate>::Node::remove(const Value& val) {
+bool SearchTree2D<Value, NodeCompare, Predicate>::Node::ownsCenter(const NodeCompare& box, const OpContext& ctx) const {
 
-	if (hasChildren()) {
-		for (auto&& region : m_mapRegions) {
-			if (region.second) {
-				region.second->remove(val);
-			}
-		}
+	if (isPointTree || &m_compare == ctx.root) {
+		return true;
 	}
 
-	m_data.erase(val);
+	// Centers are moved into the root so a value only partly inside of it is owned by a
+	// node it overlaps. Such a node holds it, as do the nodes above it
+	const NodeCompare& root = *ctx.root;
+	double x = std::min(std::max((static_cast<double>(box.minX) + box.maxX) / 2, static_cast<double>(root.minX)), static_cast<double>(root.maxX));
+	double y = std::min(std::max((static_cast<double>(box.minY) + box.maxY) / 2, static_cast<double>(root.minY)), static_cast<double>(root.maxY));
+	return m_compare.minX <= x && (x < m_compare.maxX || (x == m_compare.maxX && !(m_compare.maxX < root.maxX))) &&
+		   m_compare.minY <= y && (y < m_compare.maxY || (y == m_compare.maxY && !(m_compare.maxY < root.maxY)));
 }
 
-// Clear the node and its children of all values
+// Insert a value into this node's data
 template<class Value, class NodeCompare, class Predicate>
-void SearchTree2D<Value, NodeCompare, Predicate>::Node::clear() {
-	if (hasChildren()) {
-		for (auto&& region : m_mapRegions) {
-			if (region.second) {
-				region.second->clear();
-			}
-		}
-		deleteChildren();
+void SearchTree2D<Value, NodeCompare, Predicate>::Node::insertData(const Value& val, const OpContext& ctx) {
+
+	if (!m_data.insert(val).second) {
+		return;
 	}
 
-	m_data.clear();
+	++m_version;
+	markChanged();
+	if (ctx.sortLeaves) {
+		CountedPredicate predicate(ctx.counts);
+		indexValue(val, predicate, LeafSortTag());
+	}
 }
 
-// Get values belonging to child leafs whos search space satisfies the test compare
+// Erase a value from this node's data
 template<class Value, class NodeCompare, class Predicate>
-auto SearchTree2D<Value, NodeCompare, Predicate>::Node::getNearbyValues(const NodeCompare& compare) const -> SetValue {
+void SearchTree2D<Value, NodeCompare, Predicate>::Node::eraseData(const Value& val) {
 
-	// Our return set
-	SetValue nearbyVals;
-	if (hasChildren()) {
-		// Check children and get their values if compare overlaps with the childs's search space
-		for (auto&& region : m_mapRegions) {
-			if (region.second) {
-				SetValue childVals = region.second->getNearbyValues(compare);
-				nearbyVals.insert(childVals.begin(), childVals.end());
-			}
-		}
+	if (m_data.erase(val) == 0) {
+		return;
 	}
 
-	Predicate predicate;
-
-	// Return our values if compare overlaps with our search space
-	// This will also return orphaned values that belong to this node but not its children
-	if (predicate.overlaps(m_compare, compare)) {
+	++m_version;
+	markChanged();
+	if (!m_dataIndex) {
+		return;
+	}
 
-		// std::set guarantees uniqueness (values may belong to more than one node)
-		nearbyVals.insert(m_data.begin(), m_data.end());
+	// The value may have moved since it was indexed, so find it by value rather than by box
+	std::vector<Value>& vecValues = m_dataIndex->values;
+	for (std::size_t i = 0; i < vecValues.size(); ++i) {
+		if (!(vecValues[i] < val) && !(val < vecValues[i])) {
+			vecValues.erase(vecValues.begin() + i);
+			m_dataIndex->boxes.erase(i);
+			break;
+		}
 	}
 
-	return nearbyVals;
+	if (vecValues.empty()) {
+		m_dataIndex.reset();
+	}
 }
 
-// Build a root search space based off of current data
+// Replace this node's data
 template<class Value, class NodeCompare, class Predicate>
-void SearchTree2D<Value, NodeCompare, Predicate>::Node::buildRootRegion() {
+void SearchTree2D<Value, NodeCompare, Predicate>::Node::assignData(const SetValue& values, const OpContext& ctx) {
 
-	Predicate predicate;
+	if (!hasSameData(values)) {
+		markChanged();
+	}
 
-	// Build our search space based off of our data
-	m_compare = predicate.buildRegionFromData(getAllChildValues());
+	m_data = values;
+	++m_version;
+	if (ctx.sortLeaves) {
+		CountedPredicate predicate(ctx.counts);
+		rebuildDataIndex(predicate, LeafSortTag());
+	}
+	else {
+		m_dataIndex.reset();
+	}
 }
 
-// Rebalance this node and its children
+// Clear this node's data
 template<class Value, class NodeCompare, class Predicate>
-void SearchTree2D<Value, NodeCompare, Predicate>::Node::rebalance() {
+void SearchTree2D<Value, NodeCompare, Predicate>::Node::clearData() {
 
-	Predicate predicate;
-
-	SetValue setAllData = getAllChildValues();
-
-	// Remove data that no longer satisfies this node's compare
-	for (SetValue::iterator itSet = setAllData.begin(); itSet != setAllData.end(); ) {
-		if (!predicate.satisfies(m_compare, *itSet)) {
-			setAllData.erase(itSet++);
-		}
-		else {
-			++itSet;
-		}
+	if (!m_data.empty()) {
+		markChanged();
 	}
 
-	// Clear our local set. This set will be reset if necessary and will also
-	// hold onto orphaned values if necessary
 	m_data.clear();
+	m_dataIndex.reset();
+	++m_version;
+}
 
-	if (hasChildren()) {
-		// Should we keep the children?
-		// first just check raw data size
-
-		if (setAllData.size() <= g_minDataSize) {
-			// Our data set is small enough that we don't need children for our search space
-			deleteChildren();
-			m_data = setAllData;
-		}
-		else {
-
-			// Now check if subdividing will do anything
+// Insert a value into the index at its sorted position
+template<class Value, class NodeCompare, class Predicate>
+void SearchTree2D<Value, NodeCompare, Predicate>::Node::indexValue(const Value& val, CountedPredicate& predicate, std::true_type) {
 
-			// Let's update our child quadrants
-			// First grab references to our children's search spaces
-			QuadMap mapQuads;
-			for (auto&& region : m_mapRegions) {
-				mapQuads.insert(QuadPair(region.first, region.second->m_compare));
-			}
+	if (!m_dataIndex) {
+		m_dataIndex = std::unique_ptr<DataIndex>(new DataIndex());
+		m_dataIndex->maxWidth = 0;
+	}
 
-			// Use our predicate to rebuild our quadrant search spaces
-			predicate.buildQuadrantsFromData(m_compare, setAllData, mapQuads);
+	const NodeCompare box = predicate.boxOf(val);
+	std::vector<LeafCoord>& vecMinX = m_dataIndex->boxes.minX;
+	std::size_t index = std::upper_bound(vecMinX.begin(), vecMinX.end(), box.minX) - vecMinX.begin();
 
-			// Do we still need children?
-			if (shouldSubdivide(setAllData, mapQuads)) {
+	m_dataIndex->values.insert(m_dataIndex->values.begin() + index, val);
+	m_dataIndex->boxes.insert(index, box);
+	m_dataIndex->maxWidth = std::max(m_dataIndex->maxWidth, boxExtent(box.minX, box.maxX));
+}
 
-				// Re-add our data to our children
-				for (auto thisVal : setAllData) {
-					// This may modify m_data of the value is orphaned
-					add(thisVal);
-				}
+// Sort m_data by min x into a new index
+template<class Value, class NodeCompare, class Predicate>
+void SearchTree2D<Value, NodeCompare, Predicate>::Node::rebuildDataIndex(CountedPredicate& predicate, std::true_type) {
 
-				// rebalance our child nodes
-				for (auto&& region : m_mapRegions) {
-					if (region.second) {
-						region.second->rebalance();
-					}
-				}
-			}
-			else {
-				// We no longer need children. Just hold onto the data ourselves
-				deleteChildren();
-				m_data = setAllData;
-			}
-		}
+	m_dataIndex.reset();
+	if (m_data.empty()) {
+		return;
 	}
-	// Should we subdivide and create children?
-	else {
-		// check raw data size
-		if (setAllData.size() <= g_minDataSize) {
-			// The data set is small enough that we don't need to create children
-			m_data = setAllData;
-		}
-		else {
-
-			// Let's build some test quads and see if they will subdivide
 
-			NodeCompare ulComp = predicate.nilCompare();
-			NodeCompare urComp = predicate.nilCompare();
-			NodeCompare llComp = predicate.nilCompare();
-			NodeCompare lrComp = predicate.nilCompare();
-
-			QuadMap mapQuads;
-			mapQuads.insert(QuadPair(RegionCode::UPPER_LEFT, ulComp));
-			mapQuads.insert(QuadPair(RegionCode::UPPER_RIGHT, urComp));
-			mapQuads.insert(QuadPair(RegionCode::LOWER_LEFT, llComp));
-			mapQuads.insert(QuadPair(RegionCode::LOWER_RIGHT, lrComp));
-
-			// Build our test quads from our data
-			predicate.buildQuadrantsFromData(m_compare, setAllData, mapQuads);
+	std::vector<std::pair<NodeCompare, Value> > vecSorted;
+	vecSorted.reserve(m_data.size());
+	for (auto&& val : m_data) {
+		vecSorted.push_back(std::make_pair(predicate.boxOf(val), val));
+	}
+	std::stable_sort(vecSorted.begin(), vecSorted.end(),
+		[](const std::pair<NodeCompare, Value>& left, const std::pair<NodeCompare, Value>& right) {
+			return left.first.minX < right.first.minX;
+		});
 
-			// Do we need children?
-			if (shouldSubdivide(setAllData, mapQuads)) {
+	m_dataIndex = std::unique_ptr<DataIndex>(new DataIndex());
+	m_dataIndex->maxWidth = 0;
+	m_dataIndex->values.reserve(vecSorted.size());
+	m_dataIndex->boxes.reserve(vecSorted.size());
+	for (auto&& sorted : vecSorted) {
+		m_dataIndex->values.push_back(sorted.second);
+		m_dataIndex->boxes.push_back(sorted.first);
+		m_dataIndex->maxWidth = std::max(m_dataIndex->maxWidth, boxExtent(sorted.first.minX, sorted.first.maxX));
+	}
+}
 
-				// We need children, so build some child nodes and set their search spaces
-				for (auto& region : m_mapRegions) {
-					if (!region.second) {
-						region.second = std::unique_ptr<Node>(new Node());
-					}
-					region.second->setCompare(mapQuads.at(region.first));
-				}
+// Sweep the slice of the index that can overlap compare
+template<class Value, class NodeCompare, class Predicate>
+template<class Output>
+void SearchTree2D<Value, NodeCompare, Predicate>::Node::appendIndexedValues(const NodeCompare& compare, Output& out, std::true_type) const {
 
-				// Add the values to our children
-				for (auto&& thisVal : setAllData) {
-					// This may modify m_data of the value is orphaned
-					add(thisVal);
-				}
+	const BoxArray2D<LeafCoord>& boxes = m_dataIndex->boxes;
 
-				// Rebalance our newly created children so they may create
-				// children of their own
-				for (auto&& region : m_mapRegions) {
-					if (region.second) {
-						region.second->rebalance();
-					}
-				}
-			}
-			else {
+	// Boxes starting right of the query can't reach it, and neither can boxes starting
+	// further left of it than the widest box in the index
+	std::size_t end = std::upper_bound(boxes.minX.begin(), boxes.minX.end(), compare.maxX) - boxes.minX.begin();
+	std::size_t begin = std::lower_bound(boxes.minX.begin(), boxes.minX.begin() + end,
+										 boxSaturatingSub(compare.minX, m_dataIndex->maxWidth)) - boxes.minX.begin();
+	if (begin >= end) {
+		return;
+	}
 
-				// We don't need children
-				m_data = setAllData;
-			}
-		}
+	std::vector<std::size_t> vecHits(end - begin);
+	std::size_t hitCount = boxOverlapBatch(compare, boxes.minX.data(), boxes.minY.data(), boxes.maxX.data(), boxes.maxY.data(),
+										   begin, end, vecHits.data());
+	for (std::size_t i = 0; i < hitCount; ++i) {
+		appendValue(out, m_dataIndex->values[vecHits[i]]);
 	}
 }
 
@@ -584,6 +4038,7 @@ void SearchTree2D<Value, NodeCompare, Predicate>::Node::deleteChildren() {
 	for (auto& region : m_mapRegions) {
 		if (region.second) {
 			region.second.reset(nullptr);
+			markChanged();
 		}
 	}
 }
@@ -592,10 +4047,11 @@ void SearchTree2D<Value, NodeCompare, Predicate>::Node::deleteChildren() {
 template<class Value, class NodeCompare, class Predicate>
 bool SearchTree2D<Value, NodeCompare, Predicate>::Node::shouldSubdivide(
 	const SearchTree2D<Value, NodeCompare, Predicate>::SetValue& vecVals, 
-	const QuadMap& mapQuads) const
+	const QuadMap& mapQuads,
+	const OpContext& ctx) const
 {
 
-	Predicate predicate; 
+	CountedPredicate predicate(ctx.counts);
 
 	// Is there a value that doesn't satisfy all regions?
 	// If not, then all children will have the same values, so there is no need to subdivide
@@ -618,10 +4074,48 @@ bool SearchTree2D<Value, NodeCompare, Predicate>::Node::shouldSubdivide(
 	return !inAllRegions;
 }
 
+// Mark this node changed
+template<class Value, class NodeCompare, class Predicate>
+void SearchTree2D<Value, NodeCompare, Predicate>::Node::markChanged() {
+	m_isChanged = true;
+	m_hasChanges = true;
+}
+
+// Compare this node's data to a set of values
+template<class Value, class NodeCompare, class Predicate>
+bool SearchTree2D<Value, NodeCompare, Predicate>::Node::hasSameData(const SetValue& values) const {
+	return m_data.size() == values.size() &&
+		   std::equal(m_data.begin(), m_data.end(), values.begin(), [](const Value& left, const Value& right) {
+			   return !(left < right) && !(right < left);
+		   });
+}
+
+// Digest the boxes of this node's data, FNV-1a over their coordinates
+template<class Value, class NodeCompare, class Predicate>
+std::uint64_t SearchTree2D<Value, NodeCompare, Predicate>::Node::digestBoxes(CountedPredicate& predicate, std::true_type) const {
+
+	std::uint64_t digest = 14695981039346656037ull;
+	for (auto&& val : m_data) {
+		NodeCompare box = predicate.boxOf(val);
+		const LeafCoord coords[4] = { box.minX, box.minY, box.maxX, box.maxY };
+		const unsigned char* bytes = reinterpret_cast<const unsigned char*>(coords);
+		for (std::size_t i = 0; i < sizeof(coords); ++i) {
+			digest = (digest ^ bytes[i]) * 1099511628211ull;
+		}
+	}
+	return digest;
+}
+
 // Set the search space for this node
 template<class Value, class NodeCompare, class Predicate>
 void SearchTree2D<Value, NodeCompare, Predicate>::Node::setCompare(const NodeCompare& compare) {
+	if (!isSameCompare(m_compare, compare, EqualityTag())) {
+		markChanged();
+	}
 	m_compare = compare;
 }
 
-#endif
\ No newline at end of file
+// The frozen tree needs the complete SearchTree2D, so it is included last
+#include "frozenSearchTree2D.h"
+
+#endif
@@ -0,0 +1,367 @@
+/*
+
+	- Change log for writing to the generic 2D search tree during a rebalance
+
+	Usage:
+	LoggedSearchTree2D<Value, NodeCompare, Predicate> wraps a SearchTree2D for scenes that
+	rebalance on a background thread (see the example's m_treeThread). add and remove never
+	wait: every change is appended to a lock-free log, and whichever thread holds the tree
+	applies the log in order. While a rebalance is running the rebalancing thread holds the
+	tree and applies the changes logged during it as soon as the new structure is in place.
+
+		// gameplay thread, any time
+		tree.add(sprite);
+
+		// background thread
+		tree.rebalance();
+
+		// gameplay thread, once the rebalance thread has been waited on
+		tree.applyPendingChanges();
+		std::set<Sprite*> setNear = tree.tree().getNearbyValues(box);
+
+	Changes are applied by a thread that finds the tree free, so a change made while another
+	write or a rebalance holds the tree is applied by that thread before it lets go, by a later
+	write, or by applyPendingChanges. Queries are not logged and must not run while a rebalance
+	is running, as with the tree itself.
+*/
+
+#ifndef __SEARCH_TREE_CHANGE_LOG_H_
+#define __SEARCH_TREE_CHANGE_LOG_H_
+
+#include <atomic>
+#include <mutex>
+#include <memory>
+#include <new>
+#include <limits>
+#include <type_traits>
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+
+#include "searchTree2D.h"
+
+// Most logged changes a single add or remove applies
+const std::size_t g_maxChangesPerWrite = 64;
+
+//=======================================
+// Change Log
+//=======================================
+
+// Multiple producer, single consumer queue of tree changes. Every change takes a ticket, then
+// producers claim a slot of a ring buffer with a compare and swap and publish it by bumping the
+// slot's sequence number, so pushing doesn't allocate. Changes that find the ring full go to an
+// overflow list. The consumer merges the ring and the overflowed changes by ticket, so a change
+// is never replayed before one whose push had finished when it was logged
+template<class Value>
+class SearchTreeChangeLog {
+public:
+
+	enum class Op {
+		ADD,
+		REMOVE
+	};
+
+	// capacity is rounded up to a power of two
+	explicit SearchTreeChangeLog(std::size_t capacity = 1024)
+		: m_mask(0)
+		, m_slots()
+		, m_enqueuePos(0)
+		, m_dequeuePos(0)
+		, m_nextTicket(0)
+		, m_overflow(nullptr)
+		, m_vecTaken()
+		, m_takenCount(0)
+		, m_size(0)
+	{
+		std::size_t slotCount = 1;
+		while (slotCount < capacity) {
+			slotCount *= 2;
+		}
+		m_mask = slotCount - 1;
+		m_slots.reset(new Slot[slotCount]);
+		for (std::size_t i = 0; i < slotCount; ++i) {
+			m_slots[i].sequence.store(i, std::memory_order_relaxed);
+		}
+	}
+
+	~SearchTreeChangeLog() {
+		consume([](Op, const Value&) {});
+	}
+
+	SearchTreeChangeLog(const SearchTreeChangeLog&) = delete;
+	SearchTreeChangeLog& operator=(const SearchTreeChangeLog&) = delete;
+
+	// Appends a change. Safe to call from any number of threads
+	void push(Op op, const Value& val) {
+
+		m_size.fetch_add(1);
+
+		// The ticket is taken before a slot is claimed, so ring order agrees with ticket order
+		// for changes that follow each other
+		std::uint64_t ticket = m_nextTicket.fetch_add(1);
+		if (!tryPushSlot(op, val, ticket)) {
+			Entry* entry = new Entry(op, val, ticket);
+			entry->next = m_overflow.load();
+			while (!m_overflow.compare_exchange_weak(entry->next, entry)) {
+			}
+		}
+	}
+
+	// Returns true if no changes are waiting
+	bool empty() const {
+		return m_size.load() == 0;
+	}
+
+	// Returns true if the oldest waiting change can be consumed. A change is waiting but not
+	// ready while its producer is still writing it
+	bool hasReadyChanges() const {
+
+		std::size_t pos = m_dequeuePos.load();
+		if (m_slots[pos & m_mask].sequence.load() == pos + 1) {
+			return true;
+		}
+		return m_enqueuePos.load() == pos && (m_takenCount.load() > 0 || m_overflow.load() != nullptr);
+	}
+
+	// Calls apply(op, val) for up to maxCount ready changes, oldest first, and returns the
+	// number applied. Only one thread may consume at a time
+	template<class Apply>
+	std::size_t consume(Apply apply, std::size_t maxCount = std::numeric_limits<std::size_t>::max()) {
+
+		std::size_t applied = 0;
+		std::size_t pos = m_dequeuePos.load();
+		while (applied < maxCount) {
+
+			// A change that overflowed before a ready slot was published is in the overflow
+			// list by the time it's checked, so it's merged before the slot is compared
+			Slot& slot = m_slots[pos & m_mask];
+			bool isSlotReady = slot.sequence.load() == pos + 1;
+			takeOverflow();
+			Entry* entry = m_vecTaken.empty() ? nullptr : m_vecTaken.back();
+
+			if (isSlotReady && (!entry || slot.ticket < entry->ticket)) {
+				Value* pVal = reinterpret_cast<Value*>(&slot.storage);
+				apply(slot.op, *pVal);
+				pVal->~Value();
+				slot.sequence.store(pos + m_mask + 1);
+				m_dequeuePos.store(++pos);
+			}
+			// A claimed slot that isn't written yet may hold an older change, so overflowed
+			// changes wait for it unless the ring has nothing claimed
+			else if (entry && (isSlotReady || m_enqueuePos.load() == pos)) {
+				m_vecTaken.pop_back();
+				m_takenCount.store(m_vecTaken.size());
+				apply(entry->op, entry->val);
+				delete entry;
+			}
+			else {
+				break;
+			}
+			m_size.fetch_sub(1);
+			++applied;
+		}
+		return applied;
+	}
+
+private:
+
+	struct Slot {
+		// pos + 1 once the change claimed at pos is written, pos + capacity once it's consumed
+		std::atomic<std::size_t> sequence;
+		Op op;
+		std::uint64_t ticket;
+		typename std::aligned_storage<sizeof(Value), alignof(Value)>::type storage;
+	};
+
+	struct Entry {
+		Entry(Op entryOp, const Value& entryVal, std::uint64_t entryTicket)
+			: op(entryOp)
+			, val(entryVal)
+			, ticket(entryTicket)
+			, next(nullptr)
+		{
+		}
+
+		Op op;
+		Value val;
+		std::uint64_t ticket;
+		Entry* next;
+	};
+
+	// Writes a change to the next free slot. Returns false if the ring is full
+	bool tryPushSlot(Op op, const Value& val, std::uint64_t ticket) {
+
+		std::size_t pos = m_enqueuePos.load();
+		for (;;) {
+			Slot& slot = m_slots[pos & m_mask];
+			std::size_t sequence = slot.sequence.load();
+			if (sequence == pos) {
+				if (m_enqueuePos.compare_exchange_weak(pos, pos + 1)) {
+					slot.op = op;
+					slot.ticket = ticket;
+					new (&slot.storage) Value(val);
+					slot.sequence.store(pos + 1);
+					return true;
+				}
+			}
+			else if (sequence < pos) {
+				return false;
+			}
+			else {
+				pos = m_enqueuePos.load();
+			}
+		}
+	}
+
+	// Moves the overflow list into the taken changes, which are kept newest ticket first
+	void takeOverflow() {
+
+		Entry* entry = m_overflow.exchange(nullptr);
+		if (!entry) {
+			return;
+		}
+		auto isNewer = [](const Entry* left, const Entry* right) {
+			return left->ticket > right->ticket;
+		};
+
+		// Sort the new changes on their own, then merge them with the ones still waiting
+		std::size_t waiting = m_vecTaken.size();
+		for (; entry; entry = entry->next) {
+			m_vecTaken.push_back(entry);
+		}
+		std::sort(m_vecTaken.begin() + waiting, m_vecTaken.end(), isNewer);
+		std::inplace_merge(m_vecTaken.begin(), m_vecTaken.begin() + waiting, m_vecTaken.end(), isNewer);
+		m_takenCount.store(m_vecTaken.size());
+	}
+
+	std::size_t m_mask;
+	std::unique_ptr<Slot[]> m_slots;
+
+	// Next slot to claim and next slot to consume
+	std::atomic<std::size_t> m_enqueuePos;
+	std::atomic<std::size_t> m_dequeuePos;
+
+	// Ticket of the next change logged
+	std::atomic<std::uint64_t> m_nextTicket;
+
+	// Changes logged while the ring was full, newest first
+	std::atomic<Entry*> m_overflow;
+
+	// Overflowed changes taken by the consumer but not yet applied, newest ticket first.
+	// Only the consumer touches the vector, other threads read its size from m_takenCount
+	std::vector<Entry*> m_vecTaken;
+	std::atomic<std::size_t> m_takenCount;
+
+	// Number of changes logged but not yet applied
+	std::atomic<std::size_t> m_size;
+};
+
+//=======================================
+// Logged Tree
+//=======================================
+template<class Value, class NodeCompare, class Predicate>
+class LoggedSearchTree2D {
+public:
+
+	using Tree = SearchTree2D<Value, NodeCompare, Predicate>;
+	using Log = SearchTreeChangeLog<Value>;
+
+	// logCapacity is the number of changes the log holds before it has to allocate
+	explicit LoggedSearchTree2D(std::size_t logCapacity = 1024)
+		: m_tree()
+		, m_log(logCapacity)
+		, m_holder()
+	{
+	}
+
+	LoggedSearchTree2D(const LoggedSearchTree2D&) = delete;
+	LoggedSearchTree2D& operator=(const LoggedSearchTree2D&) = delete;
+
+	// Inserts a value into the tree, or logs it if the tree is held by another thread
+	void add(const Value& val) {
+		m_log.push(Log::Op::ADD, val);
+		applyChanges(g_maxChangesPerWrite);
+	}
+
+	// Removes a value from the tree, or logs it if the tree is held by another thread
+	void remove(const Value& val) {
+		m_log.push(Log::Op::REMOVE, val);
+		applyChanges(g_maxChangesPerWrite);
+	}
+
+	// Applies logged changes if no other thread holds the tree. Never waits.
+	// Returns the number of changes applied
+	std::size_t applyPendingChanges() {
+		return applyChanges(std::numeric_limits<std::size_t>::max());
+	}
+
+	// Rebalances the tree, then applies the changes logged while it ran.
+	// Waits only for a write already applying changes to finish
+	RebalanceProfile rebalance() {
+
+		m_holder.lock();
+		drainLog(std::numeric_limits<std::size_t>::max());
+		RebalanceProfile profile = m_tree.rebalance();
+		drainLog(std::numeric_limits<std::size_t>::max());
+		m_holder.unlock();
+
+		applyPendingChanges();
+		return profile;
+	}
+
+	// Returns true if changes are waiting to be applied
+	bool hasPendingChanges() const {
+		return !m_log.empty();
+	}
+
+	// Returns the underlying tree, i.e. for queries. Only use it while no other thread
+	// is writing or rebalancing
+	const Tree& tree() const {
+		return m_tree;
+	}
+
+	Tree& tree() {
+		return m_tree;
+	}
+
+private:
+
+	// Applies up to maxChanges logged changes while no other thread holds the tree
+	std::size_t applyChanges(std::size_t maxChanges) {
+
+		std::size_t applied = 0;
+
+		// A change logged just before the holder let go is picked up by the next pass. A pass
+		// that applies nothing is waiting on a producer, which applies changes once it's done
+		while (applied < maxChanges && m_log.hasReadyChanges() && m_holder.try_lock()) {
+			std::size_t drained = drainLog(maxChanges - applied);
+			m_holder.unlock();
+			if (drained == 0) {
+				break;
+			}
+			applied += drained;
+		}
+		return applied;
+	}
+
+	// Applies up to maxChanges of the log to the tree. The tree must be held
+	std::size_t drainLog(std::size_t maxChanges) {
+		return m_log.consume([this](typename Log::Op op, const Value& val) {
+			if (op == Log::Op::ADD) {
+				m_tree.add(val);
+			}
+			else {
+				m_tree.remove(val);
+			}
+		}, maxChanges);
+	}
+
+	Tree m_tree;
+	Log m_log;
+
+	// held while a thread is applying changes or rebalancing
+	std::mutex m_holder;
+};
+
+#endif
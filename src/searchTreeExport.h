@@ -0,0 +1,262 @@
+/*
+
+	- Spatial structure export for the generic 2D search tree
+
+	Usage:
+	Build a TreeLayout from a tree, then write it out as a density raster (PGM/PPM)
+	or as an SVG of node rectangles. The tree knows nothing about the geometry of
+	NodeCompare, so buildTreeLayout takes a functor that returns the LayoutRect of a
+	node's search space. i.e. for a Collider:
+
+		TreeLayout layout = buildTreeLayout(tree, [](const orc::Collider& c) {
+			return LayoutRect{ c.getPos().x, c.getPos().y,
+							   c.getPos().x + c.getScale().x, c.getPos().y + c.getScale().y };
+		});
+		std::ofstream svg("tree.svg");
+		writeLayoutSVG(svg, layout);
+
+	Rasters and SVGs use the tree's coordinate system with y increasing downwards.
+*/
+
+#ifndef __SEARCH_TREE_EXPORT_H_
+#define __SEARCH_TREE_EXPORT_H_
+
+#include <vector>
+#include <set>
+#include <ostream>
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+
+// Axis aligned bounds of a node's search space
+struct LayoutRect {
+	double minX;
+	double minY;
+	double maxX;
+	double maxY;
+};
+
+// Exported description of a single node
+struct NodeLayout {
+	LayoutRect bounds;
+
+	// depth below the root. The root is depth 0
+	std::size_t depth;
+
+	// Number of values held by the node itself. Orphaned values for nodes with children
+	std::size_t valueCount;
+
+	// Number of values held by the node and all of its children. Values belonging
+	// to more than one node are counted once per node
+	std::size_t subtreeValueCount;
+
+	bool isLeaf;
+};
+
+// Exported description of a whole tree
+struct TreeLayout {
+	// All nodes, parents before children. nodes[0] is the root
+	std::vector<NodeLayout> nodes;
+
+	std::size_t leafCount = 0;
+	std::size_t maxDepth = 0;
+
+	// Number of (node, value) pairs in the tree
+	std::size_t memberships = 0;
+
+	// Number of unique values in the tree
+	std::size_t distinctValues = 0;
+
+	// Average number of nodes holding each value. 1 means no value is duplicated
+	double duplicationFactor = 0;
+};
+
+// Builds a layout of the tree's nodes
+// inputs:
+//		tree - tree to export
+//		boundsOf - functor returning the LayoutRect of a NodeCompare
+template<class Tree, class BoundsOf>
+TreeLayout buildTreeLayout(const Tree& tree, BoundsOf boundsOf) {
+
+	TreeLayout layout;
+	typename Tree::SetValue setDistinct;
+
+	// Index of each node's parent so subtree counts can be accumulated afterwards
+	std::vector<std::size_t> vecParents;
+	std::vector<std::size_t> vecPath;
+
+	tree.visitNodes([&](const typename Tree::NodeVisit& node) {
+
+		vecPath.resize(node.depth);
+
+		NodeLayout nodeLayout;
+		nodeLayout.bounds = boundsOf(node.compare);
+		nodeLayout.depth = node.depth;
+		nodeLayout.valueCount = node.values.size();
+		nodeLayout.subtreeValueCount = node.values.size();
+		nodeLayout.isLeaf = node.isLeaf;
+
+		vecParents.push_back(vecPath.empty() ? layout.nodes.size() : vecPath.back());
+		vecPath.push_back(layout.nodes.size());
+		layout.nodes.push_back(nodeLayout);
+
+		if (node.isLeaf) {
+			++layout.leafCount;
+		}
+		layout.maxDepth = std::max(layout.maxDepth, node.depth);
+		layout.memberships += node.values.size();
+		setDistinct.insert(node.values.begin(), node.values.end());
+
+		return true;
+	});
+
+	// Children always follow their parents, so walking backwards accumulates bottom up
+	for (std::size_t i = layout.nodes.size(); i-- > 1; ) {
+		layout.nodes[vecParents[i]].subtreeValueCount += layout.nodes[i].subtreeValueCount;
+	}
+
+	layout.distinctValues = setDistinct.size();
+	if (layout.distinctValues > 0) {
+		layout.duplicationFactor = static_cast<double>(layout.memberships) / layout.distinctValues;
+	}
+
+	return layout;
+}
+
+// Rasterizes value density (values per unit area) over the root bounds.
+// Returns width * height densities in row major order with row 0 at minY
+inline std::vector<double> rasterizeDensity(const TreeLayout& layout, std::size_t width, std::size_t height) {
+
+	std::vector<double> vecDensity(width * height, 0.0);
+	if (layout.nodes.empty() || width == 0 || height == 0) {
+		return vecDensity;
+	}
+
+	const LayoutRect& root = layout.nodes[0].bounds;
+	double cellW = (root.maxX - root.minX) / width;
+	double cellH = (root.maxY - root.minY) / height;
+	if (cellW <= 0 || cellH <= 0) {
+		return vecDensity;
+	}
+
+	// Clamp a world coordinate to a cell index
+	auto toCell = [](double offset, double cellSize, std::size_t cells) {
+		double cell = std::floor(offset / cellSize);
+		return static_cast<std::size_t>(std::min(std::max(cell, 0.0), static_cast<double>(cells - 1)));
+	};
+
+	// Max edges are half open, so a node ending on a cell boundary stops at the cell before it
+	auto toLastCell = [](double offset, double cellSize, std::size_t cells, std::size_t firstCell) {
+		double cell = std::ceil(offset / cellSize) - 1;
+		return static_cast<std::size_t>(std::min(std::max(cell, static_cast<double>(firstCell)), static_cast<double>(cells - 1)));
+	};
+
+	for (auto&& node : layout.nodes) {
+		if (node.valueCount == 0) {
+			continue;
+		}
+
+		// Degenerate nodes spread their values over at least one cell
+		double area = std::max(node.bounds.maxX - node.bounds.minX, cellW) *
+					  std::max(node.bounds.maxY - node.bounds.minY, cellH);
+		double density = node.valueCount / area;
+
+		std::size_t x0 = toCell(node.bounds.minX - root.minX, cellW, width);
+		std::size_t x1 = toLastCell(node.bounds.maxX - root.minX, cellW, width, x0);
+		std::size_t y0 = toCell(node.bounds.minY - root.minY, cellH, height);
+		std::size_t y1 = toLastCell(node.bounds.maxY - root.minY, cellH, height, y0);
+
+		for (std::size_t y = y0; y <= y1; ++y) {
+			for (std::size_t x = x0; x <= x1; ++x) {
+				vecDensity[y * width + x] += density;
+			}
+		}
+	}
+
+	return vecDensity;
+}
+
+// Writes value density as a binary greyscale PGM (P5). Brighter is denser
+inline void writeDensityPGM(std::ostream& out, const TreeLayout& layout, std::size_t width, std::size_t height) {
+
+	std::vector<double> vecDensity = rasterizeDensity(layout, width, height);
+	double maxDensity = vecDensity.empty() ? 0.0 : *std::max_element(vecDensity.begin(), vecDensity.end());
+
+	out << "P5\n" << width << " " << height << "\n255\n";
+	for (double density : vecDensity) {
+		double level = maxDensity > 0 ? density / maxDensity : 0.0;
+		out.put(static_cast<char>(static_cast<unsigned char>(level * 255.0 + 0.5)));
+	}
+}
+
+// Writes value density as a binary PPM (P6) heat map running from black through red to yellow
+inline void writeDensityPPM(std::ostream& out, const TreeLayout& layout, std::size_t width, std::size_t height) {
+
+	std::vector<double> vecDensity = rasterizeDensity(layout, width, height);
+	double maxDensity = vecDensity.empty() ? 0.0 : *std::max_element(vecDensity.begin(), vecDensity.end());
+
+	out << "P6\n" << width << " " << height << "\n255\n";
+	for (double density : vecDensity) {
+		double level = maxDensity > 0 ? density / maxDensity : 0.0;
+		double red = std::min(level * 2.0, 1.0);
+		double green = std::max(level * 2.0 - 1.0, 0.0);
+		out.put(static_cast<char>(static_cast<unsigned char>(red * 255.0 + 0.5)));
+		out.put(static_cast<char>(static_cast<unsigned char>(green * 255.0 + 0.5)));
+		out.put(static_cast<char>(0));
+	}
+}
+
+// Writes every node as an SVG rectangle. Leaves are shaded by density and every
+// node has a tooltip with its depth and value counts
+inline void writeLayoutSVG(std::ostream& out, const TreeLayout& layout) {
+
+	LayoutRect root = { 0, 0, 1, 1 };
+	if (!layout.nodes.empty()) {
+		root = layout.nodes[0].bounds;
+	}
+	double w = std::max(root.maxX - root.minX, 1e-9);
+	double h = std::max(root.maxY - root.minY, 1e-9);
+
+	// Find the densest leaf so shading is relative
+	double maxDensity = 0;
+	for (auto&& node : layout.nodes) {
+		double area = (node.bounds.maxX - node.bounds.minX) * (node.bounds.maxY - node.bounds.minY);
+		if (node.isLeaf && area > 0) {
+			maxDensity = std::max(maxDensity, node.valueCount / area);
+		}
+	}
+
+	std::streamsize oldPrecision = out.precision(10);
+
+	out << "<svg xmlns=\"http://www.w3.org/2000/svg\" viewBox=\""
+		<< root.minX << " " << root.minY << " " << w << " " << h << "\">\n";
+	out << "<!-- nodes " << layout.nodes.size() << " leaves " << layout.leafCount
+		<< " max depth " << layout.maxDepth << " values " << layout.distinctValues
+		<< " duplication " << layout.duplicationFactor << " -->\n";
+
+	// Stroke width in world units so deep nodes remain visible
+	double stroke = std::max(w, h) / 1000.0;
+
+	for (auto&& node : layout.nodes) {
+		double nodeW = node.bounds.maxX - node.bounds.minX;
+		double nodeH = node.bounds.maxY - node.bounds.minY;
+
+		double opacity = 0;
+		if (node.isLeaf && maxDensity > 0 && nodeW * nodeH > 0) {
+			opacity = (node.valueCount / (nodeW * nodeH)) / maxDensity;
+		}
+
+		out << "<rect x=\"" << node.bounds.minX << "\" y=\"" << node.bounds.minY
+			<< "\" width=\"" << nodeW << "\" height=\"" << nodeH
+			<< "\" fill=\"red\" fill-opacity=\"" << opacity
+			<< "\" stroke=\"" << (node.isLeaf ? "black" : "blue")
+			<< "\" stroke-width=\"" << stroke << "\">"
+			<< "<title>depth " << node.depth << " values " << node.valueCount
+			<< " subtree " << node.subtreeValueCount << "</title></rect>\n";
+	}
+
+	out << "</svg>\n";
+	out.precision(oldPrecision);
+}
+
+#endif
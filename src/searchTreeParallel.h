@@ -0,0 +1,72 @@
+/*
+
+	- Thread driver for the batch queries of the generic 2D search tree
+
+	Usage:
+	Batch queries such as SearchTree2D::getAllNearestNeighbors split their work into ranges
+	of independent tasks and hand them to a range runner. The tree itself runs them in order
+	on the calling thread. ParallelRanges spreads them over std::threads instead:
+
+		std::vector<Neighbors> vecNeighbors = tree.getAllNearestNeighbors(k, ParallelRanges());
+
+	Keeping the threads here leaves searchTree2D.h free of <thread>, so programs with their
+	own job system can pass a runner built on it instead.
+*/
+
+#ifndef __SEARCH_TREE_PARALLEL_H_
+#define __SEARCH_TREE_PARALLEL_H_
+
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <algorithm>
+#include <cstddef>
+
+// Range runner calling runRange(first, last) over [0, count) from threadCount threads, or one
+// per hardware thread if 0. The calling thread works too, and the call returns once every task
+// has run. Threads take small ranges from a shared counter, so uneven tasks stay balanced
+class ParallelRanges {
+public:
+
+	explicit ParallelRanges(std::size_t threadCount = 0)
+		: m_threadCount(threadCount)
+	{
+	}
+
+	template<class RunRange>
+	void operator()(std::size_t count, RunRange runRange) const {
+
+		std::size_t threadCount = m_threadCount;
+		if (threadCount == 0) {
+			threadCount = std::max<std::size_t>(1, std::thread::hardware_concurrency());
+		}
+		threadCount = std::min(threadCount, count);
+		if (threadCount <= 1) {
+			runRange(std::size_t(0), count);
+			return;
+		}
+
+		// About 8 ranges per thread keeps the counter quiet and the threads evenly loaded
+		std::size_t rangeSize = std::max<std::size_t>(1, count / (threadCount * 8));
+		std::atomic<std::size_t> next(0);
+		auto runRanges = [&]() {
+			for (std::size_t first = next.fetch_add(rangeSize); first < count; first = next.fetch_add(rangeSize)) {
+				runRange(first, std::min(first + rangeSize, count));
+			}
+		};
+
+		std::vector<std::thread> vecThreads;
+		for (std::size_t i = 1; i < threadCount; ++i) {
+			vecThreads.emplace_back(runRanges);
+		}
+		runRanges();
+		for (auto&& thread : vecThreads) {
+			thread.join();
+		}
+	}
+
+private:
+	std::size_t m_threadCount;
+};
+
+#endif
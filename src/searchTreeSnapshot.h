@@ -0,0 +1,692 @@
+/*
+
+	- Compressed snapshots of the generic 2D search tree
+
+	Usage:
+	writeSnapshot records a tree's nodes and values to a stream, and readSnapshot rebuilds
+	the same nodes from it without rebalancing. Values are stored as an integer id and
+	their box, so the caller converts between values and ids:
+
+		writeSnapshot(out, tree, [](const Entity& e) { return e.id; });
+
+		readSnapshot(in, tree, [](std::uint64_t id, const Box2D<float>& box) {
+			return Entity{ id, box };
+		});
+
+	Requires a predicate with boxOf returning NodeCompare (see SearchTree2D::supportsLeafSorting).
+
+	Format:
+	Nodes are written depth first with children in region order, so leaves follow the
+	Z order (Morton) curve and neighbouring values land close together in the stream.
+	Each node holds its values sorted by quantized min x. Integers are LEB128 varints and
+	signed deltas are zigzag encoded.
+
+		header	"ST2S", format version, coordinate size, precision bits,
+				root search space as raw coordinates
+		node	flags (1 = has children, 2 = search space follows),
+				search space as raw coordinates if flag 2 is set,
+				value count, then per value:
+					id delta from the previous value
+					min x delta from the previous value
+					min y delta from the previous value
+					width and height
+
+	Child search spaces are only written when buildQuadrantsFromData doesn't rebuild them.
+	Value boxes are quantized onto a grid of 2^precisionBits cells per axis over the root,
+	rounding outwards, so a restored box holds the original and is at most one cell larger.
+	Raw coordinates use the host's byte order.
+
+	readSnapshot decodes one node at a time from the stream into the tree, so loading
+	holds no more than one node's values on top of the tree itself.
+
+	Checkpoints:
+	checkpoint writes the same format, except that subtrees with no changes since the
+	previous checkpoint (or readSnapshot) are written as a single node with flag 4 set.
+	Autosaves then grow with the number of changed nodes rather than the size of the world.
+	compactSnapshot folds a checkpoint into the snapshot it follows, producing a full snapshot:
+
+		writeSnapshot(base, tree, idOf);
+		tree.markCheckpoint();					// or write base with checkpoint, which marks the tree
+		...
+		checkpoint(delta, tree, idOf);
+		compactSnapshot<WorldTree>(base, delta, merged);
+*/
+
+#ifndef __SEARCH_TREE_SNAPSHOT_H_
+#define __SEARCH_TREE_SNAPSHOT_H_
+
+#include <vector>
+#include <set>
+#include <map>
+#include <string>
+#include <istream>
+#include <ostream>
+#include <algorithm>
+#include <utility>
+#include <type_traits>
+#include <cmath>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+
+#include "searchTree2D.h"
+#include "box2D.h"
+
+namespace searchTreeSnapshot {
+
+	const char g_magic[4] = { 'S', 'T', '2', 'S' };
+	const std::uint64_t g_formatVersion = 1;
+
+	// Node flags
+	const std::uint64_t g_hasChildren = 1 << 0;
+	const std::uint64_t g_hasCompare = 1 << 1;
+	const std::uint64_t g_isUnchanged = 1 << 2;
+
+	inline void writeVarint(std::string& out, std::uint64_t value) {
+		while (value >= 0x80) {
+			out.push_back(static_cast<char>((value & 0x7F) | 0x80));
+			value >>= 7;
+		}
+		out.push_back(static_cast<char>(value));
+	}
+
+	inline std::uint64_t zigzag(std::int64_t value) {
+		return (static_cast<std::uint64_t>(value) << 1) ^ static_cast<std::uint64_t>(value >> 63);
+	}
+
+	inline std::int64_t unzigzag(std::uint64_t value) {
+		return static_cast<std::int64_t>(value >> 1) ^ -static_cast<std::int64_t>(value & 1);
+	}
+
+	template<class Coord>
+	void writeBox(std::string& out, const Box2D<Coord>& box) {
+		const Coord coords[4] = { box.minX, box.minY, box.maxX, box.maxY };
+		out.append(reinterpret_cast<const char*>(coords), sizeof(coords));
+	}
+
+	// Returns the search spaces the predicate builds for the children of parentRegion,
+	// in region order, when it is given no values
+	template<class Value, class Box, class Predicate>
+	std::vector<Box> buildQuadrants(Predicate& predicate, const Box& parentRegion) {
+
+		std::map<RegionCode, Box> mapQuads;
+		mapQuads[RegionCode::UPPER_LEFT] = parentRegion;
+		mapQuads[RegionCode::UPPER_RIGHT] = parentRegion;
+		mapQuads[RegionCode::LOWER_LEFT] = parentRegion;
+		mapQuads[RegionCode::LOWER_RIGHT] = parentRegion;
+
+		std::map<RegionCode, Box&> mapRefs;
+		for (auto&& quad : mapQuads) {
+			mapRefs.insert(std::pair<RegionCode, Box&>(quad.first, quad.second));
+		}
+		predicate.buildQuadrantsFromData(parentRegion, std::set<Value>(), mapRefs);
+
+		std::vector<Box> vecQuads;
+		for (auto&& quad : mapQuads) {
+			vecQuads.push_back(quad.second);
+		}
+		return vecQuads;
+	}
+
+	// Reads a snapshot from a stream buffer without going through the stream for every byte
+	class Reader {
+	public:
+
+		explicit Reader(std::istream& in)
+			: m_buf(in.rdbuf())
+			, m_failed(m_buf == nullptr)
+		{
+		}
+
+		bool failed() const {
+			return m_failed;
+		}
+
+		// Marks the snapshot as malformed
+		void fail() {
+			m_failed = true;
+		}
+
+		std::uint64_t varint() {
+			std::uint64_t value = 0;
+			for (unsigned shift = 0; shift < 64 && !m_failed; shift += 7) {
+				int byte = m_buf->sbumpc();
+				if (byte == std::char_traits<char>::eof()) {
+					m_failed = true;
+					break;
+				}
+				value |= static_cast<std::uint64_t>(byte & 0x7F) << shift;
+				if (!(byte & 0x80)) {
+					return value;
+				}
+			}
+			m_failed = true;
+			return 0;
+		}
+
+		bool bytes(void* out, std::size_t count) {
+			if (m_failed || m_buf->sgetn(static_cast<char*>(out), count) != static_cast<std::streamsize>(count)) {
+				m_failed = true;
+			}
+			return !m_failed;
+		}
+
+		template<class Coord>
+		Box2D<Coord> box() {
+			Coord coords[4] = {};
+			bytes(coords, sizeof(coords));
+			Box2D<Coord> read = { coords[0], coords[1], coords[2], coords[3] };
+			return read;
+		}
+
+	private:
+		std::streambuf* m_buf;
+		bool m_failed;
+	};
+
+	// Maps coordinates onto the quantization grid over the root and back
+	template<class Coord>
+	class Quantizer {
+	public:
+
+		Quantizer(const Box2D<Coord>& root, unsigned precisionBits)
+			: m_minX(static_cast<double>(root.minX))
+			, m_minY(static_cast<double>(root.minY))
+			, m_stepX(step(root.minX, root.maxX, precisionBits))
+			, m_stepY(step(root.minY, root.maxY, precisionBits))
+		{
+		}
+
+		std::int64_t lowX(Coord x) const { return static_cast<std::int64_t>(std::floor((x - m_minX) / m_stepX)); }
+		std::int64_t lowY(Coord y) const { return static_cast<std::int64_t>(std::floor((y - m_minY) / m_stepY)); }
+		std::int64_t highX(Coord x) const { return static_cast<std::int64_t>(std::ceil((x - m_minX) / m_stepX)); }
+		std::int64_t highY(Coord y) const { return static_cast<std::int64_t>(std::ceil((y - m_minY) / m_stepY)); }
+
+		Box2D<Coord> box(std::int64_t minX, std::int64_t minY, std::int64_t maxX, std::int64_t maxY) const {
+			Box2D<Coord> restored = {
+				low(m_minX + minX * m_stepX), low(m_minY + minY * m_stepY),
+				high(m_minX + maxX * m_stepX), high(m_minY + maxY * m_stepY)
+			};
+			return restored;
+		}
+
+	private:
+
+		static double step(Coord low, Coord high, unsigned precisionBits) {
+			double extent = static_cast<double>(high) - static_cast<double>(low);
+			double cellSize = extent / static_cast<double>(std::uint64_t(1) << precisionBits);
+			return cellSize > 0 ? cellSize : 1.0;
+		}
+
+		// Integer coordinates round outwards so restored boxes never shrink
+		static Coord low(double coord) {
+			return static_cast<Coord>(std::is_integral<Coord>::value ? std::floor(coord) : coord);
+		}
+		static Coord high(double coord) {
+			return static_cast<Coord>(std::is_integral<Coord>::value ? std::ceil(coord) : coord);
+		}
+
+		double m_minX;
+		double m_minY;
+		double m_stepX;
+		double m_stepY;
+	};
+
+	// Quantized box of a value and its id. Nodes store their values sorted by min x
+	struct Quantized {
+		std::int64_t minX;
+		std::int64_t minY;
+		std::int64_t maxX;
+		std::int64_t maxY;
+		std::uint64_t id;
+
+		bool operator<(const Quantized& other) const {
+			return minX < other.minX || (minX == other.minX && id < other.id);
+		}
+	};
+
+	// One node of a snapshot
+	template<class Coord>
+	struct NodeRecord {
+		std::uint64_t flags;
+
+		// Only set if flags has g_hasCompare
+		Box2D<Coord> compare;
+
+		std::vector<Quantized> values;
+	};
+
+	template<class Coord>
+	void writeHeader(std::string& out, const Box2D<Coord>& root, unsigned precisionBits) {
+		out.append(g_magic, sizeof(g_magic));
+		writeVarint(out, g_formatVersion);
+		writeVarint(out, sizeof(Coord));
+		writeVarint(out, precisionBits);
+		writeBox(out, root);
+	}
+
+	// Reads a header written for Coord. Returns false if it isn't one
+	template<class Coord>
+	bool readHeader(Reader& reader, Box2D<Coord>& root, unsigned& precisionBits) {
+		char magic[sizeof(g_magic)];
+		if (!reader.bytes(magic, sizeof(magic)) || std::memcmp(magic, g_magic, sizeof(magic)) != 0 ||
+			reader.varint() != g_formatVersion || reader.varint() != sizeof(Coord)) {
+			reader.fail();
+			return false;
+		}
+
+		precisionBits = static_cast<unsigned>(reader.varint());
+		root = reader.box<Coord>();
+		if (precisionBits == 0 || precisionBits > 32) {
+			reader.fail();
+		}
+		return !reader.failed();
+	}
+
+	// Writes a node. record.values must be sorted
+	template<class Coord>
+	void writeRecord(std::string& out, const NodeRecord<Coord>& record) {
+		writeVarint(out, record.flags);
+		if (record.flags & g_isUnchanged) {
+			return;
+		}
+		if (record.flags & g_hasCompare) {
+			writeBox(out, record.compare);
+		}
+
+		writeVarint(out, record.values.size());
+		Quantized previous = { 0, 0, 0, 0, 0 };
+		for (auto&& quantized : record.values) {
+			writeVarint(out, zigzag(static_cast<std::int64_t>(quantized.id - previous.id)));
+			writeVarint(out, zigzag(quantized.minX - previous.minX));
+			writeVarint(out, zigzag(quantized.minY - previous.minY));
+			writeVarint(out, static_cast<std::uint64_t>(quantized.maxX - quantized.minX));
+			writeVarint(out, static_cast<std::uint64_t>(quantized.maxY - quantized.minY));
+			previous = quantized;
+		}
+	}
+
+	// Reads a node. Returns false if the stream failed
+	template<class Coord>
+	bool readRecord(Reader& reader, NodeRecord<Coord>& record) {
+		record.flags = reader.varint();
+		record.values.clear();
+		if (record.flags & g_isUnchanged) {
+			return !reader.failed();
+		}
+		if (record.flags & g_hasCompare) {
+			record.compare = reader.box<Coord>();
+		}
+
+		std::uint64_t count = reader.varint();
+		Quantized quantized = { 0, 0, 0, 0, 0 };
+		for (std::uint64_t i = 0; i < count && !reader.failed(); ++i) {
+			quantized.id += static_cast<std::uint64_t>(unzigzag(reader.varint()));
+			quantized.minX += unzigzag(reader.varint());
+			quantized.minY += unzigzag(reader.varint());
+			quantized.maxX = quantized.minX + static_cast<std::int64_t>(reader.varint());
+			quantized.maxY = quantized.minY + static_cast<std::int64_t>(reader.varint());
+			record.values.push_back(quantized);
+		}
+		return !reader.failed();
+	}
+
+	// Writes a tree's header and nodes. With onlyChanged, nodes without changes since the
+	// last checkpoint are written as a single g_isUnchanged flag in place of their subtree
+	template<class Value, class NodeCompare, class Predicate, class IdOf>
+	bool writeTree(std::ostream& out, const SearchTree2D<Value, NodeCompare, Predicate>& tree, IdOf& idOf,
+				   unsigned precisionBits, bool onlyChanged) {
+
+		using Tree = SearchTree2D<Value, NodeCompare, Predicate>;
+		using Coord = typename Tree::LeafCoord;
+		using Box = Box2D<Coord>;
+
+		precisionBits = std::min(std::max(precisionBits, 1u), 32u);
+
+		Predicate predicate;
+		Box root = predicate.nilCompare();
+		tree.visitNodes([&](const typename Tree::NodeVisit& node) {
+			root = node.compare;
+			return false;
+		});
+		Quantizer<Coord> quantizer(root, precisionBits);
+
+		std::string buffer;
+		writeHeader(buffer, root, precisionBits);
+
+		// Search spaces the predicate will rebuild for the children of each open node, by depth.
+		// Children come in region order, so each child takes the next one
+		std::vector<std::vector<Box> > vecExpected;
+		std::vector<std::size_t> vecNextChild;
+
+		NodeRecord<Coord> record;
+
+		tree.visitNodes([&](const typename Tree::NodeVisit& node) {
+
+			vecExpected.resize(node.depth);
+			vecNextChild.resize(node.depth);
+
+			bool hasCompare = true;
+			if (node.depth > 0) {
+				std::size_t child = vecNextChild.back()++;
+				const std::vector<Box>& vecQuads = vecExpected.back();
+				hasCompare = child >= vecQuads.size() || !(vecQuads[child] == node.compare);
+			}
+
+			record.values.clear();
+			if (onlyChanged && !node.isChanged) {
+				record.flags = g_isUnchanged;
+				writeRecord(buffer, record);
+				return false;
+			}
+
+			record.flags = (node.isLeaf ? 0 : g_hasChildren) | (hasCompare ? g_hasCompare : 0);
+			record.compare = node.compare;
+			for (auto&& val : node.values) {
+				Box box = predicate.boxOf(val);
+				Quantized quantized = {
+					quantizer.lowX(box.minX), quantizer.lowY(box.minY),
+					quantizer.highX(box.maxX), quantizer.highY(box.maxY),
+					static_cast<std::uint64_t>(idOf(val))
+				};
+				record.values.push_back(quantized);
+			}
+			std::sort(record.values.begin(), record.values.end());
+			writeRecord(buffer, record);
+
+			// Record what the predicate would build for this node's children
+			if (node.isLeaf) {
+				vecExpected.push_back(std::vector<Box>());
+			}
+			else {
+				vecExpected.push_back(buildQuadrants<Value>(predicate, node.compare));
+			}
+			vecNextChild.push_back(0);
+
+			// Flush as we go so the buffer holds about one node
+			if (buffer.size() >= 64 * 1024) {
+				out.write(buffer.data(), buffer.size());
+				buffer.clear();
+			}
+			return true;
+		});
+
+		out.write(buffer.data(), buffer.size());
+		return static_cast<bool>(out);
+	}
+
+	// Merges a checkpoint into the snapshot it was taken against, node by node
+	template<class Coord>
+	class Compactor {
+	public:
+
+		Compactor(std::istream& base, std::istream& delta, std::ostream& out)
+			: m_base(base)
+			, m_delta(delta)
+			, m_out(out)
+			, m_buffer()
+			, m_baseGrid(Box2D<Coord>(), 1)
+			, m_deltaGrid(Box2D<Coord>(), 1)
+			, m_isSameGrid(false)
+		{
+		}
+
+		// Writes the merged snapshot. Returns false if either input is malformed
+		bool compact() {
+			Box2D<Coord> baseRoot, deltaRoot;
+			unsigned baseBits, deltaBits;
+			if (!readHeader(m_base, baseRoot, baseBits) || !readHeader(m_delta, deltaRoot, deltaBits)) {
+				return false;
+			}
+
+			// The merged snapshot uses the checkpoint's grid
+			m_baseGrid = Quantizer<Coord>(baseRoot, baseBits);
+			m_deltaGrid = Quantizer<Coord>(deltaRoot, deltaBits);
+			m_isSameGrid = baseBits == deltaBits && baseRoot == deltaRoot;
+
+			writeHeader(m_buffer, deltaRoot, deltaBits);
+			if (!mergeNode(true)) {
+				return false;
+			}
+
+			m_out.write(m_buffer.data(), m_buffer.size());
+			return static_cast<bool>(m_out);
+		}
+
+	private:
+
+		// Merges the next checkpoint node with the next base node, if hasBase
+		bool mergeNode(bool hasBase) {
+			NodeRecord<Coord> record;
+			if (!readRecord(m_delta, record)) {
+				return false;
+			}
+
+			if (record.flags & g_isUnchanged) {
+				return hasBase && copyNode();
+			}
+
+			NodeRecord<Coord> baseRecord;
+			baseRecord.flags = 0;
+			if (hasBase && !readRecord(m_base, baseRecord)) {
+				return false;
+			}
+			bool hasBaseChildren = hasBase && (baseRecord.flags & g_hasChildren);
+
+			write(record);
+			if (record.flags & g_hasChildren) {
+				for (std::size_t i = 0; i < g_regionCount; ++i) {
+					if (!mergeNode(hasBaseChildren)) {
+						return false;
+					}
+				}
+			}
+			else if (hasBaseChildren) {
+				for (std::size_t i = 0; i < g_regionCount; ++i) {
+					if (!skipNode()) {
+						return false;
+					}
+				}
+			}
+			return true;
+		}
+
+		// Copies the next base node and its subtree onto the checkpoint's grid
+		bool copyNode() {
+			NodeRecord<Coord> record;
+			if (!readRecord(m_base, record) || (record.flags & g_isUnchanged)) {
+				return false;
+			}
+
+			if (!m_isSameGrid) {
+				for (auto&& quantized : record.values) {
+					Box2D<Coord> box = m_baseGrid.box(quantized.minX, quantized.minY, quantized.maxX, quantized.maxY);
+					quantized.minX = m_deltaGrid.lowX(box.minX);
+					quantized.minY = m_deltaGrid.lowY(box.minY);
+					quantized.maxX = m_deltaGrid.highX(box.maxX);
+					quantized.maxY = m_deltaGrid.highY(box.maxY);
+				}
+				std::sort(record.values.begin(), record.values.end());
+			}
+
+			write(record);
+			if (record.flags & g_hasChildren) {
+				for (std::size_t i = 0; i < g_regionCount; ++i) {
+					if (!copyNode()) {
+						return false;
+					}
+				}
+			}
+			return true;
+		}
+
+		// Skips the next base node and its subtree
+		bool skipNode() {
+			NodeRecord<Coord> record;
+			if (!readRecord(m_base, record)) {
+				return false;
+			}
+			if (record.flags & g_hasChildren) {
+				for (std::size_t i = 0; i < g_regionCount; ++i) {
+					if (!skipNode()) {
+						return false;
+					}
+				}
+			}
+			return true;
+		}
+
+		void write(const NodeRecord<Coord>& record) {
+			writeRecord(m_buffer, record);
+			if (m_buffer.size() >= 64 * 1024) {
+				m_out.write(m_buffer.data(), m_buffer.size());
+				m_buffer.clear();
+			}
+		}
+
+		Reader m_base;
+		Reader m_delta;
+		std::ostream& m_out;
+		std::string m_buffer;
+
+		Quantizer<Coord> m_baseGrid;
+		Quantizer<Coord> m_deltaGrid;
+
+		// true if base values can be copied without moving them onto the checkpoint's grid
+		bool m_isSameGrid;
+	};
+}
+
+// Writes tree to out. idOf(const Value&) returns the std::uint64_t id of a value.
+// precisionBits is the number of bits per axis of quantized value boxes, at most 32.
+// The tree isn't marked checkpointed, so call tree.markCheckpoint() if this snapshot
+// starts a chain of checkpoints. Without it the next checkpoint is still correct but
+// also holds the nodes changed before this snapshot. Returns false if the stream failed
+template<class Value, class NodeCompare, class Predicate, class IdOf>
+bool writeSnapshot(std::ostream& out, const SearchTree2D<Value, NodeCompare, Predicate>& tree, IdOf idOf, unsigned precisionBits = 20) {
+
+	static_assert(SearchTree2D<Value, NodeCompare, Predicate>::supportsLeafSorting, "Snapshots require a predicate with boxOf returning NodeCompare");
+
+	return searchTreeSnapshot::writeTree(out, tree, idOf, precisionBits, false);
+}
+
+// Writes the nodes of tree that changed since the last checkpoint (see SearchTree2D::markCheckpoint)
+// to out and marks the tree checkpointed. Unchanged subtrees take one byte each, so the
+// checkpoint grows with the number of changed nodes rather than the size of the tree.
+// Merge checkpoints into a snapshot with compactSnapshot, oldest first.
+// Returns false if the stream failed, leaving the tree unmarked
+template<class Value, class NodeCompare, class Predicate, class IdOf>
+bool checkpoint(std::ostream& out, SearchTree2D<Value, NodeCompare, Predicate>& tree, IdOf idOf, unsigned precisionBits = 20) {
+
+	static_assert(SearchTree2D<Value, NodeCompare, Predicate>::supportsLeafSorting, "Snapshots require a predicate with boxOf returning NodeCompare");
+
+	if (!searchTreeSnapshot::writeTree(out, tree, idOf, precisionBits, true)) {
+		return false;
+	}
+	tree.markCheckpoint();
+	return true;
+}
+
+// Writes the snapshot of base with the checkpoint delta applied to out. delta must be the
+// first checkpoint taken after base was written, or after the snapshot it was compacted into.
+// Tree is the type of the tree both were written from.
+// Returns false if either input is malformed or they don't match
+template<class Tree>
+bool compactSnapshot(std::istream& base, std::istream& delta, std::ostream& out) {
+
+	static_assert(Tree::supportsLeafSorting, "Snapshots require a predicate with boxOf returning NodeCompare");
+
+	searchTreeSnapshot::Compactor<typename Tree::LeafCoord> compactor(base, delta, out);
+	return compactor.compact();
+}
+
+// Replaces tree with the snapshot read from in and marks it checkpointed.
+// makeValue(std::uint64_t id, const Box2D<LeafCoord>& box) returns the value for an id and its
+// restored box. Returns false if the stream is not a snapshot for this tree's coordinate type,
+// is a checkpoint, or ends early, leaving the nodes read so far
+template<class Value, class NodeCompare, class Predicate, class MakeValue>
+bool readSnapshot(std::istream& in, SearchTree2D<Value, NodeCompare, Predicate>& tree, MakeValue makeValue) {
+
+	using namespace searchTreeSnapshot;
+	using Tree = SearchTree2D<Value, NodeCompare, Predicate>;
+	using Coord = typename Tree::LeafCoord;
+	using Box = Box2D<Coord>;
+
+	static_assert(Tree::supportsLeafSorting, "Snapshots require a predicate with boxOf returning NodeCompare");
+
+	Reader reader(in);
+
+	Box root;
+	unsigned precisionBits;
+	if (!readHeader(reader, root, precisionBits)) {
+		return false;
+	}
+	Quantizer<Coord> quantizer(root, precisionBits);
+
+	Predicate predicate;
+
+	// Search spaces for the children of each open node and the next child to read, by depth
+	std::vector<std::vector<Box> > vecExpected;
+	std::vector<std::size_t> vecNextChild;
+
+	// Nodes still to read. A node with children adds its children
+	std::size_t pending = 1;
+
+	NodeRecord<Coord> record;
+
+	bool isRestored = tree.restoreNodes([&](typename Tree::NodeRestore& restored) {
+
+		if (pending == 0 || !readRecord(reader, record)) {
+			return false;
+		}
+		--pending;
+
+		// Checkpoints need the snapshot they were taken against
+		if (record.flags & g_isUnchanged) {
+			reader.fail();
+			return false;
+		}
+
+		// Climb to the deepest node still expecting children
+		while (!vecNextChild.empty() && vecNextChild.back() >= g_regionCount) {
+			vecNextChild.pop_back();
+			vecExpected.pop_back();
+		}
+		restored.depth = vecNextChild.size();
+
+		if (record.flags & g_hasCompare) {
+			restored.compare = record.compare;
+		}
+		else if (restored.depth > 0 && vecNextChild.back() < vecExpected.back().size()) {
+			restored.compare = vecExpected.back()[vecNextChild.back()];
+		}
+		else {
+			reader.fail();
+			return false;
+		}
+		if (restored.depth > 0) {
+			++vecNextChild.back();
+		}
+
+		if (record.flags & g_hasChildren) {
+			pending += g_regionCount;
+			vecExpected.push_back(buildQuadrants<Value>(predicate, restored.compare));
+			vecNextChild.push_back(0);
+		}
+
+		restored.values.clear();
+		for (auto&& quantized : record.values) {
+			restored.values.push_back(makeValue(quantized.id, quantizer.box(quantized.minX, quantized.minY, quantized.maxX, quantized.maxY)));
+		}
+		return true;
+	});
+
+	if (!isRestored || pending != 0 || reader.failed()) {
+		return false;
+	}
+
+	tree.markCheckpoint();
+	return true;
+}
+
+#endif
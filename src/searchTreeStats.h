@@ -0,0 +1,201 @@
+/*
+
+	- Diagnostic structures for the generic 2D search tree
+
+	Profiling and stats are opt-in. When they are disabled the tree never touches
+	a clock or a counter and the structures below are returned empty.
+*/
+
+#ifndef __SEARCH_TREE_STATS_H_
+#define __SEARCH_TREE_STATS_H_
+
+#include <vector>
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+
+//=======================================
+// Predicate Call Counting
+//=======================================
+
+// Number of calls made to each SearchPredicate method
+struct PredicateCallCounts {
+	std::uint64_t nilCompare = 0;
+	std::uint64_t buildRegionFromData = 0;
+	std::uint64_t buildQuadrantsFromData = 0;
+	std::uint64_t satisfies = 0;
+	std::uint64_t overlaps = 0;
+
+	// Calls to the optional point predicate extension quadrantOf
+	std::uint64_t quadrantOf = 0;
+
+	// Calls to the optional growth extension growRegion
+	std::uint64_t growRegion = 0;
+
+	// Calls to the optional query cache extension containsStrictly
+	std::uint64_t containsStrictly = 0;
+
+	// Calls to the optional value extensions boxOf, timeOf, categoryOf and priorityOf
+	std::uint64_t boxOf = 0;
+	std::uint64_t timeOf = 0;
+	std::uint64_t categoryOf = 0;
+	std::uint64_t priorityOf = 0;
+
+	// Returns the number of calls made to all methods
+	std::uint64_t total() const {
+		return nilCompare + buildRegionFromData + buildQuadrantsFromData + satisfies + overlaps + quadrantOf + growRegion + containsStrictly +
+			   boxOf + timeOf + categoryOf + priorityOf;
+	}
+
+	PredicateCallCounts& operator+=(const PredicateCallCounts& other) {
+		nilCompare += other.nilCompare;
+		buildRegionFromData += other.buildRegionFromData;
+		buildQuadrantsFromData += other.buildQuadrantsFromData;
+		satisfies += other.satisfies;
+		overlaps += other.overlaps;
+		quadrantOf += other.quadrantOf;
+		growRegion += other.growRegion;
+		containsStrictly += other.containsStrictly;
+		boxOf += other.boxOf;
+		timeOf += other.timeOf;
+		categoryOf += other.categoryOf;
+		priorityOf += other.priorityOf;
+		return *this;
+	}
+};
+
+// Number of times a tree operation was called and the predicate work it did
+struct OperationStats {
+	std::uint64_t calls = 0;
+	PredicateCallCounts predicateCalls;
+};
+
+// Counters kept by SearchTree2D while stats are enabled
+struct SearchTreeStats {
+	OperationStats add;
+	OperationStats remove;
+	OperationStats query;
+	OperationStats rebalance;
+
+	// Number of times add grew the root to hold a value outside of it
+	std::uint64_t rootGrowths = 0;
+
+	// Returns the predicate calls made by all operations
+	PredicateCallCounts totalPredicateCalls() const {
+		PredicateCallCounts total;
+		total += add.predicateCalls;
+		total += remove.predicateCalls;
+		total += query.predicateCalls;
+		total += rebalance.predicateCalls;
+		return total;
+	}
+};
+
+//=======================================
+// Rebalance Profiling
+//=======================================
+
+// Number of times a phase ran and the total time spent in it
+struct RebalancePhase {
+	std::size_t calls = 0;
+	std::uint64_t nanoseconds = 0;
+};
+
+// Breakdown of rebalance work by phase. Phases are exclusive of each other,
+// so the sum of all phases is the time spent inside the rebalance itself
+struct RebalancePhases {
+	// Building the root search space from the tree's values (root only)
+	RebalancePhase buildRootRegion;
+
+	// Merging child value sets in getAllChildValues
+	RebalancePhase gatherValues;
+
+	// Removing values that no longer satisfy the node's search space
+	RebalancePhase filterValues;
+
+	// Predicate calls to buildQuadrantsFromData
+	RebalancePhase buildQuadrants;
+
+	// Predicate calls made while deciding if a node should subdivide
+	RebalancePhase subdivideTest;
+
+	// Creating and deleting child nodes
+	RebalancePhase allocateNodes;
+
+	// Re-adding values to child nodes
+	RebalancePhase addValues;
+};
+
+// Result of a single call to SearchTree2D::rebalance
+struct RebalanceProfile {
+	// false if profiling was disabled for the call. All other members are zero/empty
+	bool enabled = false;
+
+	// Wall time of the whole rebalance
+	std::uint64_t totalNanoseconds = 0;
+
+	// Number of nodes rebalanced
+	std::size_t nodesVisited = 0;
+
+	// Predicate calls made during the rebalance
+	PredicateCallCounts predicateCalls;
+
+	// Phase breakdown summed over all depths
+	RebalancePhases total;
+
+	// Phase breakdown for each depth level. Index 0 is the root
+	std::vector<RebalancePhases> byDepth;
+
+	// Returns the phase breakdown for a depth, growing the depth list as needed
+	RebalancePhases& atDepth(std::size_t depth) {
+		if (byDepth.size() <= depth) {
+			byDepth.resize(depth + 1);
+		}
+		return byDepth[depth];
+	}
+};
+
+// Times a scope and records it against one phase of a profile.
+// Does nothing if the profile is nullptr
+class RebalancePhaseTimer {
+public:
+
+	using Clock = std::chrono::steady_clock;
+
+	RebalancePhaseTimer(RebalanceProfile* profile, RebalancePhase RebalancePhases::* phase, std::size_t depth)
+		: m_profile(profile)
+		, m_phase(phase)
+		, m_depth(depth)
+		, m_start()
+	{
+		if (m_profile) {
+			m_start = Clock::now();
+		}
+	}
+
+	~RebalancePhaseTimer() {
+		if (m_profile) {
+			std::uint64_t elapsed = static_cast<std::uint64_t>(
+				std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - m_start).count());
+
+			RebalancePhase& depthPhase = m_profile->atDepth(m_depth).*m_phase;
+			++depthPhase.calls;
+			depthPhase.nanoseconds += elapsed;
+
+			RebalancePhase& totalPhase = m_profile->total.*m_phase;
+			++totalPhase.calls;
+			totalPhase.nanoseconds += elapsed;
+		}
+	}
+
+	RebalancePhaseTimer(const RebalancePhaseTimer&) = delete;
+	RebalancePhaseTimer& operator=(const RebalancePhaseTimer&) = delete;
+
+private:
+	RebalanceProfile* m_profile;
+	RebalancePhase RebalancePhases::* m_phase;
+	std::size_t m_depth;
+	Clock::time_point m_start;
+};
+
+#endif
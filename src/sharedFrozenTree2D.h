@@ -0,0 +1,373 @@
+/*
+
+	- Frozen search tree shared between processes through POSIX shared memory
+
+	Usage:
+	One process freezes the static world tree and builds it into a named segment. Any
+	number of processes then attach to the segment read only and query it in place, so
+	the host holds one copy of the tree instead of one per process:
+
+		// builder
+		SharedFrozenTree2D<Id, Box2D<float>, WorldPredicate>::create("/world_tree", tree.freeze());
+
+		// workers
+		SharedFrozenTree2D<Id, Box2D<float>, WorldPredicate> world;
+		if (world.attach("/world_tree")) {
+			std::vector<Id> vecNear;
+			world.getNearbyValues(box, vecNear);
+		}
+
+	The segment holds the frozen tree's arrays after a small header, and the header refers
+	to them by offset from the start of the segment, so it may be mapped at any address.
+	Values and search spaces are copied byte for byte and must be trivially copyable. Values
+	should not hold pointers, i.e. store ids rather than object pointers.
+
+	The segment outlives the processes using it until removed with unlink.
+*/
+
+#ifndef __SHARED_FROZEN_TREE_2D_H_
+#define __SHARED_FROZEN_TREE_2D_H_
+
+#include <vector>
+#include <set>
+#include <string>
+#include <algorithm>
+#include <type_traits>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <atomic>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "frozenSearchTree2D.h"
+
+// Start of a shared tree segment. Offsets are in bytes from the start of the segment
+struct SharedTreeHeader {
+	std::uint32_t magic;
+	std::uint32_t layoutVersion;
+
+	// Sizes of the stored types, checked when attaching
+	std::uint32_t valueSize;
+	std::uint32_t nodeSize;
+	std::uint32_t coordSize;
+
+	std::uint64_t totalBytes;
+
+	std::uint64_t nodeCount;
+	std::uint64_t valueCount;
+	std::uint64_t boxCount;
+	std::uint64_t nodeMaxWidthCount;
+
+	std::uint64_t nodesOffset;
+	std::uint64_t valuesOffset;
+	std::uint64_t minXOffset;
+	std::uint64_t minYOffset;
+	std::uint64_t maxXOffset;
+	std::uint64_t maxYOffset;
+	std::uint64_t nodeMaxWidthOffset;
+};
+
+//=======================================
+// Shared Frozen Tree
+//=======================================
+template<class Value, class NodeCompare, class Predicate>
+class SharedFrozenTree2D {
+public:
+
+	using SetValue = std::set<Value>;
+	using Frozen = FrozenSearchTree2D<Value, NodeCompare, Predicate>;
+	using View = FrozenTreeView<Value, NodeCompare, Predicate>;
+	using Node = typename View::Node;
+	using LeafCoord = typename View::LeafCoord;
+
+	static const bool isPointTree = View::isPointTree;
+
+	static_assert(std::is_trivially_copyable<Value>::value, "Shared trees require trivially copyable values");
+	static_assert(std::is_trivially_copyable<NodeCompare>::value, "Shared trees require a trivially copyable NodeCompare");
+
+	static const std::uint32_t s_magic = 0x32545346;  // "FST2"
+	static const std::uint32_t s_layoutVersion = 1;
+
+	// Not attached to a segment
+	SharedFrozenTree2D()
+		: m_base(nullptr)
+		, m_bytes(0)
+		, m_view()
+	{
+	}
+
+	~SharedFrozenTree2D() {
+		detach();
+	}
+
+	SharedFrozenTree2D(const SharedFrozenTree2D&) = delete;
+	SharedFrozenTree2D& operator=(const SharedFrozenTree2D&) = delete;
+
+	// Builds a copy of tree into a new segment of the given name, unlinking any segment of
+	// that name first. Processes attached to the old segment keep their mapping. Returns false
+	// if the segment could not be created or written, with errno set, i.e. EEXIST if another
+	// process created the name in between, or if the frozen tree is incomplete
+	// (see FrozenSearchTree2D::isComplete)
+	static bool create(const std::string& name, const Frozen& tree);
+
+	// Removes the named segment. Processes already attached keep their mapping
+	static bool unlink(const std::string& name) {
+		return shm_unlink(name.c_str()) == 0;
+	}
+
+	// Maps the named segment read only. Returns false if it does not exist, is still being
+	// built, was built for different types or has arrays or nodes outside of the segment,
+	// leaving this tree detached
+	bool attach(const std::string& name);
+
+	// Unmaps the segment
+	void detach();
+
+	bool isAttached() const {
+		return m_base != nullptr;
+	}
+
+	// Returns all values belonging to nodes whose search spaces overlap (as defined by the predicate)
+	// with the input search space. Empty if detached
+	SetValue getNearbyValues(const NodeCompare& compare) const {
+		SetValue nearbyVals;
+		if (isAttached()) {
+			m_view.getNearbyValues(compare, nearbyVals);
+		}
+		return nearbyVals;
+	}
+
+	// Appends the same values as getNearbyValues to out. Point trees append without
+	// any deduplication. Other trees sort and deduplicate the appended values
+	void getNearbyValues(const NodeCompare& compare, std::vector<Value>& out) const {
+		if (!isAttached()) {
+			return;
+		}
+
+		std::size_t firstNew = out.size();
+		m_view.getNearbyValues(compare, out);
+
+		if (!isPointTree) {
+			searchTreeDetail::sortUnique(out, firstNew);
+		}
+	}
+
+	// Returns a view over the mapped arrays. Invalidated by detach
+	const View& view() const {
+		return m_view;
+	}
+
+	// Bytes of the mapped segment
+	std::size_t mappedBytes() const {
+		return m_bytes;
+	}
+
+private:
+
+	// Rounds an offset up so every array starts on its own cache line
+	static std::uint64_t alignOffset(std::uint64_t offset) {
+		return (offset + 63) & ~std::uint64_t(63);
+	}
+
+	// Places an array of count elements at the end of the layout. Returns its offset
+	template<class T>
+	static std::uint64_t reserveArray(std::uint64_t& end, std::size_t count) {
+		std::uint64_t offset = alignOffset(end);
+		end = offset + count * sizeof(T);
+		return offset;
+	}
+
+	// Returns true if count elements of T at offset are aligned and fit in totalBytes
+	template<class T>
+	static bool fitsArray(std::uint64_t offset, std::uint64_t count, std::uint64_t totalBytes) {
+		return offset % alignof(T) == 0 && offset <= totalBytes && count <= (totalBytes - offset) / sizeof(T);
+	}
+
+	// Returns true if the header's arrays and nodes all lie inside the segment
+	static bool isValidLayout(const SharedTreeHeader& header, const void* base);
+
+	template<class T>
+	static void copyArray(char* base, std::uint64_t offset, const std::vector<T>& vec) {
+		if (!vec.empty()) {
+			std::memcpy(base + offset, vec.data(), vec.size() * sizeof(T));
+		}
+	}
+
+	template<class T>
+	const T* arrayAt(std::uint64_t offset) const {
+		return reinterpret_cast<const T*>(static_cast<const char*>(m_base) + offset);
+	}
+
+	void* m_base;
+	std::size_t m_bytes;
+	View m_view;
+};
+
+// Build a tree into a segment
+template<class Value, class NodeCompare, class Predicate>
+bool SharedFrozenTree2D<Value, NodeCompare, Predicate>::create(const std::string& name, const Frozen& tree) {
+
+	if (!tree.isComplete()) {
+		return false;
+	}
+
+	const BoxArray2D<LeafCoord>& boxes = tree.boxes();
+
+	SharedTreeHeader header;
+	std::memset(&header, 0, sizeof(header));
+	header.layoutVersion = s_layoutVersion;
+	header.valueSize = sizeof(Value);
+	header.nodeSize = sizeof(Node);
+	header.coordSize = sizeof(LeafCoord);
+	header.nodeCount = tree.nodes().size();
+	header.valueCount = tree.values().size();
+	header.boxCount = boxes.minX.size();
+	header.nodeMaxWidthCount = tree.nodeMaxWidths().size();
+
+	std::uint64_t end = sizeof(SharedTreeHeader);
+	header.nodesOffset = reserveArray<Node>(end, header.nodeCount);
+	header.valuesOffset = reserveArray<Value>(end, header.valueCount);
+	header.minXOffset = reserveArray<LeafCoord>(end, header.boxCount);
+	header.minYOffset = reserveArray<LeafCoord>(end, header.boxCount);
+	header.maxXOffset = reserveArray<LeafCoord>(end, header.boxCount);
+	header.maxYOffset = reserveArray<LeafCoord>(end, header.boxCount);
+	header.nodeMaxWidthOffset = reserveArray<LeafCoord>(end, header.nodeMaxWidthCount);
+	header.totalBytes = end;
+
+	// A new segment rather than a truncated one, so attached processes never see it change
+	shm_unlink(name.c_str());
+	int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+	if (fd < 0) {
+		return false;
+	}
+	if (ftruncate(fd, static_cast<off_t>(header.totalBytes)) != 0) {
+		close(fd);
+		shm_unlink(name.c_str());
+		return false;
+	}
+
+	void* mapped = mmap(nullptr, header.totalBytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (mapped == MAP_FAILED) {
+		shm_unlink(name.c_str());
+		return false;
+	}
+
+	// The magic is stored last, so a process attaching while we write rejects the segment
+	char* base = static_cast<char*>(mapped);
+	std::memcpy(base, &header, sizeof(header));
+	copyArray(base, header.nodesOffset, tree.nodes());
+	copyArray(base, header.valuesOffset, tree.values());
+	copyArray(base, header.minXOffset, boxes.minX);
+	copyArray(base, header.minYOffset, boxes.minY);
+	copyArray(base, header.maxXOffset, boxes.maxX);
+	copyArray(base, header.maxYOffset, boxes.maxY);
+	copyArray(base, header.nodeMaxWidthOffset, tree.nodeMaxWidths());
+
+	std::atomic_thread_fence(std::memory_order_release);
+	std::memcpy(base + offsetof(SharedTreeHeader, magic), &s_magic, sizeof(s_magic));
+
+	munmap(mapped, header.totalBytes);
+	return true;
+}
+
+// Map a segment
+template<class Value, class NodeCompare, class Predicate>
+bool SharedFrozenTree2D<Value, NodeCompare, Predicate>::attach(const std::string& name) {
+
+	detach();
+
+	int fd = shm_open(name.c_str(), O_RDONLY, 0);
+	if (fd < 0) {
+		return false;
+	}
+
+	struct stat info;
+	if (fstat(fd, &info) != 0 || static_cast<std::size_t>(info.st_size) < sizeof(SharedTreeHeader)) {
+		close(fd);
+		return false;
+	}
+
+	std::size_t bytes = static_cast<std::size_t>(info.st_size);
+	void* mapped = mmap(nullptr, bytes, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (mapped == MAP_FAILED) {
+		return false;
+	}
+
+	// Reject segments still being built, built by another layout or for other types,
+	// and segments whose arrays don't fit
+	const SharedTreeHeader& header = *static_cast<const SharedTreeHeader*>(mapped);
+	std::uint32_t magic = header.magic;
+	std::atomic_thread_fence(std::memory_order_acquire);
+	if (magic != s_magic || header.layoutVersion != s_layoutVersion || header.valueSize != sizeof(Value) ||
+		header.nodeSize != sizeof(Node) || header.coordSize != sizeof(LeafCoord) || header.totalBytes > bytes ||
+		!isValidLayout(header, mapped)) {
+		munmap(mapped, bytes);
+		return false;
+	}
+
+	m_base = mapped;
+	m_bytes = bytes;
+
+	m_view.nodes = arrayAt<Node>(header.nodesOffset);
+	m_view.nodeCount = header.nodeCount;
+	m_view.values = arrayAt<Value>(header.valuesOffset);
+	m_view.valueCount = header.valueCount;
+	m_view.minX = arrayAt<LeafCoord>(header.minXOffset);
+	m_view.minY = arrayAt<LeafCoord>(header.minYOffset);
+	m_view.maxX = arrayAt<LeafCoord>(header.maxXOffset);
+	m_view.maxY = arrayAt<LeafCoord>(header.maxYOffset);
+	m_view.nodeMaxWidth = arrayAt<LeafCoord>(header.nodeMaxWidthOffset);
+	return true;
+}
+
+// Check a segment's arrays and nodes
+template<class Value, class NodeCompare, class Predicate>
+bool SharedFrozenTree2D<Value, NodeCompare, Predicate>::isValidLayout(const SharedTreeHeader& header, const void* base) {
+
+	std::uint64_t total = header.totalBytes;
+	if (!fitsArray<Node>(header.nodesOffset, header.nodeCount, total) || !fitsArray<Value>(header.valuesOffset, header.valueCount, total)) {
+		return false;
+	}
+
+	// Boxes are parallel to values and widths to nodes
+	if (View::isLeafSorted) {
+		if (header.boxCount != header.valueCount || header.nodeMaxWidthCount != header.nodeCount ||
+			!fitsArray<LeafCoord>(header.minXOffset, header.boxCount, total) || !fitsArray<LeafCoord>(header.minYOffset, header.boxCount, total) ||
+			!fitsArray<LeafCoord>(header.maxXOffset, header.boxCount, total) || !fitsArray<LeafCoord>(header.maxYOffset, header.boxCount, total) ||
+			!fitsArray<LeafCoord>(header.nodeMaxWidthOffset, header.nodeMaxWidthCount, total)) {
+			return false;
+		}
+	}
+
+	// Nodes are breadth first, so children come after their parent
+	const Node* nodes = reinterpret_cast<const Node*>(static_cast<const char*>(base) + header.nodesOffset);
+	for (std::uint64_t i = 0; i < header.nodeCount; ++i) {
+		const Node& node = nodes[i];
+		if ((node.childCount > 0 && node.firstChild <= i) ||
+			std::uint64_t(node.firstChild) + node.childCount > header.nodeCount ||
+			std::uint64_t(node.firstValue) + node.valueCount > header.valueCount) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// Unmap the segment
+template<class Value, class NodeCompare, class Predicate>
+void SharedFrozenTree2D<Value, NodeCompare, Predicate>::detach() {
+
+	if (m_base) {
+		munmap(m_base, m_bytes);
+	}
+	m_base = nullptr;
+	m_bytes = 0;
+	m_view = View();
+}
+
+#endif
@@ -0,0 +1,234 @@
+/*
+
+	- Change log order through the ring buffer and its overflow list
+	- Changes logged at every step of a consume, and a slot claimed but not yet written
+	- Producers logging while another thread consumes
+	- Writers adding and removing while another thread rebalances
+	Run with -fsanitize=thread to check the log for data races
+*/
+
+#include <thread>
+#include <vector>
+#include <atomic>
+#include <limits>
+
+#include "searchTreeChangeLog.h"
+#include "testCommon.h"
+
+using IdLog = SearchTreeChangeLog<int>;
+
+// Changes come back oldest first, whether they went to the ring or overflowed
+void testLogOrder() {
+
+	IdLog log(4);
+	for (int id = 0; id < 20; ++id) {
+		log.push(id % 3 ? IdLog::Op::ADD : IdLog::Op::REMOVE, id);
+	}
+	CHECK(!log.empty());
+
+	std::vector<int> vecIds;
+	auto record = [&](IdLog::Op op, int id) {
+		CHECK((op == IdLog::Op::ADD) == (id % 3 != 0));
+		vecIds.push_back(id);
+	};
+
+	// A capped consume leaves the rest in order
+	CHECK(log.consume(record, 3) == 3);
+	CHECK(log.consume(record, 5) == 5);
+	for (int id = 20; id < 30; ++id) {
+		log.push(id % 3 ? IdLog::Op::ADD : IdLog::Op::REMOVE, id);
+	}
+	CHECK(log.consume(record) == 22);
+	CHECK(log.empty());
+	CHECK(!log.hasReadyChanges());
+
+	bool isOrdered = vecIds.size() == 30;
+	for (std::size_t i = 0; isOrdered && i < vecIds.size(); ++i) {
+		isOrdered = vecIds[i] == static_cast<int>(i);
+	}
+	CHECK(isOrdered);
+}
+
+// The ring empties, refills and overflows while the consumer is between changes. Changes are
+// logged from inside apply, so every interleaving runs the same way each time
+void testInterleavedLog() {
+
+	const int total = 200;
+	for (unsigned pattern = 0; pattern < 100; ++pattern) {
+
+		std::srand(pattern);
+		IdLog log(4);
+		int pushed = 0;
+		auto pushSome = [&]() {
+			for (int count = std::rand() % 8; count > 0 && pushed < total; --count, ++pushed) {
+				log.push(IdLog::Op::ADD, pushed);
+			}
+		};
+
+		std::vector<int> vecIds;
+		pushSome();
+		while (pushed < total || !log.empty()) {
+			std::size_t maxCount = std::rand() % 2 ? 1 + std::rand() % 6 : std::numeric_limits<std::size_t>::max();
+			log.consume([&](IdLog::Op, int id) {
+				vecIds.push_back(id);
+				pushSome();
+			}, maxCount);
+			pushSome();
+		}
+
+		bool isOrdered = vecIds.size() == static_cast<std::size_t>(total);
+		for (std::size_t i = 0; isOrdered && i < vecIds.size(); ++i) {
+			isOrdered = vecIds[i] == static_cast<int>(i);
+		}
+		CHECK(isOrdered);
+	}
+}
+
+// Id whose copy waits for g_releaseCopy, leaving its slot claimed but not yet written
+static const int g_gatedId = 100;
+static std::atomic<bool> g_isCopying(false);
+static std::atomic<bool> g_releaseCopy(false);
+
+struct GatedId {
+	explicit GatedId(int idValue)
+		: id(idValue)
+	{
+	}
+
+	GatedId(const GatedId& other)
+		: id(other.id)
+	{
+		if (id == g_gatedId) {
+			g_isCopying = true;
+			while (!g_releaseCopy.load()) {
+				std::this_thread::yield();
+			}
+		}
+	}
+
+	int id;
+};
+
+// Overflowed changes wait for an older slot that is still being written
+void testUnwrittenSlot() {
+
+	using GatedLog = SearchTreeChangeLog<GatedId>;
+	GatedLog log(4);
+	log.push(GatedLog::Op::ADD, GatedId(0));
+
+	std::thread producer([&log]() {
+		log.push(GatedLog::Op::ADD, GatedId(g_gatedId));
+	});
+	while (!g_isCopying.load()) {
+		std::this_thread::yield();
+	}
+
+	// Two changes fill the ring behind the claimed slot and two overflow
+	for (int id = 1; id < 5; ++id) {
+		log.push(GatedLog::Op::ADD, GatedId(id));
+	}
+
+	std::vector<int> vecIds;
+	auto record = [&](GatedLog::Op, const GatedId& val) {
+		vecIds.push_back(val.id);
+	};
+	CHECK(log.consume(record) == 1);
+	CHECK(!log.hasReadyChanges());
+
+	g_releaseCopy = true;
+	producer.join();
+	CHECK(log.hasReadyChanges());
+	CHECK(log.consume(record) == 5);
+	CHECK(log.empty());
+	CHECK(vecIds == std::vector<int>({ 0, g_gatedId, 1, 2, 3, 4 }));
+}
+
+// Every producer's changes are consumed once and in the order it logged them
+void testConcurrentLog() {
+
+	const int producerCount = 4;
+	const int pushes = 20000;
+	IdLog log(64);
+
+	std::vector<std::thread> vecProducers;
+	for (int producer = 0; producer < producerCount; ++producer) {
+		vecProducers.push_back(std::thread([&log, producer, pushes]() {
+			for (int i = 0; i < pushes; ++i) {
+				log.push(IdLog::Op::ADD, producer * pushes + i);
+			}
+		}));
+	}
+
+	std::vector<int> vecLast(producerCount, -1);
+	int consumed = 0;
+	bool isOrdered = true;
+	while (consumed < producerCount * pushes) {
+		consumed += static_cast<int>(log.consume([&](IdLog::Op, int id) {
+			int producer = id / pushes;
+			isOrdered = isOrdered && id > vecLast[producer];
+			vecLast[producer] = id;
+		}, 100));
+	}
+	for (auto&& producer : vecProducers) {
+		producer.join();
+	}
+
+	CHECK(isOrdered);
+	CHECK(consumed == producerCount * pushes);
+	CHECK(log.empty());
+}
+
+// Changes made during rebalances all reach the tree
+void testLoggedTree() {
+
+	const int writerCount = 4;
+	const std::size_t valuesPerWriter = 3000;
+	std::srand(13);
+	std::vector<TestBox> vecValues = makeTestBoxes(writerCount * valuesPerWriter, 5000, 30);
+
+	LoggedSearchTree2D<TestBox, Box2D<float>, BoxPredicate2D<TestBox, float, TestBoxOf> > tree(128);
+	std::atomic<int> writing(writerCount);
+
+	// Each writer adds its values and removes every other one again
+	std::vector<std::thread> vecWriters;
+	for (int writer = 0; writer < writerCount; ++writer) {
+		vecWriters.push_back(std::thread([&, writer]() {
+			std::size_t first = writer * valuesPerWriter;
+			for (std::size_t i = first; i < first + valuesPerWriter; ++i) {
+				tree.add(vecValues[i]);
+				if (i % 2) {
+					tree.remove(vecValues[i]);
+				}
+			}
+			--writing;
+		}));
+	}
+
+	std::size_t rebalances = 0;
+	while (writing.load() > 0) {
+		tree.rebalance();
+		++rebalances;
+	}
+	for (auto&& writer : vecWriters) {
+		writer.join();
+	}
+	tree.applyPendingChanges();
+	CHECK(!tree.hasPendingChanges());
+
+	std::set<int> setWanted;
+	for (std::size_t i = 0; i < vecValues.size(); i += 2) {
+		setWanted.insert(vecValues[i].id);
+	}
+	Box2D<float> everything = { 0, 0, 6000, 6000 };
+	CHECK(idsOf(tree.tree().getNearbyValues(everything)) == setWanted);
+	CHECK(rebalances > 0);
+}
+
+int main() {
+	testLogOrder();
+	testInterleavedLog();
+	testUnwrittenSlot();
+	testConcurrentLog();
+	testLoggedTree();
+	return testResult("changeLogTest");
+}
@@ -0,0 +1,55 @@
+/*
+
+	- Density rasters of hand built layouts whose nodes end on and between cell boundaries
+*/
+
+#include <cmath>
+
+#include "searchTreeExport.h"
+#include "testCommon.h"
+
+// Returns a node of a layout
+NodeLayout layoutNode(double minX, double minY, double maxX, double maxY, std::size_t depth, std::size_t valueCount, bool isLeaf) {
+	NodeLayout node;
+	node.bounds = LayoutRect{ minX, minY, maxX, maxY };
+	node.depth = depth;
+	node.valueCount = valueCount;
+	node.subtreeValueCount = valueCount;
+	node.isLeaf = isLeaf;
+	return node;
+}
+
+// Returns true if every density is within a rounding error of the wanted one
+bool isNear(const std::vector<double>& vecDensity, const std::vector<double>& vecWanted) {
+	bool isSame = vecDensity.size() == vecWanted.size();
+	for (std::size_t i = 0; isSame && i < vecDensity.size(); ++i) {
+		isSame = std::fabs(vecDensity[i] - vecWanted[i]) < 1e-9;
+	}
+	return isSame;
+}
+
+// A node ending on a cell boundary used to paint the cell past it as well
+void testKnownLayout() {
+
+	// 10 values over the left half of a 10 x 1 root, 6 over [2.5, 7.5] and 2 in a zero width node
+	TreeLayout layout;
+	layout.nodes.push_back(layoutNode(0, 0, 10, 1, 0, 0, false));
+	layout.nodes.push_back(layoutNode(0, 0, 5, 1, 1, 10, true));
+	layout.nodes.push_back(layoutNode(5, 0, 10, 1, 1, 0, true));
+
+	std::vector<double> vecWanted = { 2, 2, 2, 2, 2, 0, 0, 0, 0, 0 };
+	CHECK(isNear(rasterizeDensity(layout, 10, 1), vecWanted));
+
+	layout.nodes[2] = layoutNode(2.5, 0, 7.5, 1, 1, 6, true);
+	vecWanted = { 2, 2, 3.2, 3.2, 3.2, 1.2, 1.2, 1.2, 0, 0 };
+	CHECK(isNear(rasterizeDensity(layout, 10, 1), vecWanted));
+
+	layout.nodes[2] = layoutNode(6, 0, 6, 1, 1, 2, true);
+	vecWanted = { 2, 2, 2, 2, 2, 0, 2, 0, 0, 0 };
+	CHECK(isNear(rasterizeDensity(layout, 10, 1), vecWanted));
+}
+
+int main() {
+	testKnownLayout();
+	return testResult("exportTest");
+}
@@ -0,0 +1,221 @@
+/*
+
+	- Frozen and shared trees checked against the live tree they were built from
+	- Shared segments that are incomplete or corrupt rejected when attaching
+*/
+
+#include <string>
+#include <limits>
+#include <cstdint>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+
+#include "sharedFrozenTree2D.h"
+#include "testCommon.h"
+
+// Returns a random query box inside [0, extent)
+Box2D<float> randomQuery(int extent, int size) {
+	float x = static_cast<float>(std::rand() % extent);
+	float y = static_cast<float>(std::rand() % extent);
+	Box2D<float> box = { x, y, x + size, y + size };
+	return box;
+}
+
+// Frozen trees filter by box like a live tree with sorted leaves, so their results are exact
+template<class Tree, class BoxOf>
+void testFrozen() {
+
+	std::srand(5);
+	std::vector<TestBox> vecValues = makeTestBoxes(3000, 5000, 30);
+
+	Tree tree;
+	for (auto&& val : vecValues) {
+		tree.add(val);
+	}
+	tree.rebalance();
+
+	auto frozen = tree.freeze();
+	CHECK(frozen.isComplete());
+
+	for (int query = 0; query < 200; ++query) {
+		Box2D<float> box = randomQuery(5000, 200);
+
+		std::set<int> setWanted = overlappingIds<BoxOf>(vecValues, box);
+		std::set<int> setUnsorted = idsOf(tree.getNearbyValues(box));
+		std::set<int> setFrozen = idsOf(frozen.getNearbyValues(box));
+		CHECK(setFrozen == setWanted);
+		CHECK(std::includes(setUnsorted.begin(), setUnsorted.end(), setFrozen.begin(), setFrozen.end()));
+
+		std::vector<TestBox> vecFrozen;
+		frozen.getNearbyValues(box, vecFrozen);
+		CHECK(vecFrozen.size() == setFrozen.size());
+	}
+
+	tree.setLeafSorting(true);
+	for (int query = 0; query < 200; ++query) {
+		Box2D<float> box = randomQuery(5000, 200);
+		CHECK(idsOf(tree.getNearbyValues(box)) == idsOf(frozen.getNearbyValues(box)));
+	}
+}
+
+// A shared tree maps the same arrays and answers the same queries
+void testShared() {
+
+	std::srand(6);
+	std::vector<TestBox> vecValues = makeTestBoxes(2000, 5000, 30);
+
+	TestBoxTree tree;
+	for (auto&& val : vecValues) {
+		tree.add(val);
+	}
+	tree.rebalance();
+	auto frozen = tree.freeze();
+
+	using Shared = SharedFrozenTree2D<TestBox, Box2D<float>, BoxPredicate2D<TestBox, float, TestBoxOf> >;
+	std::string name = "/frozenTest_" + std::to_string(getpid());
+	CHECK(Shared::create(name, frozen));
+
+	Shared shared;
+	CHECK(shared.attach(name));
+	for (int query = 0; query < 200; ++query) {
+		Box2D<float> box = randomQuery(5000, 200);
+		CHECK(idsOf(shared.getNearbyValues(box)) == idsOf(frozen.getNearbyValues(box)));
+	}
+
+	// Recreating makes a new segment, so the old mapping keeps the old tree
+	TestBoxTree half;
+	for (std::size_t i = 0; i < vecValues.size() / 2; ++i) {
+		half.add(vecValues[i]);
+	}
+	CHECK(Shared::create(name, half.freeze()));
+	Shared again;
+	CHECK(again.attach(name));
+	Box2D<float> everything = { 0, 0, 6000, 6000 };
+	CHECK(again.getNearbyValues(everything).size() == vecValues.size() / 2);
+	CHECK(shared.getNearbyValues(everything).size() == vecValues.size());
+
+	shared.detach();
+	again.detach();
+	CHECK(Shared::unlink(name));
+	CHECK(!shared.attach(name));
+}
+
+// Maps a segment writable and hands its header to corrupt
+template<class Corrupt>
+void corruptSegment(const std::string& name, Corrupt corrupt) {
+	int fd = shm_open(name.c_str(), O_RDWR, 0);
+	CHECK(fd >= 0);
+	if (fd < 0) {
+		return;
+	}
+	off_t bytes = lseek(fd, 0, SEEK_END);
+	void* mapped = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	CHECK(mapped != MAP_FAILED);
+	if (mapped != MAP_FAILED) {
+		corrupt(*static_cast<SharedTreeHeader*>(mapped));
+		munmap(mapped, bytes);
+	}
+}
+
+// Segments without their magic, with arrays past the end or with nodes pointing outside
+// of the arrays are rejected
+void testSharedRejects() {
+
+	std::srand(7);
+	std::vector<TestBox> vecValues = makeTestBoxes(500, 5000, 30);
+
+	TestBoxTree tree;
+	for (auto&& val : vecValues) {
+		tree.add(val);
+	}
+	tree.rebalance();
+	auto frozen = tree.freeze();
+
+	using Shared = SharedFrozenTree2D<TestBox, Box2D<float>, BoxPredicate2D<TestBox, float, TestBoxOf> >;
+	std::string name = "/frozenTest_rejects_" + std::to_string(getpid());
+	Shared shared;
+
+	// Still being built
+	CHECK(Shared::create(name, frozen));
+	corruptSegment(name, [](SharedTreeHeader& header) { header.magic = 0; });
+	CHECK(!shared.attach(name));
+
+	CHECK(Shared::create(name, frozen));
+	corruptSegment(name, [](SharedTreeHeader& header) { header.valueCount *= 1000; });
+	CHECK(!shared.attach(name));
+
+	CHECK(Shared::create(name, frozen));
+	corruptSegment(name, [](SharedTreeHeader& header) { header.maxYOffset = header.totalBytes - 4; });
+	CHECK(!shared.attach(name));
+
+	CHECK(Shared::create(name, frozen));
+	corruptSegment(name, [](SharedTreeHeader& header) { header.boxCount = header.valueCount / 2; });
+	CHECK(!shared.attach(name));
+
+	CHECK(Shared::create(name, frozen));
+	corruptSegment(name, [](SharedTreeHeader& header) {
+		Shared::Node* nodes = reinterpret_cast<Shared::Node*>(reinterpret_cast<char*>(&header) + header.nodesOffset);
+		nodes[0].firstValue = static_cast<std::uint32_t>(header.valueCount);
+		nodes[0].valueCount = 1;
+	});
+	CHECK(!shared.attach(name));
+
+	CHECK(Shared::create(name, frozen));
+	CHECK(shared.attach(name));
+	shared.detach();
+	CHECK(Shared::unlink(name));
+}
+
+// Integer boxes at the low limit of their type
+struct LimitBox {
+	std::int32_t x;
+	std::int32_t size;
+	int id;
+
+	bool operator<(const LimitBox& other) const {
+		return id < other.id;
+	}
+};
+
+struct LimitBoxOf {
+	Box2D<std::int32_t> operator()(const LimitBox& val) const {
+		Box2D<std::int32_t> box = { val.x, 0, boxSaturatingAdd(val.x, val.size), 1 };
+		return box;
+	}
+};
+
+// The reach left of a query used to wrap around on the lowest coordinates
+void testFrozenLimits() {
+
+	const std::int32_t lowest = std::numeric_limits<std::int32_t>::lowest();
+	using LimitTree = SearchTree2D<LimitBox, Box2D<std::int32_t>, BoxPredicate2D<LimitBox, std::int32_t, LimitBoxOf> >;
+
+	LimitTree tree;
+	std::vector<LimitBox> vecValues;
+	for (int id = 0; id < 8; ++id) {
+		LimitBox val = { lowest + id * 2, id == 0 ? std::numeric_limits<std::int32_t>::max() : 3, id };
+		vecValues.push_back(val);
+		tree.add(val);
+	}
+	tree.rebalance();
+
+	Box2D<std::int32_t> box = { lowest + 6, 0, lowest + 6, 0 };
+	std::set<int> setWanted;
+	for (auto&& val : vecValues) {
+		if (boxOverlaps(box, LimitBoxOf()(val))) {
+			setWanted.insert(val.id);
+		}
+	}
+	CHECK(idsOf(tree.freeze().getNearbyValues(box)) == setWanted);
+}
+
+int main() {
+	testFrozen<TestBoxTree, TestBoxOf>();
+	testFrozen<TestPointTree, PointBoxOf<TestBox, float, TestPointOf> >();
+	testShared();
+	testSharedRejects();
+	testFrozenLimits();
+	return testResult("frozenTest");
+}
@@ -0,0 +1,88 @@
+/*
+
+	- Geographic tree queries checked against a brute force search, after adding and bulk loading
+*/
+
+#include "geoSearchTree2D.h"
+#include "testCommon.h"
+
+struct Place {
+	double lon;
+	double lat;
+	int id;
+
+	bool operator<(const Place& other) const {
+		return id < other.id;
+	}
+};
+
+struct PlaceLonLat {
+	GeoPoint operator()(const Place& place) const {
+		GeoPoint point = { place.lon, place.lat };
+		return point;
+	}
+};
+
+using PlaceTree = GeoSearchTree2D<Place, PlaceLonLat>;
+
+// Returns the ids of the places inside rect
+std::set<int> placesInside(const std::vector<Place>& vecPlaces, const GeoRect& rect) {
+	std::set<int> setIds;
+	for (auto&& place : vecPlaces) {
+		bool inLon = rect.west <= rect.east ? (rect.west <= place.lon && place.lon <= rect.east) : (rect.west <= place.lon || place.lon <= rect.east);
+		if (inLon && rect.south <= place.lat && place.lat <= rect.north) {
+			setIds.insert(place.id);
+		}
+	}
+	return setIds;
+}
+
+// Checks random rects, some crossing the antimeridian, against the brute force search
+void checkRects(const PlaceTree& tree, const std::vector<Place>& vecPlaces) {
+	for (int query = 0; query < 200; ++query) {
+		double west = std::rand() % 360 - 180.0;
+		double south = std::rand() % 160 - 80.0;
+		GeoRect rect = { west, south, west + 5 + std::rand() % 40, south + 10 };
+		if (rect.east > 180.0) {
+			rect.east -= 360.0;
+		}
+		CHECK(idsOf(tree.getValuesInRect(rect)) == placesInside(vecPlaces, rect));
+	}
+}
+
+int main() {
+
+	std::srand(4);
+	std::vector<Place> vecPlaces;
+	for (int id = 0; id < 5000; ++id) {
+		Place place = { (std::rand() % 36000) / 100.0 - 180.0, (std::rand() % 18000) / 100.0 - 90.0, id };
+		vecPlaces.push_back(place);
+	}
+
+	// Built one value at a time
+	PlaceTree added;
+	for (auto&& place : vecPlaces) {
+		added.add(place);
+	}
+	added.rebalance();
+	checkRects(added, vecPlaces);
+
+	// Built from sorted runs, in two batches so the second has to keep the first
+	PlaceTree loaded;
+	loaded.bulkLoad(vecPlaces.begin(), vecPlaces.begin() + 2000);
+	loaded.bulkLoad(vecPlaces.begin() + 2000, vecPlaces.end());
+	checkRects(loaded, vecPlaces);
+
+	std::size_t count = 0;
+	std::size_t leaves = 0;
+	loaded.tree().visitNodes([&](const PlaceTree::Tree::NodeVisit& node) {
+		count += node.values.size();
+		leaves += node.isLeaf ? 1 : 0;
+		return true;
+	});
+	CHECK(count == vecPlaces.size());
+	CHECK(leaves > 1);
+	CHECK(!PlaceTree::Tree::isGrowable);
+
+	return testResult("geoTest");
+}
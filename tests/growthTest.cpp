@@ -0,0 +1,126 @@
+/*
+
+	- Root growth towards values added outside of the root, for float and integer boxes
+*/
+
+#include <limits>
+#include <cstdint>
+
+#include "testCommon.h"
+
+// Square value with integer coordinates. size is added with saturation
+struct GrowBox {
+	std::int32_t x;
+	std::int32_t y;
+	std::int32_t size;
+	int id;
+
+	bool operator<(const GrowBox& other) const {
+		return id < other.id;
+	}
+};
+
+struct GrowBoxOf {
+	Box2D<std::int32_t> operator()(const GrowBox& val) const {
+		Box2D<std::int32_t> box = { val.x, val.y, boxSaturatingAdd(val.x, val.size), boxSaturatingAdd(val.y, val.size) };
+		return box;
+	}
+};
+
+using GrowPredicate = BoxPredicate2D<GrowBox, std::int32_t, GrowBoxOf>;
+using GrowTree = SearchTree2D<GrowBox, Box2D<std::int32_t>, GrowPredicate>;
+
+// Growth only extends the sides the value lies past
+void testGrowthSides() {
+
+	GrowPredicate predicate;
+	Box2D<std::int32_t> region = { 0, 0, 10, 10 };
+	RegionCode childCode;
+
+	GrowBox left = { -5, 2, 1, 0 };
+	Box2D<std::int32_t> grown = predicate.growRegion(region, left, childCode);
+	CHECK(grown.minX == -10 && grown.maxX == 10);
+	CHECK(boxContains(grown, region));
+
+	// Inside on y, nearer the top, so the region grows up
+	GrowBox below = { 2, 20, 1, 1 };
+	grown = predicate.growRegion(region, below, childCode);
+	CHECK(grown.minY == 0 && grown.maxY == 20);
+	CHECK(childCode == RegionCode::UPPER_LEFT || childCode == RegionCode::UPPER_RIGHT);
+
+	GrowBox upRight = { 30, -30, 1, 2 };
+	grown = predicate.growRegion(region, upRight, childCode);
+	CHECK(grown.maxX == 20 && grown.minY == -10);
+	CHECK(childCode == RegionCode::LOWER_LEFT);
+}
+
+// Regions at the limits of int32 saturate instead of overflowing, and stop once they span everything
+void testGrowthLimits() {
+
+	const std::int32_t lowest = std::numeric_limits<std::int32_t>::lowest();
+	const std::int32_t highest = std::numeric_limits<std::int32_t>::max();
+	GrowPredicate predicate;
+	RegionCode childCode;
+
+	Box2D<std::int32_t> region = { highest - 10, highest - 10, highest, highest };
+	GrowBox far = { lowest, lowest, 0, 0 };
+	Box2D<std::int32_t> grown = predicate.growRegion(region, far, childCode);
+	CHECK(boxContains(grown, region));
+	CHECK(grown.minX == highest - 20 && grown.maxX == highest);
+
+	Box2D<std::int32_t> everything = { lowest, lowest, highest, highest };
+	CHECK(predicate.growRegion(everything, far, childCode) == everything);
+
+	// Half the range past the edge doubles to the limit instead of wrapping around
+	Box2D<std::int32_t> half = { 0, 0, highest, highest };
+	GrowBox top = { 0, highest, 0, 1 };
+	grown = predicate.growRegion(half, top, childCode);
+	CHECK(grown.maxX == highest && grown.maxY == highest);
+	CHECK(grown.minX <= 0 && grown.minY <= 0);
+}
+
+// Values added far outside of a built tree are found without a rebalance
+void testTreeGrowth() {
+
+	GrowTree tree;
+	tree.setStatsEnabled(true);
+	std::vector<GrowBox> vecValues;
+	std::srand(7);
+	for (int id = 0; id < 200; ++id) {
+		GrowBox val = { std::rand() % 1000, std::rand() % 1000, 5, id };
+		vecValues.push_back(val);
+		tree.add(val);
+	}
+	tree.rebalance();
+
+	const std::int32_t lowest = std::numeric_limits<std::int32_t>::lowest();
+	const std::int32_t highest = std::numeric_limits<std::int32_t>::max();
+	GrowBox corners[] = {
+		{ lowest, lowest, 0, 200 }, { highest, highest, 0, 201 }, { lowest, highest, 0, 202 }, { 500, highest - 3, highest, 203 }
+	};
+	for (auto&& corner : corners) {
+		vecValues.push_back(corner);
+		tree.add(corner);
+	}
+	CHECK(tree.getStats().rootGrowths > 0);
+	CHECK(tree.getStats().rootGrowths < 4 * 64);
+
+	for (auto&& corner : corners) {
+		Box2D<std::int32_t> box = GrowBoxOf()(corner);
+		CHECK(idsOf(tree.getNearbyValues(box)).count(corner.id) == 1);
+	}
+
+	std::size_t count = 0;
+	tree.visitNodes([&](const GrowTree::NodeVisit& node) {
+		count += node.values.size();
+		return true;
+	});
+	CHECK(count >= vecValues.size());
+}
+
+int main() {
+	testGrowthSides();
+	testGrowthLimits();
+	testTreeGrowth();
+	return testResult("growthTest");
+}
@@ -0,0 +1,126 @@
+/*
+
+	- Rounds of random adds, removes and moves, each followed by a rebalance checked against brute force
+	- Phase profiles of the profiled rounds adding up across depths
+	Run with -fsanitize=address to catch nodes used after a rebalance deleted them
+*/
+
+#include <cstdint>
+
+#include "testCommon.h"
+
+// Returns the ids of the held values overlapping query
+std::set<int> heldIds(const std::vector<TestBox>& vecValues, const std::vector<bool>& vecHeld, const Box2D<float>& query) {
+	std::set<int> setIds;
+	for (std::size_t i = 0; i < vecValues.size(); ++i) {
+		if (vecHeld[i] && boxOverlaps(query, TestBoxOf()(vecValues[i]))) {
+			setIds.insert(vecValues[i].id);
+		}
+	}
+	return setIds;
+}
+
+// Returns true if the phases of every depth add up to the totals
+bool sumsByDepth(const RebalanceProfile& profile) {
+	RebalancePhase RebalancePhases::* phases[] = {
+		&RebalancePhases::buildRootRegion, &RebalancePhases::gatherValues, &RebalancePhases::filterValues,
+		&RebalancePhases::buildQuadrants, &RebalancePhases::subdivideTest, &RebalancePhases::allocateNodes,
+		&RebalancePhases::addValues
+	};
+	for (auto phase : phases) {
+		std::size_t calls = 0;
+		std::uint64_t nanoseconds = 0;
+		for (auto&& depth : profile.byDepth) {
+			calls += (depth.*phase).calls;
+			nanoseconds += (depth.*phase).nanoseconds;
+		}
+		if (calls != (profile.total.*phase).calls || nanoseconds != (profile.total.*phase).nanoseconds) {
+			return false;
+		}
+	}
+	return true;
+}
+
+void testRandomRounds() {
+
+	std::srand(15);
+	std::vector<TestBox> vecValues = makeTestBoxes(4000, 5000, 40);
+	std::vector<bool> vecHeld(vecValues.size(), false);
+
+	PtrTree tree;
+	for (int round = 0; round < 40; ++round) {
+
+		// Values are added and removed through the tree, moves only show up in the rebalance
+		for (int change = 0; change < 300; ++change) {
+			std::size_t i = std::rand() % vecValues.size();
+			TestBox& val = vecValues[i];
+			switch (std::rand() % 3) {
+			case 0:
+				tree.add(&val);
+				vecHeld[i] = true;
+				break;
+			case 1:
+				tree.remove(&val);
+				vecHeld[i] = false;
+				break;
+			default:
+				// Mostly short moves, sometimes across the whole tree
+				if (std::rand() % 4) {
+					val.x = std::max(0.0f, val.x + static_cast<float>(std::rand() % 41 - 20));
+					val.y = std::max(0.0f, val.y + static_cast<float>(std::rand() % 41 - 20));
+				}
+				else {
+					val.x = static_cast<float>(std::rand() % 5000);
+					val.y = static_cast<float>(std::rand() % 5000);
+				}
+				break;
+			}
+		}
+
+		bool isProfiled = round % 2 == 1;
+		tree.setRebalanceProfiling(isProfiled);
+		RebalanceProfile profile = tree.rebalance();
+		CHECK(profile.enabled == isProfiled);
+		if (isProfiled) {
+			CHECK(profile.nodesVisited > 0);
+			CHECK(profile.total.buildRootRegion.calls == 1);
+			CHECK(sumsByDepth(profile));
+		}
+		else {
+			CHECK(profile.nodesVisited == 0 && profile.byDepth.empty());
+		}
+
+		for (int query = 0; query < 30; ++query) {
+			float x = static_cast<float>(std::rand() % 5000);
+			float y = static_cast<float>(std::rand() % 5000);
+			Box2D<float> box = { x, y, x + 300, y + 300 };
+
+			std::set<int> setWanted = heldIds(vecValues, vecHeld, box);
+			std::set<int> setFound;
+			for (const TestBox* val : tree.getNearbyValues(box)) {
+				CHECK(vecHeld[val->id]);
+				setFound.insert(val->id);
+			}
+			CHECK(std::includes(setFound.begin(), setFound.end(), setWanted.begin(), setWanted.end()));
+		}
+	}
+
+	// Every held value is in the tree, and only in nodes whose search space it overlaps
+	std::set<int> setNodeIds;
+	bool isInNode = true;
+	tree.visitNodes([&](const PtrTree::NodeVisit& node) {
+		for (const TestBox* val : node.values) {
+			isInNode = isInNode && boxOverlaps(node.compare, TestBoxOf()(*val));
+			setNodeIds.insert(val->id);
+		}
+		return true;
+	});
+	Box2D<float> everything = { 0, 0, 6000, 6000 };
+	CHECK(isInNode);
+	CHECK(setNodeIds == heldIds(vecValues, vecHeld, everything));
+}
+
+int main() {
+	testRandomRounds();
+	return testResult("rebalanceTest");
+}
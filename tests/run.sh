@@ -0,0 +1,18 @@
+#!/bin/sh
+# Builds and runs every test. Extra arguments are passed to the compiler,
+# i.e. tests/run.sh -g -fsanitize=address
+cd "$(dirname "$0")" || exit 1
+CXX=${CXX:-g++}
+mkdir -p build
+
+status=0
+for test in *Test.cpp; do
+	name=${test%.cpp}
+	if ! $CXX -std=c++11 -Wall -Wextra -O1 -pthread -I../src "$@" "$test" -o "build/$name" -lrt; then
+		echo "$name: BUILD FAILED"
+		status=1
+	elif ! "build/$name"; then
+		status=1
+	fi
+done
+exit $status
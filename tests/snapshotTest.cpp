@@ -0,0 +1,119 @@
+/*
+
+	- Snapshots, checkpoints and compaction round-tripped through readSnapshot
+	- Values moved inside their node picked up by the next checkpoint
+*/
+
+#include <sstream>
+#include <cstdint>
+
+#include "searchTreeSnapshot.h"
+#include "testCommon.h"
+
+std::uint64_t idOf(const TestBox* val) {
+	return static_cast<std::uint64_t>(val->id);
+}
+
+// Loads a snapshot into tree, restoring the values into vecRestored by id
+bool load(const std::string& snapshot, PtrTree& tree, std::vector<TestBox>& vecRestored) {
+	std::istringstream in(snapshot);
+	return readSnapshot(in, tree, [&](std::uint64_t id, const Box2D<float>& box) {
+		TestBox& val = vecRestored[id];
+		val.x = box.minX;
+		val.y = box.minY;
+		val.size = box.maxX - box.minX;
+		val.id = static_cast<int>(id);
+		return &val;
+	});
+}
+
+// Returns true if every restored box holds the live box of the same id
+bool holdsAll(const std::vector<TestBox>& vecLive, const std::vector<TestBox>& vecRestored, const PtrTree& restored) {
+	std::size_t count = 0;
+	bool isHeld = true;
+	restored.visitNodes([&](const PtrTree::NodeVisit& node) {
+		for (const TestBox* val : node.values) {
+			Box2D<float> live = TestBoxOf()(vecLive[val->id]);
+			Box2D<float> box = TestBoxOf()(vecRestored[val->id]);
+			isHeld = isHeld && box.minX <= live.minX && box.minY <= live.minY && live.maxX <= box.maxX + 0.01f && live.maxY <= box.maxY + 0.01f;
+			++count;
+		}
+		return true;
+	});
+	return isHeld && count >= vecLive.size();
+}
+
+// Returns the leaf holding val
+const Box2D<float>* leafOf(const PtrTree& tree, const TestBox* val) {
+	const Box2D<float>* pLeaf = nullptr;
+	tree.visitNodes([&](const PtrTree::NodeVisit& node) {
+		if (node.isLeaf && node.values.count(const_cast<TestBox*>(val))) {
+			pLeaf = &node.compare;
+		}
+		return true;
+	});
+	return pLeaf;
+}
+
+void testRoundTrip() {
+
+	std::srand(14);
+	std::vector<TestBox> vecValues = makeTestBoxes(2000, 5000, 20);
+
+	PtrTree tree;
+	for (auto&& val : vecValues) {
+		tree.add(&val);
+	}
+	tree.rebalance();
+
+	std::ostringstream base;
+	CHECK(writeSnapshot(base, tree, idOf));
+	tree.markCheckpoint();
+
+	std::vector<TestBox> vecRestored(vecValues.size());
+	PtrTree restored;
+	CHECK(load(base.str(), restored, vecRestored));
+	CHECK(holdsAll(vecValues, vecRestored, restored));
+
+	// Nothing changed, so the checkpoint is one marker
+	std::ostringstream empty;
+	CHECK(checkpoint(empty, tree, idOf));
+	std::ostringstream unchanged;
+	std::istringstream baseIn(base.str());
+	std::istringstream emptyIn(empty.str());
+	CHECK(compactSnapshot<PtrTree>(baseIn, emptyIn, unchanged));
+	CHECK(unchanged.str() == base.str());
+
+	// Move a value a little, keeping it in its leaf
+	TestBox* pMoved = &vecValues[0];
+	Box2D<float> leafBefore = *leafOf(tree, pMoved);
+	pMoved->x += 0.5f;
+	tree.rebalance();
+	const Box2D<float>* pLeafAfter = leafOf(tree, pMoved);
+	CHECK(pLeafAfter && *pLeafAfter == leafBefore);
+
+	std::ostringstream delta;
+	CHECK(checkpoint(delta, tree, idOf));
+	CHECK(delta.str().size() < base.str().size() / 4);
+
+	std::ostringstream merged;
+	std::istringstream baseAgain(base.str());
+	std::istringstream deltaIn(delta.str());
+	CHECK(compactSnapshot<PtrTree>(baseAgain, deltaIn, merged));
+
+	std::vector<TestBox> vecMerged(vecValues.size());
+	PtrTree reloaded;
+	CHECK(load(merged.str(), reloaded, vecMerged));
+	CHECK(holdsAll(vecValues, vecMerged, reloaded));
+	CHECK(vecMerged[0].x <= pMoved->x && pMoved->x - vecMerged[0].x < 0.1f);
+
+	// Checkpoints can't be loaded on their own
+	PtrTree partial;
+	std::vector<TestBox> vecPartial(vecValues.size());
+	CHECK(!load(delta.str(), partial, vecPartial));
+}
+
+int main() {
+	testRoundTrip();
+	return testResult("snapshotTest");
+}
@@ -0,0 +1,181 @@
+/*
+
+	- Subdivision floor of the box predicates: dense data, single axis data and integer boundaries
+	- Leaf sorted queries on integer boxes at the limits of their coordinate type
+*/
+
+#include <limits>
+#include <cstdint>
+
+#include "testCommon.h"
+
+// Square value with integer coordinates
+template<class Coord>
+struct IntBox {
+	Coord x;
+	Coord y;
+	Coord size;
+	int id;
+
+	bool operator<(const IntBox& other) const {
+		return id < other.id;
+	}
+};
+
+// size is added with saturation, so a box can reach the largest Coord
+template<class Coord>
+struct IntBoxOf {
+	Box2D<Coord> operator()(const IntBox<Coord>& val) const {
+		Box2D<Coord> box = { val.x, val.y, boxSaturatingAdd(val.x, val.size), boxSaturatingAdd(val.y, val.size) };
+		return box;
+	}
+};
+
+struct IntPointOf {
+	Point2D<std::int32_t> operator()(const IntBox<std::int32_t>& val) const {
+		Point2D<std::int32_t> point = { val.x, val.y };
+		return point;
+	}
+};
+
+template<class Coord>
+using IntBoxTree = SearchTree2D<IntBox<Coord>, Box2D<Coord>, BoxPredicate2D<IntBox<Coord>, Coord, IntBoxOf<Coord> > >;
+
+// Returns the depth of the deepest node
+template<class Tree>
+std::size_t maxDepth(const Tree& tree) {
+	std::size_t depth = 0;
+	tree.visitNodes([&](const typename Tree::NodeVisit& node) {
+		depth = std::max(depth, node.depth);
+		return true;
+	});
+	return depth;
+}
+
+// Many overlapping float boxes used to subdivide until the midpoint stopped moving
+void testDenseFloat() {
+
+	std::srand(3);
+	std::vector<TestBox> vecValues = makeTestBoxes(3000, 1000, 20);
+
+	TestBoxTree tree;
+	for (auto&& val : vecValues) {
+		tree.add(val);
+	}
+	tree.rebalance();
+	CHECK(maxDepth(tree) < 40);
+
+	for (int query = 0; query < 100; ++query) {
+		float x = static_cast<float>(std::rand() % 1000);
+		float y = static_cast<float>(std::rand() % 1000);
+		Box2D<float> box = { x, y, x + 10, y + 10 };
+
+		std::set<int> setWanted = overlappingIds<TestBoxOf>(vecValues, box);
+		std::set<int> setFound = idsOf(tree.getNearbyValues(box));
+		CHECK(std::includes(setFound.begin(), setFound.end(), setWanted.begin(), setWanted.end()));
+	}
+}
+
+// Integer nodes one unit wide can't be split. Their lower quadrant used to equal the parent
+template<class Coord>
+void testIntegerFloor(Coord origin) {
+
+	IntBoxTree<Coord> tree;
+	std::vector<IntBox<Coord> > vecValues;
+	for (int id = 0; id < 40; ++id) {
+		IntBox<Coord> val = { static_cast<Coord>(origin + id % 2), static_cast<Coord>(origin + (id / 2) % 2), 0, id };
+		vecValues.push_back(val);
+		tree.add(val);
+	}
+	tree.rebalance();
+	CHECK(maxDepth(tree) <= 2);
+
+	Box2D<Coord> box = { origin, origin, origin, origin };
+	std::set<int> setFound = idsOf(tree.getNearbyValues(box));
+	for (auto&& val : vecValues) {
+		if (val.x == origin && val.y == origin) {
+			CHECK(setFound.count(val.id) == 1);
+		}
+	}
+}
+
+// Values on one row can only be split along x. Quadrant pairs used to be the same box,
+// which doubled the subtree at every level
+template<class Tree, class Coord>
+void testSingleAxis() {
+
+	Tree tree;
+	std::vector<IntBox<Coord> > vecValues;
+	for (int id = 0; id < 2000; ++id) {
+		IntBox<Coord> val = { static_cast<Coord>(id * 7), 0, 0, id };
+		vecValues.push_back(val);
+		tree.add(val);
+	}
+	tree.rebalance();
+
+	std::size_t nodes = 0;
+	tree.visitNodes([&](const typename Tree::NodeVisit&) {
+		++nodes;
+		return true;
+	});
+	CHECK(nodes < 4 * vecValues.size());
+
+	for (int query = 0; query < 100; ++query) {
+		Coord x = static_cast<Coord>(std::rand() % 14000);
+		Box2D<Coord> box = { x, 0, static_cast<Coord>(x + 20), 0 };
+		std::set<int> setWanted;
+		for (auto&& val : vecValues) {
+			if (boxOverlaps(box, IntBoxOf<Coord>()(val))) {
+				setWanted.insert(val.id);
+			}
+		}
+		std::set<int> setFound = idsOf(tree.getNearbyValues(box));
+		CHECK(std::includes(setFound.begin(), setFound.end(), setWanted.begin(), setWanted.end()));
+	}
+}
+
+// The widest box of a leaf and the query's reach left of it used to wrap around
+template<class Coord>
+void testSortedLimits() {
+
+	const Coord lowest = std::numeric_limits<Coord>::lowest();
+	const Coord highest = std::numeric_limits<Coord>::max();
+
+	IntBoxTree<Coord> tree;
+	tree.setLeafSorting(true);
+	std::vector<IntBox<Coord> > vecValues;
+	for (int id = 0; id < 20; ++id) {
+		IntBox<Coord> val = { static_cast<Coord>(lowest + id * 3), lowest, 4, id };
+		vecValues.push_back(val);
+	}
+	IntBox<Coord> spanning = { lowest, lowest, highest, 20 };
+	vecValues.push_back(spanning);
+	for (auto&& val : vecValues) {
+		tree.add(val);
+	}
+
+	Box2D<Coord> box = { static_cast<Coord>(lowest + 10), lowest, static_cast<Coord>(lowest + 12), static_cast<Coord>(lowest + 1) };
+	std::set<int> setWanted;
+	for (auto&& val : vecValues) {
+		if (boxOverlaps(box, IntBoxOf<Coord>()(val))) {
+			setWanted.insert(val.id);
+		}
+	}
+	std::set<int> setFound = idsOf(tree.getNearbyValues(box));
+	CHECK(setFound == setWanted);
+	CHECK(setFound.count(20) == 1);
+}
+
+int main() {
+	testDenseFloat();
+	testIntegerFloor<std::int32_t>(0);
+	testIntegerFloor<std::int32_t>(std::numeric_limits<std::int32_t>::max() - 1);
+	testIntegerFloor<std::int32_t>(std::numeric_limits<std::int32_t>::min());
+	testIntegerFloor<std::int64_t>(std::numeric_limits<std::int64_t>::max() - 1);
+	testIntegerFloor<std::int64_t>(-1);
+	testSingleAxis<IntBoxTree<std::int32_t>, std::int32_t>();
+	testSingleAxis<SearchTree2D<IntBox<std::int32_t>, Box2D<std::int32_t>, PointPredicate2D<IntBox<std::int32_t>, std::int32_t, IntPointOf> >, std::int32_t>();
+	testSortedLimits<std::int32_t>();
+	testSortedLimits<std::int64_t>();
+	return testResult("subdivisionTest");
+}
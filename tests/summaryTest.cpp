@@ -0,0 +1,114 @@
+/*
+
+	- Time windows, category masks, top values and retiring checked against brute force
+	- Summaries of values already held are left alone
+*/
+
+#include <algorithm>
+#include <cstdint>
+
+#include "testCommon.h"
+
+// Box predicate with every summarized extension, all derived from the value's id
+struct SummaryPredicate : BoxPredicate2D<TestBox, float, TestBoxOf> {
+	int timeOf(const TestBox& val) const {
+		return val.id % 50;
+	}
+
+	std::uint32_t categoryOf(const TestBox& val) const {
+		return 1u << (val.id % 5);
+	}
+
+	int priorityOf(const TestBox& val) const {
+		return (val.id * 7919) % 1000;
+	}
+};
+
+using SummaryTree = SearchTree2D<TestBox, Box2D<float>, SummaryPredicate>;
+
+// Returns the ids of the values overlapping box that pass keep
+template<class Keep>
+std::set<int> wantedIds(const std::vector<TestBox>& vecValues, const Box2D<float>& box, Keep keep) {
+	std::set<int> setIds;
+	for (auto&& val : vecValues) {
+		if (boxOverlaps(box, TestBoxOf()(val)) && keep(val)) {
+			setIds.insert(val.id);
+		}
+	}
+	return setIds;
+}
+
+void testFilters() {
+
+	std::srand(11);
+	std::vector<TestBox> vecValues = makeTestBoxes(3000, 2000, 30);
+	SummaryPredicate predicate;
+
+	SummaryTree tree;
+	tree.setLeafSorting(true);
+	for (auto&& val : vecValues) {
+		tree.add(val);
+	}
+	tree.rebalance();
+
+	for (int query = 0; query < 100; ++query) {
+		float x = static_cast<float>(std::rand() % 2000);
+		float y = static_cast<float>(std::rand() % 2000);
+		Box2D<float> box = { x, y, x + 150, y + 150 };
+
+		int begin = std::rand() % 50;
+		int end = begin + std::rand() % 10;
+		CHECK(idsOf(tree.getNearbyValues(box, begin, end)) == wantedIds(vecValues, box, [&](const TestBox& val) {
+			return predicate.timeOf(val) >= begin && predicate.timeOf(val) <= end;
+		}));
+
+		std::uint32_t mask = 1u << (std::rand() % 5);
+		CHECK(idsOf(tree.getNearbyValues(box, mask)) == wantedIds(vecValues, box, [&](const TestBox& val) {
+			return (predicate.categoryOf(val) & mask) != 0;
+		}));
+
+		std::vector<std::pair<int, int> > vecRanked;
+		for (int id : wantedIds(vecValues, box, [](const TestBox&) { return true; })) {
+			vecRanked.push_back(std::make_pair(-predicate.priorityOf(vecValues[id]), id));
+		}
+		std::sort(vecRanked.begin(), vecRanked.end());
+		std::vector<TestBox> vecTop = tree.getTopValues(box, 5);
+		CHECK(vecTop.size() == std::min<std::size_t>(5, vecRanked.size()));
+		for (std::size_t i = 0; i < vecTop.size() && i < vecRanked.size(); ++i) {
+			CHECK(vecTop[i].id == vecRanked[i].second);
+		}
+	}
+
+	tree.retireBefore(25);
+	Box2D<float> everything = { 0, 0, 3000, 3000 };
+	CHECK(idsOf(tree.getNearbyValues(everything)) == wantedIds(vecValues, everything, [&](const TestBox& val) {
+		return predicate.timeOf(val) >= 25;
+	}));
+}
+
+// Adding a value the tree already holds used to summarize it again before the insert failed
+void testDuplicateAdds() {
+
+	std::srand(12);
+	std::vector<TestBox> vecValues = makeTestBoxes(500, 1000, 20);
+
+	SummaryTree tree;
+	tree.setStatsEnabled(true);
+	for (auto&& val : vecValues) {
+		tree.add(val);
+	}
+	CHECK(tree.getStats().add.predicateCalls.timeOf >= vecValues.size());
+
+	tree.resetStats();
+	for (auto&& val : vecValues) {
+		tree.add(val);
+	}
+	const PredicateCallCounts& calls = tree.getStats().add.predicateCalls;
+	CHECK(calls.timeOf == 0 && calls.categoryOf == 0 && calls.priorityOf == 0 && calls.boxOf == 0);
+}
+
+int main() {
+	testFilters();
+	testDuplicateAdds();
+	return testResult("summaryTest");
+}
@@ -0,0 +1,108 @@
+/*
+
+	- Shared helpers for the search tree tests
+
+	Every test is a standalone program returning 0 when all of its checks pass.
+	Build and run them all with tests/run.sh.
+*/
+
+#ifndef __TEST_COMMON_H_
+#define __TEST_COMMON_H_
+
+#include <vector>
+#include <set>
+#include <cstdio>
+#include <cstdlib>
+
+#include "boxPredicate2D.h"
+
+// Number of failed checks in this test
+static int g_failures = 0;
+
+// Records a failure if condition is false, then carries on with the test
+#define CHECK(condition) \
+	do { \
+		if (!(condition)) { \
+			std::printf("%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #condition); \
+			++g_failures; \
+		} \
+	} while (0)
+
+// Prints the result of the test and returns its exit code
+inline int testResult(const char* name) {
+	std::printf("%s: %s\n", name, g_failures ? "FAILED" : "passed");
+	return g_failures ? 1 : 0;
+}
+
+// Square value identified by id. Values compare by id only, so a value may move
+struct TestBox {
+	float x;
+	float y;
+	float size;
+	int id;
+
+	bool operator<(const TestBox& other) const {
+		return id < other.id;
+	}
+};
+
+struct TestBoxOf {
+	Box2D<float> operator()(const TestBox& val) const {
+		Box2D<float> box = { val.x, val.y, val.x + val.size, val.y + val.size };
+		return box;
+	}
+};
+
+struct TestPointOf {
+	Point2D<float> operator()(const TestBox& val) const {
+		Point2D<float> point = { val.x, val.y };
+		return point;
+	}
+};
+
+using TestBoxTree = SearchTree2D<TestBox, Box2D<float>, BoxPredicate2D<TestBox, float, TestBoxOf> >;
+using TestPointTree = SearchTree2D<TestBox, Box2D<float>, PointPredicate2D<TestBox, float, TestPointOf> >;
+
+// Values are pointers, so a value can move without the tree being told until it rebalances
+struct PtrBoxOf {
+	Box2D<float> operator()(const TestBox* val) const {
+		return TestBoxOf()(*val);
+	}
+};
+
+using PtrTree = SearchTree2D<TestBox*, Box2D<float>, BoxPredicate2D<TestBox*, float, PtrBoxOf> >;
+
+// Returns random values spread over [0, extent) with sizes in [1, maxSize]
+inline std::vector<TestBox> makeTestBoxes(std::size_t count, float extent, int maxSize, int firstId = 0) {
+	std::vector<TestBox> vecValues;
+	for (std::size_t i = 0; i < count; ++i) {
+		TestBox val = { static_cast<float>(std::rand() % static_cast<int>(extent)), static_cast<float>(std::rand() % static_cast<int>(extent)),
+						static_cast<float>(1 + std::rand() % maxSize), firstId + static_cast<int>(i) };
+		vecValues.push_back(val);
+	}
+	return vecValues;
+}
+
+// Returns the ids of the values whose boxes overlap query
+template<class BoxOf>
+std::set<int> overlappingIds(const std::vector<TestBox>& vecValues, const Box2D<float>& query) {
+	std::set<int> setIds;
+	for (auto&& val : vecValues) {
+		if (boxOverlaps(query, BoxOf()(val))) {
+			setIds.insert(val.id);
+		}
+	}
+	return setIds;
+}
+
+// Returns the ids of values
+template<class Container>
+std::set<int> idsOf(const Container& values) {
+	std::set<int> setIds;
+	for (auto&& val : values) {
+		setIds.insert(val.id);
+	}
+	return setIds;
+}
+
+#endif
@@ -0,0 +1,331 @@
+/*
+
+	- Queries of the live tree checked against a brute force search
+	- Predicate calls of every operation counted in the tree stats
+	- Query caches handed to copies and to new trees built where an old one was destroyed
+	- Samples of values that belong to several nodes
+	- Nearest neighbors of every value, run serially and on threads
+	- Density rasters counting every value once, checked against brute force
+	- Region expressions, with and without boxOf, checked against brute force
+*/
+
+#include <new>
+#include <map>
+#include <utility>
+#include <iterator>
+
+#include "searchTreeParallel.h"
+#include "testCommon.h"
+
+// Every value overlapping a query must be returned, before and after rebalancing
+template<class Tree, class BoxOf>
+void testQueries() {
+
+	std::srand(1);
+	std::vector<TestBox> vecValues = makeTestBoxes(4000, 20000, 40);
+
+	Tree tree;
+	for (auto&& val : vecValues) {
+		tree.add(val);
+	}
+
+	for (int pass = 0; pass < 3; ++pass) {
+		for (int query = 0; query < 200; ++query) {
+			float x = static_cast<float>(std::rand() % 20000);
+			float y = static_cast<float>(std::rand() % 20000);
+			Box2D<float> box = { x, y, x + 500, y + 500 };
+
+			std::set<int> setWanted = overlappingIds<BoxOf>(vecValues, box);
+			std::set<int> setFound = idsOf(tree.getNearbyValues(box));
+			CHECK(std::includes(setFound.begin(), setFound.end(), setWanted.begin(), setWanted.end()));
+		}
+
+		if (pass == 0) {
+			tree.rebalance();
+		}
+		else {
+			for (std::size_t i = 0; i < 1000; ++i) {
+				tree.remove(vecValues.back());
+				vecValues.pop_back();
+			}
+		}
+	}
+
+	std::size_t count = 0;
+	tree.visitNodes([&](const typename Tree::NodeVisit& node) {
+		count += node.values.size();
+		return true;
+	});
+	CHECK(count >= vecValues.size());
+}
+
+// Box lookups made while adding, sweeping and rasterizing show up in the stats
+void testStats() {
+
+	std::srand(2);
+	std::vector<TestBox> vecValues = makeTestBoxes(500, 1000, 20);
+
+	TestBoxTree tree;
+	tree.setStatsEnabled(true);
+	for (auto&& val : vecValues) {
+		tree.add(val);
+	}
+	CHECK(tree.getStats().add.predicateCalls.boxOf >= vecValues.size());
+
+	tree.resetStats();
+	std::size_t pairs = 0;
+	tree.forEachOverlappingPair([&](const TestBox&, const TestBox&) { ++pairs; });
+	CHECK(tree.getStats().query.predicateCalls.boxOf > 0);
+
+	tree.resetStats();
+	Box2D<float> region = { 0, 0, 1000, 1000 };
+	tree.getDensityRaster(region, 8, 8);
+	CHECK(tree.getStats().query.calls == 1);
+}
+
+// A cache must not reuse nodes or results of another tree, even one built the same way at
+// the same address. Under -fsanitize=address a stale cache also reads freed nodes
+void testQueryCacheIdentity() {
+
+	std::srand(8);
+	std::vector<TestBox> vecValues = makeTestBoxes(500, 1000, 10);
+	Box2D<float> box = { 400, 400, 420, 420 };
+
+	TestBoxTree::QueryCache cache;
+	alignas(TestBoxTree) unsigned char storage[sizeof(TestBoxTree)];
+
+	for (int pass = 0; pass < 2; ++pass) {
+		TestBoxTree* pTree = new (storage) TestBoxTree();
+		for (auto&& val : vecValues) {
+			pTree->add(val);
+		}
+		pTree->rebalance();
+
+		// The second tree lacks one of the values the first one returned
+		if (pass == 1) {
+			std::set<TestBox> setNear = pTree->getNearbyValues(box);
+			CHECK(!setNear.empty());
+			if (!setNear.empty()) {
+				pTree->remove(*setNear.begin());
+			}
+		}
+		CHECK(idsOf(pTree->getNearbyValues(box, cache)) == idsOf(pTree->getNearbyValues(box)));
+
+		// A copy has the same values in different nodes
+		TestBoxTree copy(*pTree);
+		CHECK(idsOf(copy.getNearbyValues(box, cache)) == idsOf(pTree->getNearbyValues(box)));
+		CHECK(idsOf(pTree->getNearbyValues(box, cache)) == idsOf(pTree->getNearbyValues(box)));
+
+		pTree->~TestBoxTree();
+	}
+}
+
+// Large boxes belong to several nodes. Samples used to hold them more than once and come
+// back short after duplicates were dropped
+template<class Tree>
+void testSampling() {
+
+	std::srand(9);
+	std::vector<TestBox> vecValues = makeTestBoxes(3000, 2000, 40);
+
+	Tree tree;
+	for (auto&& val : vecValues) {
+		tree.add(val);
+	}
+	tree.rebalance();
+
+	for (int query = 0; query < 50; ++query) {
+		float x = static_cast<float>(std::rand() % 2000);
+		float y = static_cast<float>(std::rand() % 2000);
+		Box2D<float> box = { x, y, x + 400, y + 400 };
+		std::set<int> setNear = idsOf(tree.getNearbyValues(box));
+
+		for (std::size_t n : { std::size_t(1), std::size_t(40), std::size_t(300), setNear.size() + 10 }) {
+			std::vector<TestBox> vecSample = tree.getSampleValues(box, n, query);
+			std::set<int> setSample = idsOf(vecSample);
+			CHECK(setSample.size() == vecSample.size());
+			CHECK(vecSample.size() == std::min(n, setNear.size()));
+			CHECK(std::includes(setNear.begin(), setNear.end(), setSample.begin(), setSample.end()));
+			CHECK(idsOf(tree.getSampleValues(box, n, query)) == setSample);
+		}
+	}
+}
+
+// Returns the ids of the k nearest other values of val, nearest first and equal distances by id
+std::vector<int> nearestIds(const std::vector<TestBox>& vecValues, const TestBox& val, std::size_t k) {
+	std::vector<std::pair<double, int> > vecRanked;
+	for (auto&& other : vecValues) {
+		if (other.id != val.id) {
+			vecRanked.push_back(std::make_pair(boxDistanceSquared(TestBoxOf()(val), TestBoxOf()(other)), other.id));
+		}
+	}
+	std::sort(vecRanked.begin(), vecRanked.end());
+	std::vector<int> vecIds;
+	for (std::size_t i = 0; i < k && i < vecRanked.size(); ++i) {
+		vecIds.push_back(vecRanked[i].second);
+	}
+	return vecIds;
+}
+
+// Returns the ids of every value's neighbors by the value's id
+std::map<int, std::vector<int> > neighborIds(const std::vector<TestBoxTree::Neighbors>& vecNeighbors) {
+	std::map<int, std::vector<int> > mapIds;
+	for (auto&& neighbors : vecNeighbors) {
+		std::vector<int>& vecIds = mapIds[neighbors.value.id];
+		for (auto&& val : neighbors.nearest) {
+			vecIds.push_back(val.id);
+		}
+	}
+	return mapIds;
+}
+
+// Threads must find the same neighbors as the serial search, and both the brute force ones
+void testNearestNeighbors() {
+
+	const std::size_t k = 6;
+	std::srand(10);
+	std::vector<TestBox> vecValues = makeTestBoxes(3000, 4000, 30);
+
+	TestBoxTree tree;
+	for (auto&& val : vecValues) {
+		tree.add(val);
+	}
+	tree.rebalance();
+
+	std::map<int, std::vector<int> > mapSerial = neighborIds(tree.getAllNearestNeighbors(k));
+	CHECK(mapSerial.size() == vecValues.size());
+	CHECK(neighborIds(tree.getAllNearestNeighbors(k, ParallelRanges(4))) == mapSerial);
+	CHECK(neighborIds(tree.getAllNearestNeighbors(k, ParallelRanges())) == mapSerial);
+
+	for (std::size_t i = 0; i < vecValues.size(); i += 37) {
+		CHECK(mapSerial[vecValues[i].id] == nearestIds(vecValues, vecValues[i], k));
+	}
+}
+
+// Returns the number of values with box centers in each cell, as getDensityRaster lays them out
+template<class BoxOf>
+std::vector<std::size_t> countCenters(const std::vector<TestBox>& vecValues, const Box2D<float>& region, std::size_t width, std::size_t height) {
+	std::vector<std::size_t> vecCounts(width * height, 0);
+	double cellWidth = (static_cast<double>(region.maxX) - region.minX) / width;
+	double cellHeight = (static_cast<double>(region.maxY) - region.minY) / height;
+	for (auto&& val : vecValues) {
+		Box2D<float> box = BoxOf()(val);
+		double x = (static_cast<double>(box.minX) + box.maxX) / 2;
+		double y = (static_cast<double>(box.minY) + box.maxY) / 2;
+		if (region.minX <= x && x <= region.maxX && region.minY <= y && y <= region.maxY) {
+			std::size_t column = std::min(static_cast<std::size_t>((x - region.minX) / cellWidth), width - 1);
+			std::size_t row = std::min(static_cast<std::size_t>((y - region.minY) / cellHeight), height - 1);
+			++vecCounts[row * width + column];
+		}
+	}
+	return vecCounts;
+}
+
+// Boxes belong to many nodes each, but count once in the cell of their center. Rasters used
+// to count them once per node
+template<class Tree, class BoxOf>
+void testDensityRaster() {
+
+	std::srand(11);
+	std::vector<TestBox> vecValues = makeTestBoxes(3000, 5000, 60);
+
+	Tree tree;
+	for (auto&& val : vecValues) {
+		tree.add(val);
+	}
+
+	Box2D<float> world = { 0, 0, 5100, 5100 };
+	Box2D<float> part = { 700, 1200, 2700, 2200 };
+	for (int pass = 0; pass < 3; ++pass) {
+		CHECK(tree.getDensityRaster(world, 1, 1) == countCenters<BoxOf>(vecValues, world, 1, 1));
+		CHECK(tree.getDensityRaster(world, 64, 64) == countCenters<BoxOf>(vecValues, world, 64, 64));
+		CHECK(tree.getDensityRaster(part, 20, 10) == countCenters<BoxOf>(vecValues, part, 20, 10));
+
+		if (pass == 0) {
+			tree.rebalance();
+		}
+		else {
+			for (std::size_t i = 0; i < 1000; ++i) {
+				tree.remove(vecValues.back());
+				vecValues.pop_back();
+			}
+		}
+	}
+}
+
+// Box predicate without boxOf, so nodes only know their search spaces and not their values' bounds
+struct NoBoxPredicate : SearchPredicate<TestBox, Box2D<float> > {
+	Box2D<float> nilCompare() override {
+		return boxes.nilCompare();
+	}
+
+	Box2D<float> buildRegionFromData(const std::set<TestBox>& values) override {
+		return boxes.buildRegionFromData(values);
+	}
+
+	void buildQuadrantsFromData(const Box2D<float>& parentRegion, const std::set<TestBox>& values, const std::map<RegionCode, Box2D<float>&>& quads) override {
+		boxes.buildQuadrantsFromData(parentRegion, values, quads);
+	}
+
+	bool satisfies(const Box2D<float>& nodeCompare, const TestBox& val) override {
+		return boxes.satisfies(nodeCompare, val);
+	}
+
+	bool overlaps(const Box2D<float>& compareLeft, const Box2D<float>& compareRight) override {
+		return boxes.overlaps(compareLeft, compareRight);
+	}
+
+	BoxPredicate2D<TestBox, float, TestBoxOf> boxes;
+};
+
+using NoBoxTree = SearchTree2D<TestBox, Box2D<float>, NoBoxPredicate>;
+
+// Values straddling a node's edge satisfy search spaces that miss the node. Without boxOf
+// a subtracted search space missing the node used to let them through
+template<class Tree>
+void testRegionExpressions() {
+
+	using Expression = typename Tree::RegionExpression;
+
+	std::srand(12);
+	std::vector<TestBox> vecValues = makeTestBoxes(1000, 2000, 60);
+
+	Tree tree;
+	for (auto&& val : vecValues) {
+		tree.add(val);
+	}
+	tree.rebalance();
+
+	for (int query = 0; query < 50; ++query) {
+		float x = static_cast<float>(std::rand() % 1600);
+		float y = static_cast<float>(std::rand() % 1600);
+		Box2D<float> a = { x, y, x + 400, y + 400 };
+		Box2D<float> b = { x + 100 + std::rand() % 200, y + 100 + std::rand() % 200, x + 500, y + 350 };
+
+		std::set<int> setA = overlappingIds<TestBoxOf>(vecValues, a);
+		std::set<int> setB = overlappingIds<TestBoxOf>(vecValues, b);
+		std::set<int> setDifference, setIntersection, setUnion;
+		std::set_difference(setA.begin(), setA.end(), setB.begin(), setB.end(), std::inserter(setDifference, setDifference.end()));
+		std::set_intersection(setA.begin(), setA.end(), setB.begin(), setB.end(), std::inserter(setIntersection, setIntersection.end()));
+		std::set_union(setA.begin(), setA.end(), setB.begin(), setB.end(), std::inserter(setUnion, setUnion.end()));
+
+		CHECK(idsOf(tree.getExpressionValues(Expression::subtract(Expression::region(a), Expression::region(b)))) == setDifference);
+		CHECK(idsOf(tree.getExpressionValues(Expression::intersect(Expression::region(a), Expression::region(b)))) == setIntersection);
+		CHECK(idsOf(tree.getExpressionValues(Expression::unite(Expression::region(a), Expression::region(b)))) == setUnion);
+	}
+}
+
+int main() {
+	testQueries<TestBoxTree, TestBoxOf>();
+	testQueries<TestPointTree, PointBoxOf<TestBox, float, TestPointOf> >();
+	testStats();
+	testQueryCacheIdentity();
+	testSampling<TestBoxTree>();
+	testSampling<TestPointTree>();
+	testNearestNeighbors();
+	testDensityRaster<TestBoxTree, TestBoxOf>();
+	testDensityRaster<TestPointTree, PointBoxOf<TestBox, float, TestPointOf> >();
+	testRegionExpressions<TestBoxTree>();
+	testRegionExpressions<NoBoxTree>();
+	return testResult("treeTest");
+}